@@ -0,0 +1,148 @@
+"""
+File: bench_stage1.py
+Author: David T.
+Description: benchmark the stage1 compiler on a large generated dav file
+
+Usage:
+    python3 bench/bench_stage1.py [--baseline REV] [--funcs N] [--runs K]
+                                  [--body B] [--lex REPEAT | --parse REPEAT]
+                                  [--jobs J]
+
+Builds stage1a_compiler.c from the working tree (and, with --baseline, the
+stage1a_compiler.c of an older git revision) with gcc -O2, then times each
+compiler on the same generated input and prints the best wall time.
+With --lex, only the lexer is timed ('compiler --lex file REPEAT') and the
+throughput is the input size times REPEAT over the wall time. --parse does
+the same for lexer plus parser ('compiler --parse file REPEAT'), dropping
+the C output. --body repeats the loop of each function B times, e.g.
+--funcs 1000 --body 31 makes a file of about 1M tokens. --jobs lexes with
+J worker processes (lex_parallel), in --lex mode and for full compiles.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def gen_function(k, body=1):
+    # A small function that exercises declarations, loops, branches,
+    # relational/logical operators, string compares and calls.
+    call = f'fn_{k - 1}(x, b)' if k > 0 else 'x'
+    loop = (
+        f'    // Count down in steps of one or two\n'
+        f'    while x > 0 {{\n'
+        f'        if x == 3 || x >= 10 {{\n'
+        f'            x = x - 1;\n'
+        f'        }} else {{\n'
+        f'            x = x - 2;\n'
+        f'        }}\n'
+        f'    }}\n'
+    )
+    return (
+        f'ah int fn_{k}(int a, int b) {{\n'
+        f'    beg int x = a + b * 2;\n'
+        f'    beg char* s = "name_{k}";\n'
+        + loop * body +
+        f'    if s == "abc" && b != 0 {{\n'
+        f'        return 1;\n'
+        f'    }}\n'
+        f'    return {call};\n'
+        f'}}\n\n'
+    )
+
+
+def gen_source(n_funcs, body=1):
+    src = '// Generated by bench/bench_stage1.py\n\n'
+    src += ''.join(gen_function(k, body) for k in range(n_funcs))
+    src += 'ah int main() {\n'
+    src += f'    boo(fn_{n_funcs - 1}(1, 2));\n'
+    src += '    return 0;\n'
+    src += '}\n'
+    return src
+
+
+def build(c_path, exe_path):
+    subprocess.run(['gcc', '-w', '-O2', c_path, '-o', exe_path], check=True)
+
+
+def time_compiler(cmd, runs):
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    ap.add_argument('--baseline', help='git revision to compare against')
+    ap.add_argument('--funcs', type=int, default=450,
+                    help='number of generated functions')
+    ap.add_argument('--runs', type=int, default=10,
+                    help='runs per compiler, best time is reported')
+    ap.add_argument('--body', type=int, default=1,
+                    help='loops per generated function')
+    mode = ap.add_mutually_exclusive_group()
+    mode.add_argument('--lex', type=int, metavar='REPEAT',
+                      help='time only the lexer, tokenizing REPEAT times')
+    mode.add_argument('--parse', type=int, metavar='REPEAT',
+                      help='time only lexer and parser, parsing REPEAT times')
+    ap.add_argument('--jobs', type=int, default=1,
+                    help='lexer worker processes')
+    args = ap.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        src_path = os.path.join(tmp, 'bench.dav')
+        with open(src_path, 'w') as f:
+            f.write(gen_source(args.funcs, args.body))
+        size_mb = os.path.getsize(src_path) / 1e6
+
+        compilers = [('working tree', os.path.join(ROOT, 'stage1a_compiler.c'))]
+        if args.baseline:
+            base_c = os.path.join(tmp, 'baseline.c')
+            with open(base_c, 'w') as f:
+                f.write(subprocess.run(
+                    ['git', 'show', f'{args.baseline}:stage1a_compiler.c'],
+                    cwd=ROOT, check=True, capture_output=True, text=True).stdout)
+            compilers.insert(0, (args.baseline, base_c))
+
+        print(f'input: {args.funcs} functions, {size_mb:.2f} MB')
+        results = []
+        for i, (name, c_path) in enumerate(compilers):
+            exe = os.path.join(tmp, f'compiler{i}')
+            build(c_path, exe)
+            if args.lex:
+                cmd = [exe, '--lex', src_path, str(args.lex)]
+                if args.jobs > 1:
+                    cmd.append(str(args.jobs))
+                work_mb = size_mb * args.lex
+            elif args.parse:
+                cmd = [exe, '--parse', src_path, str(args.parse)]
+                work_mb = size_mb * args.parse
+            else:
+                cmd = [exe, src_path, os.path.join(tmp, f'out{i}.c')]
+                if args.jobs > 1:
+                    cmd[1:1] = ['--jobs', str(args.jobs)]
+                work_mb = size_mb
+            try:
+                best = time_compiler(cmd, args.runs)
+            except subprocess.CalledProcessError:
+                print(f'{name:>14}: n/a')
+                continue
+            results.append(best)
+            print(f'{name:>14}: {best * 1000:8.2f} ms  '
+                  f'({work_mb / best:6.2f} MB/s)')
+
+        if len(results) == 2:
+            print(f'{"speedup":>14}: {results[0] / results[1]:8.2f}x')
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -1,8 +1,7 @@
 """
 File: token.py
 Author: David T.
-Description: token regex and reserved keywords
-Reference: https://docs.python.org/3/library/re.html#writing-a-tokenizer
+Description: token patterns and reserved keywords
 """
 
 from typing import NamedTuple
@@ -15,9 +14,21 @@ class Token(NamedTuple):
     column: int
 
 
+class TokenArrays(NamedTuple):
+    """Tokens as parallel lists; kinds are indices into KIND_NAMES."""
+    kinds: list[int]
+    values: list[str | int | float | None]
+    lines: list[int]
+    columns: list[int]
+
+
+# Single source of truth for tokens. gen_dfa.py compiles these patterns
+# into the DFA tables both lexers run on (dfa_table.py for this one, the
+# DFA_* strings in stage1). The longest match wins; on a tie, the earlier
+# pattern. Patterns use a subset of Python regex syntax, see gen_dfa.py.
 TOKEN_SPEC = [
-    ('COMMENT',   r'//([^\n\r]*)'),  # Comment till newline/EOL
-    ('TYPE',      r'(int\*|char\*|int|char|void)'),
+    ('COMMENT',   r'//[^\n]*'),  # Comment till newline/EOF
+    ('TYPE',      r'(int\*|char\*\*|char\*|int|char|void)'),
     ('STRING',    r'"([^"\\]|\\.)*"'),  # Double quoted string
     ('CHAR',      r"'(\\.|[^\\'])'"),
     ('NUMBER',    r'\d+(\.\d*)?'),  # Integer or decimal number
@@ -48,9 +59,9 @@ TOKEN_SPEC = [
     ('MISMATCH',  r'.')
 ]
 
-TOKEN_REGEX = "|".join(
-    f'(?P<{name}>{pattern})' for name, pattern in TOKEN_SPEC)
-
+# Single source of truth for reserved words. The stage1 check_keywords() is
+# generated from this table by gen_keywords.py. Type names map to TYPE; in
+# both lexers they are already caught by the TYPE pattern above.
 KEYWORDS = {
     'ah': 'FN',
     'beg': 'LET',
@@ -59,7 +70,12 @@ KEYWORDS = {
     'else': 'ELSE',
     'while': 'WHILE',
     'return': 'RETURN',
-    'int': 'INT',
-    'char': 'CHAR',
-    'void': 'VOID',
+    'int': 'TYPE',
+    'char': 'TYPE',
+    'void': 'TYPE',
 }
+
+# Every token kind, for the int kinds of TokenArrays. EOF is 0.
+KIND_NAMES = ('EOF',) + tuple(dict.fromkeys(
+    [name for name, _ in TOKEN_SPEC] + list(KEYWORDS.values())))
+KIND_IDS = {name: i for i, name in enumerate(KIND_NAMES)}
@@ -0,0 +1,442 @@
+"""
+File: gen_dfa.py
+Author: David T.
+Description: compile TOKEN_SPEC into one minimized DFA for both lexers
+
+Usage (from the repo root):
+    python3 -m python.lexer.gen_dfa stage1_compiler.dav
+    python3 -m python.lexer.gen_dfa --check stage1_compiler.dav
+
+TOKEN_SPEC in custom_token.py is the single source of truth for tokens.
+This script turns its regexes into one DFA (Thompson NFA, subset
+construction, then Moore minimization) and writes it twice:
+  - python/lexer/dfa_table.py, the tables the stage0 lexer runs on
+  - the DFA_* strings between the BEGIN/END markers in the given .dav
+    file, which the stage1 lexer decodes into int arrays at startup
+
+Both lexers run the same longest-match loop over the same tables, so they
+split any input into the same tokens. When two patterns match the same
+text the earlier one in TOKEN_SPEC wins.
+
+Characters are grouped into classes that no pattern tells apart, and the
+transition table is indexed by (state, class). Symbol 128 stands for every
+non-ASCII character (every byte >= 128 in stage1); '\\0' is in no pattern
+and always ends a token.
+
+States that loop on exactly the chars a stage1 scan kernel skips are
+tagged with that kernel, so both lexers can skip such runs (identifiers,
+comments, string bodies) in one go instead of one table step per char.
+"""
+
+import os
+import re
+import sys
+from .custom_token import TOKEN_SPEC
+
+BEGIN_MARKER = '// --- BEGIN GENERATED: dfa ---\n'
+END_MARKER = '// --- END GENERATED: dfa ---\n'
+PY_TABLE = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                        'dfa_table.py')
+
+N_SYMBOLS = 129  # ASCII + one symbol for all non-ASCII
+ANY = frozenset(range(1, N_SYMBOLS))
+
+# Scan kernels of the stage1 runtime, by the chars they skip.
+# The numbers are the DFA_ACCEL codes stage1 dispatches on.
+IDENT_CHARS = frozenset(ord(c) for c in
+                        'abcdefghijklmnopqrstuvwxyz'
+                        'ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_')
+ACCEL_KERNELS = [
+    (1, 'scan_ident', IDENT_CHARS),
+    (2, 'scan_line_end', ANY - {ord('\n')}),
+    (3, 'scan_string_end', ANY - {ord('"'), ord('\\')}),
+]
+
+# Table values are stored as printable chars, chr(ENCODE_BASE + value)
+ENCODE_BASE = 40
+
+
+# ==============================================================
+# Regex -> NFA
+
+ESCAPES = {'n': '\n', 't': '\t', 'r': '\r', '0': '\0'}
+CLASS_ESCAPES = {'d': frozenset(range(ord('0'), ord('9') + 1))}
+
+
+class RegexParser:
+    """
+    Parses the regex subset used by TOKEN_SPEC: literals, escapes,
+    [classes], '.', groups, '|', '*', '+' and '?'. Returns a tree of
+    ('set', symbols), ('cat', [..]), ('alt', [..]), ('star' | 'plus' |
+    'opt', node).
+    """
+
+    def __init__(self, pattern):
+        self.p = pattern
+        self.i = 0
+
+    def parse(self):
+        node = self.alt()
+        if self.i != len(self.p):
+            raise ValueError(f'Unexpected {self.p[self.i]!r} in {self.p!r}')
+        return node
+
+    def peek(self):
+        return self.p[self.i] if self.i < len(self.p) else None
+
+    def alt(self):
+        branches = [self.cat()]
+        while self.peek() == '|':
+            self.i += 1
+            branches.append(self.cat())
+        return branches[0] if len(branches) == 1 else ('alt', branches)
+
+    def cat(self):
+        items = []
+        while self.peek() not in (None, '|', ')'):
+            items.append(self.repeat())
+        return ('cat', items)
+
+    def repeat(self):
+        node = self.atom()
+        while self.peek() in ('*', '+', '?'):
+            op = {'*': 'star', '+': 'plus', '?': 'opt'}[self.p[self.i]]
+            self.i += 1
+            node = (op, node)
+        return node
+
+    def atom(self):
+        c = self.p[self.i]
+        self.i += 1
+        if c == '(':
+            node = self.alt()
+            if self.peek() != ')':
+                raise ValueError(f'Missing ) in {self.p!r}')
+            self.i += 1
+            return node
+        if c == '[':
+            return ('set', self.char_class())
+        if c == '.':
+            return ('set', ANY - {ord('\n')})
+        if c == '\\':
+            return ('set', self.escape())
+        return ('set', frozenset({ord(c)}))
+
+    def escape(self):
+        c = self.p[self.i]
+        self.i += 1
+        if c in CLASS_ESCAPES:
+            return CLASS_ESCAPES[c]
+        return frozenset({ord(ESCAPES.get(c, c))})
+
+    def char_class(self):
+        negate = self.peek() == '^'
+        if negate:
+            self.i += 1
+        chars = set()
+        while self.peek() != ']':
+            if self.peek() is None:
+                raise ValueError(f'Missing ] in {self.p!r}')
+            c = self.p[self.i]
+            self.i += 1
+            if c == '\\':
+                chars |= self.escape()
+                continue
+            if self.peek() == '-' and self.p[self.i + 1] != ']':
+                last = self.p[self.i + 1]
+                self.i += 2
+                chars |= set(range(ord(c), ord(last) + 1))
+            else:
+                chars.add(ord(c))
+        self.i += 1
+        return ANY - chars if negate else frozenset(chars)
+
+
+class NFA:
+    """Thompson NFA: edges[state] is a list of (symbols or None, target)."""
+
+    def __init__(self):
+        self.edges = []
+        self.accept = {}  # state -> (priority, token name)
+
+    def new_state(self):
+        self.edges.append([])
+        return len(self.edges) - 1
+
+    def build(self, node, start):
+        """Adds 'node' starting at 'start', returns its end state."""
+        kind = node[0]
+        if kind == 'set':
+            end = self.new_state()
+            self.edges[start].append((node[1], end))
+            return end
+        if kind == 'cat':
+            for item in node[1]:
+                start = self.build(item, start)
+            return start
+        if kind == 'alt':
+            end = self.new_state()
+            for branch in node[1]:
+                self.edges[self.build(branch, start)].append((None, end))
+            return end
+        # star / plus / opt
+        loop = self.new_state()
+        self.edges[start].append((None, loop))
+        end = self.new_state()
+        body_end = self.build(node[1], loop)
+        if kind in ('star', 'plus'):
+            self.edges[body_end].append((None, loop))
+        self.edges[body_end].append((None, end))
+        if kind in ('star', 'opt'):
+            self.edges[loop].append((None, end))
+        return end
+
+
+def build_nfa(spec):
+    nfa = NFA()
+    start = nfa.new_state()
+    for priority, (name, pattern) in enumerate(spec):
+        token_start = nfa.new_state()
+        nfa.edges[start].append((None, token_start))
+        end = nfa.build(RegexParser(pattern).parse(), token_start)
+        nfa.accept[end] = (priority, name)
+    return nfa, start
+
+
+# ==============================================================
+# NFA -> minimized DFA
+
+def symbol_classes(nfa):
+    """
+    Groups symbols that every NFA edge treats the same way.
+    Returns class_of (symbol -> class); '\\0' is always class 0.
+    """
+    signature = {s: [] for s in range(N_SYMBOLS)}
+    for edges in nfa.edges:
+        for symbols, _ in edges:
+            if symbols is not None:
+                for s in range(N_SYMBOLS):
+                    signature[s].append(s in symbols)
+    classes = {}
+    class_of = []
+    for s in range(N_SYMBOLS):
+        key = (s == 0, tuple(signature[s]))
+        class_of.append(classes.setdefault(key, len(classes)))
+    return class_of
+
+
+def closure(nfa, states):
+    stack = list(states)
+    seen = set(states)
+    while stack:
+        for symbols, target in nfa.edges[stack.pop()]:
+            if symbols is None and target not in seen:
+                seen.add(target)
+                stack.append(target)
+    return frozenset(seen)
+
+
+def build_dfa(spec):
+    """
+    Returns (class_of, trans, accept): trans[state][cls] is the next
+    state, accept[state] the token name or None. State 0 is the dead
+    state and state 1 the start state.
+    """
+    nfa, nfa_start = build_nfa(spec)
+    class_of = symbol_classes(nfa)
+    n_classes = max(class_of) + 1
+    rep = [class_of.index(c) for c in range(n_classes)]
+
+    # --- Subset construction ---
+    dead = frozenset()
+    ids = {dead: 0}
+    order = [dead]
+    trans = [[0] * n_classes]
+    work = [closure(nfa, [nfa_start])]
+    ids[work[0]] = 1
+    order.append(work[0])
+    trans.append(None)
+    while work:
+        subset = work.pop()
+        row = []
+        for cls in range(n_classes):
+            moved = {target for state in subset
+                     for symbols, target in nfa.edges[state]
+                     if symbols is not None and rep[cls] in symbols}
+            target = closure(nfa, moved) if moved else dead
+            if target not in ids:
+                ids[target] = len(order)
+                order.append(target)
+                trans.append(None)
+                work.append(target)
+            row.append(ids[target])
+        trans[ids[subset]] = row
+
+    accept = []
+    for subset in order:
+        hits = [nfa.accept[s] for s in subset if s in nfa.accept]
+        accept.append(min(hits)[1] if hits else None)
+
+    return class_of, *minimize(trans, accept)
+
+
+def minimize(trans, accept):
+    """Moore's algorithm; keeps dead = 0 and start = 1."""
+    n = len(trans)
+    group = [(i == 0, accept[i]) for i in range(n)]
+    while True:
+        keys = [(group[i], tuple(group[t] for t in trans[i]))
+                for i in range(n)]
+        numbering = {}
+        for i in (0, 1, *range(2, n)):
+            numbering.setdefault(keys[i], len(numbering))
+        new_group = [numbering[keys[i]] for i in range(n)]
+        if len(set(new_group)) == len(set(group)):
+            break
+        group = new_group
+    numbering = {}
+    for i in (0, 1, *range(2, n)):
+        numbering.setdefault(group[i], len(numbering))
+    size = len(numbering)
+    new_trans = [None] * size
+    new_accept = [None] * size
+    for i in range(n):
+        g = numbering[group[i]]
+        new_trans[g] = [numbering[group[t]] for t in trans[i]]
+        new_accept[g] = accept[i]
+    return new_trans, new_accept
+
+
+def accel_codes(class_of, trans):
+    """
+    Returns per state the code of the scan kernel that skips exactly the
+    chars looping back to that state, or 0.
+    """
+    codes = []
+    for state, row in enumerate(trans):
+        loop = frozenset(c for c in range(N_SYMBOLS)
+                         if state != 0 and row[class_of[c]] == state)
+        codes.append(next((code for code, _, chars in ACCEL_KERNELS
+                           if chars == loop), 0))
+    return codes
+
+
+# ==============================================================
+# Emitters
+
+def encode(values):
+    """Encodes small ints as a Dav string literal body."""
+    out = []
+    for v in values:
+        c = chr(ENCODE_BASE + v)
+        if not ENCODE_BASE <= ord(c) <= 126:
+            raise ValueError(f'Table value {v} does not fit in a char')
+        out.append('\\\\' if c == '\\' else c)
+    return ''.join(out)
+
+
+def gen_python_table(class_of, trans, accept, accel):
+    """Returns the source of dfa_table.py."""
+    out = ['"""\n',
+           'File: dfa_table.py\n',
+           'Author: David T.\n',
+           'Description: token DFA for the stage0 lexer\n',
+           '\n',
+           'Generated by python/lexer/gen_dfa.py from TOKEN_SPEC, do not edit.\n',
+           '"""\n',
+           '\n',
+           f'N_CLASSES = {len(trans[0])}\n',
+           '\n',
+           '# Class of each char code; 128 stands for every non-ASCII char\n',
+           f'CLASS_OF = {class_of!r}\n',
+           '\n',
+           '# NEXT[state * N_CLASSES + class]; state 0 is dead, 1 is the start\n',
+           'NEXT = [\n']
+    for row in trans:
+        out.append(f'    {", ".join(map(str, row))},\n')
+    out.append(']\n\n')
+    out.append('# Token name accepted in each state, or None\n')
+    out.append(f'ACCEPT = {accept!r}\n\n')
+    out.append('# Scan kernel that may skip a run of chars in each state, or 0\n')
+    out.append(f'ACCEL = {accel!r}\n')
+    return ''.join(out)
+
+
+def tk_codes(dav_source):
+    """Reads the TK_* kind constants of the stage1 compiler."""
+    return {name: int(value) for name, value in
+            re.findall(r'beg int TK_(\w+) = (\d+);', dav_source)}
+
+
+def gen_dav_block(class_of, trans, accept, accel, codes):
+    """Returns the DFA_* globals for stage1, with the BEGIN/END markers."""
+    missing = sorted({a for a in accept if a and a not in codes})
+    if missing:
+        raise ValueError(f'No TK_ constant for {", ".join(missing)}')
+    flat = [t for row in trans for t in row]
+    kinds = [codes[a] + 1 if a else 0 for a in accept]
+    return ''.join([
+        BEGIN_MARKER,
+        '// Token DFA, see lex_fill() and dfa_init().\n',
+        '// Generated by python/lexer/gen_dfa.py from TOKEN_SPEC, do not edit.\n',
+        '// Each char is one table value, stored as value + 40.\n',
+        f'beg int DFA_STATES = {len(trans)};\n',
+        f'beg int DFA_CLASSES = {len(trans[0])};\n',
+        f'beg char* DFA_CLASS_OF = "{encode(class_of)}"; // Per char code 0..128\n',
+        f'beg char* DFA_NEXT = "{encode(flat)}";\n',
+        f'beg char* DFA_ACCEPT = "{encode(kinds)}"; // TK_* + 1, 0 if none\n',
+        f'beg char* DFA_ACCEL = "{encode(accel)}";\n',
+        END_MARKER,
+    ])
+
+
+def splice(source, generated):
+    """Replaces the generated block in 'source' with 'generated'."""
+    start = source.index(BEGIN_MARKER)
+    end = source.index(END_MARKER) + len(END_MARKER)
+    return source[:start] + generated + source[end:]
+
+
+def generate(dav_source):
+    """Returns (dfa_table.py source, updated .dav source)."""
+    class_of, trans, accept = build_dfa(TOKEN_SPEC)
+    accel = accel_codes(class_of, trans)
+    table = gen_python_table(class_of, trans, accept, accel)
+    block = gen_dav_block(class_of, trans, accept, accel, tk_codes(dav_source))
+    return table, splice(dav_source, block)
+
+
+def main():
+    args = sys.argv[1:]
+    check = '--check' in args
+    paths = [a for a in args if a != '--check']
+    if len(paths) != 1:
+        print('Usage: python3 -m python.lexer.gen_dfa [--check] compiler.dav')
+        return 2
+
+    with open(paths[0]) as f:
+        source = f.read()
+    table, updated = generate(source)
+    old_table = ''
+    if os.path.exists(PY_TABLE):
+        with open(PY_TABLE) as f:
+            old_table = f.read()
+    if check:
+        stale = [p for p, ok in ((paths[0], updated == source),
+                                 (PY_TABLE, table == old_table)) if not ok]
+        for path in stale:
+            print(f'[error] {path} is out of date with TOKEN_SPEC')
+        if stale:
+            return 1
+        print(f'[ok] {paths[0]} and dfa_table.py are up to date')
+        return 0
+    with open(paths[0], 'w') as f:
+        f.write(updated)
+    with open(PY_TABLE, 'w') as f:
+        f.write(table)
+    print(f'[ok] Updated {paths[0]} and {PY_TABLE}')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
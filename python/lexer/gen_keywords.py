@@ -0,0 +1,94 @@
+"""
+File: gen_keywords.py
+Author: David T.
+Description: generate the stage1 check_keywords() from KEYWORDS
+
+Usage (from the repo root):
+    python3 -m python.lexer.gen_keywords stage1_compiler.dav
+    python3 -m python.lexer.gen_keywords --check stage1_compiler.dav
+
+KEYWORDS in custom_token.py is the single source of truth for keywords and
+type names. This script turns it into a Dav function that dispatches on the
+identifier length, then on its first character, so classifying an identifier
+costs a few char compares instead of a strcmp per keyword. The function is
+written between the BEGIN/END markers in the given .dav file.
+"""
+
+import sys
+from .custom_token import KEYWORDS
+
+BEGIN_MARKER = '// --- BEGIN GENERATED: check_keywords ---\n'
+END_MARKER = '// --- END GENERATED: check_keywords ---\n'
+
+
+def gen_check_keywords(keywords=KEYWORDS):
+    """
+    Returns the Dav source of check_keywords(char* s, int len), including
+    the BEGIN/END markers.
+    """
+    by_len = {}
+    for word in sorted(keywords):
+        by_len.setdefault(len(word), {}).setdefault(word[0], []).append(word)
+
+    out = [BEGIN_MARKER]
+    out.append('ah int check_keywords(char* s, int len) {\n')
+    out.append('    // Returns the token kind of identifier \'s\' (length \'len\'):\n')
+    out.append('    // a keyword kind, TK_TYPE for type names, or TK_ID.\n')
+    out.append('    // Generated by python/lexer/gen_keywords.py, do not edit.\n')
+
+    len_kw = 'if'
+    for length in sorted(by_len):
+        out.append(f'    {len_kw} len == {length} {{\n')
+        first_kw = 'if'
+        for first in sorted(by_len[length]):
+            out.append(f'        {first_kw} s[0] == \'{first}\' {{\n')
+            for word in by_len[length][first]:
+                rest = ' && '.join(
+                    f's[{i}] == \'{ch}\'' for i, ch in enumerate(word) if i > 0)
+                kind = f'TK_{keywords[word]}'
+                if rest:
+                    out.append(f'            if {rest} {{ return {kind}; }}\n')
+                else:
+                    out.append(f'            return {kind};\n')
+            first_kw = '} else if'
+        out.append('        }\n')
+        len_kw = '} else if'
+    out.append('    }\n')
+    out.append('    return TK_ID;\n')
+    out.append('}\n')
+    out.append(END_MARKER)
+    return ''.join(out)
+
+
+def splice(source, generated):
+    """Replaces the generated block in 'source' with 'generated'."""
+    start = source.index(BEGIN_MARKER)
+    end = source.index(END_MARKER) + len(END_MARKER)
+    return source[:start] + generated + source[end:]
+
+
+def main():
+    args = sys.argv[1:]
+    check = '--check' in args
+    paths = [a for a in args if a != '--check']
+    if len(paths) != 1:
+        print('Usage: python3 -m python.lexer.gen_keywords [--check] compiler.dav')
+        return 2
+
+    with open(paths[0]) as f:
+        source = f.read()
+    updated = splice(source, gen_check_keywords())
+    if check:
+        if updated != source:
+            print(f'[error] {paths[0]} is out of date with KEYWORDS')
+            return 1
+        print(f'[ok] {paths[0]} is up to date')
+        return 0
+    with open(paths[0], 'w') as f:
+        f.write(updated)
+    print(f'[ok] Updated {paths[0]}')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -6,7 +6,51 @@ Reference: https://docs.python.org/3/library/re.html#writing-a-tokenizer
 """
 
 import re
-from .custom_token import Token, TOKEN_REGEX, KEYWORDS
+from .custom_token import Token, TokenArrays, KEYWORDS, KIND_NAMES, KIND_IDS
+from .dfa_table import N_CLASSES, CLASS_OF, NEXT, ACCEPT, ACCEL
+
+# Runs of chars a DFA state loops on, by ACCEL code. Same sets as the
+# stage1 scan kernels: scan_ident, scan_line_end, scan_string_end.
+ACCEL_RUNS = [None,
+              re.compile(r'[A-Za-z0-9_]*'),
+              re.compile(r'[^\n\0]*'),
+              re.compile(r'[^"\\\0]*')]
+
+
+def match_token(text, pos):
+    """
+    Runs the token DFA on 'text' from 'pos' and returns (kind, end) of
+    the longest match. 'text' must end with '\0', which no pattern
+    matches. A char no pattern starts with is a MISMATCH of length 1.
+    """
+    state = 1
+    last = 0
+    i = pos
+    while state:
+        c = ord(text[i])
+        nxt = NEXT[state * N_CLASSES + CLASS_OF[c if c < 128 else 128]]
+        if nxt == state and ACCEL[state]:
+            # A run of chars this state loops on: skip it in one go
+            i = ACCEL_RUNS[ACCEL[state]].match(text, i).end()
+        else:
+            last = state
+            state = nxt
+            i += 1
+    if ACCEPT[last]:
+        return ACCEPT[last], i - 1
+
+    # Died inside an unfinished token (an unclosed string): step again
+    # from 'pos', keeping the longest match
+    kind, end = 'MISMATCH', pos + 1
+    state = 1
+    i = pos
+    while state:
+        if ACCEPT[state]:
+            kind, end = ACCEPT[state], i
+        c = ord(text[i])
+        state = NEXT[state * N_CLASSES + CLASS_OF[c if c < 128 else 128]]
+        i += 1
+    return kind, end
 
 
 def tokenize(code):
@@ -17,15 +61,15 @@ def tokenize(code):
     tokens = []
     line_num = 1
     line_start = 0
+    pos = 0
+    text = code + '\0'
 
-    # Initialize 'column' to 0 for the EOF token if the input code is empty
-    column = 0
-
-    for mo in re.finditer(TOKEN_REGEX, code):
-        kind = mo.lastgroup
-        value = mo.group()
+    while pos < len(code):
+        start = pos
+        kind, pos = match_token(text, start)
+        value = code[start:pos]
         # Calculate column based on match start position relative to the line's start
-        column = mo.start() - line_start
+        column = start - line_start
 
         if kind == 'NUMBER':
             # Converts to float if decimal is present, otherwise integer
@@ -33,17 +77,9 @@ def tokenize(code):
         elif kind == 'ID':
             if value in KEYWORDS:
                 kind = KEYWORDS[value]
-            else:
-                pass
-        elif kind == 'TYPE':
-            pass
-        elif kind == 'STRING':
-            pass
-        elif kind == 'COMMENT':
-            pass
         elif kind == 'NEWLINE':
             # Update line tracking variables and skip adding token
-            line_start = mo.end()
+            line_start = pos
             line_num += 1
             continue
         elif kind == 'SKIP':
@@ -57,10 +93,126 @@ def tokenize(code):
         # Append the successfully matched token
         tokens.append(Token(kind, value, line_num, column))
 
-    # Determine the column for the EOF token
-    eof_column = mo.end() - line_start if 'mo' in locals() else 0
-
-    # Append the mandatory End-Of-File token
-    tokens.append(Token('EOF', None, line_num, eof_column))
+    # Append the mandatory End-Of-File token, right after the last match
+    tokens.append(Token('EOF', None, line_num, pos - line_start))
 
     return tokens
+
+
+# ==============================================================
+# Fast mode
+#
+# tokenize_arrays() runs the same DFA as tokenize(), tuned for whole
+# files: whitespace is skipped with one regex match per run, chars are
+# mapped to their DFA class once for the whole text, and tokens go into
+# parallel lists with int kinds instead of one Token per match.
+
+class _ClassBytes(dict):
+    """str.translate() table: char -> chr(DFA class), non-ASCII -> 128's."""
+
+    def __missing__(self, char):
+        return CLASS_OF[128]
+
+
+CLASS_TABLE = _ClassBytes({c: cls for c, cls in enumerate(CLASS_OF[:128])})
+ROWS = [NEXT[s:s + N_CLASSES] for s in range(0, len(NEXT), N_CLASSES)]
+ACCEPT_IDS = [KIND_IDS[kind] if kind else -1 for kind in ACCEPT]
+KEYWORD_IDS = {word: KIND_IDS[kind] for word, kind in KEYWORDS.items()}
+SPACES = re.compile(r'[ \t\n]+')
+
+
+
+def single_char_kinds():
+    """Returns the kind of each char that is a whole token by itself, like ';'."""
+    kinds = {}
+    for c in range(1, 128):
+        state = ROWS[1][CLASS_OF[c]]
+        if ACCEPT[state] not in (None, 'MISMATCH') and not any(ROWS[state]):
+            kinds[chr(c)] = ACCEPT_IDS[state]
+    return kinds
+
+
+SINGLE_CHAR = single_char_kinds()
+
+ID, NUMBER, MISMATCH = KIND_IDS['ID'], KIND_IDS['NUMBER'], KIND_IDS['MISMATCH']
+
+
+def tokenize_arrays(code):
+    """
+    Fast mode of tokenize(): returns the same tokens as a TokenArrays of
+    parallel lists, with kinds as indices into KIND_NAMES.
+    """
+    kinds, values, lines, columns = [], [], [], []
+    line_num = 1
+    line_start = 0
+    pos = 0
+    n = len(code)
+    text = code + '\0'
+    classes = text.translate(CLASS_TABLE).encode('latin-1')
+
+    while pos < n:
+        char = text[pos]
+
+        # --- Whitespace, in bulk ---
+        if char in ' \t\n':
+            end = SPACES.match(text, pos).end()
+            newlines = text.count('\n', pos, end)
+            if newlines:
+                line_num += newlines
+                line_start = text.rindex('\n', pos, end) + 1
+            pos = end
+            continue
+
+        lines.append(line_num)
+        columns.append(pos - line_start)
+
+        # --- Single char tokens, without stepping the DFA ---
+        kind = SINGLE_CHAR.get(char)
+        if kind is not None:
+            kinds.append(kind)
+            values.append(char)
+            pos += 1
+            continue
+
+        # --- Everything else: same DFA loop as match_token() ---
+        state = 1
+        last = 0
+        i = pos
+        while state:
+            nxt = ROWS[state][classes[i]]
+            if nxt == state and ACCEL[state]:
+                i = ACCEL_RUNS[ACCEL[state]].match(text, i).end()
+            else:
+                last = state
+                state = nxt
+                i += 1
+        kind = ACCEPT_IDS[last]
+        end = i - 1
+        if kind < 0:
+            name, end = match_token(text, pos)
+            kind = KIND_IDS[name]
+        value = code[pos:end]
+
+        if kind == ID:
+            kind = KEYWORD_IDS.get(value, ID)
+        elif kind == NUMBER:
+            value = float(value) if '.' in value else int(value)
+        elif kind == MISMATCH:
+            raise SyntaxError(
+                f'Unexpected character {value!r} on line {line_num}')
+        kinds.append(kind)
+        values.append(value)
+        pos = end
+
+    kinds.append(KIND_IDS['EOF'])
+    values.append(None)
+    lines.append(line_num)
+    columns.append(pos - line_start)
+    return TokenArrays(kinds, values, lines, columns)
+
+
+def tokenize_fast(code):
+    """tokenize() built on tokenize_arrays(), for the stage0 compiler."""
+    kinds, values, lines, columns = tokenize_arrays(code)
+    names = [KIND_NAMES[kind] for kind in kinds]
+    return list(map(Token._make, zip(names, values, lines, columns)))
@@ -4,6 +4,19 @@ Author: David T.
 Description: parser takes in a list of tokens and output c code
 """
 
+# Precedence of each binary operator token, higher binds tighter. The
+# levels are C's, since binary_op() emits no parentheses. It type checks
+# 1-2 as logical, 3-4 as relational, 5 as additive, 6 as multiplicative.
+# Same table as OP_PREC in stage1.
+BINARY_PREC = {
+    'OR': 1, 'AND': 2,
+    'EQ': 3, 'NE': 3,
+    'LT': 4, 'GT': 4, 'LE': 4, 'GE': 4,
+    'PLUS': 5, 'MINUS': 5,
+    'MUL': 6, 'DIV': 6,
+}
+
+
 
 class Parser:
     """
@@ -15,15 +28,39 @@ class Parser:
         self.pos = 0
         self.fn_name = ""
         self.variables = {}
+        # Locals in declaration order, and len(scope_log) at each open
+        # block, so leaving a block drops the locals declared in it
+        self.scope_log = []
+        self.scope_marks = []
         # Add helper functions to global environment
         self.env = {
             "concat": "char*",
             "ctos": "char*",
+            "ctoi": "int",
             "itos": "char*",
+            "substr": "char*",
+            "grow_strs": "char**",
+            "grow_chars": "char*",
+            "grow_ints": "int*",
+            "skip_spaces": "int",
+            "scan_ident": "int",
+            "scan_line_end": "int",
+            "scan_string_end": "int",
+            "atoi": "int",
             "strlen": "int",
             "strcmp": "int",
             "read_file": "char*",
-            "write_file": "void"
+            "write_file": "void",
+            "open_output": "int",
+            "write_chars": "int",
+            "copy_chars": "void",
+            "open_cc": "int",
+            "close_cc": "int",
+            "shared_ints": "int*",
+            "free_shared": "void",
+            "fork_worker": "int",
+            "wait_workers": "int",
+            "exit_worker": "void"
         }
 
     # Returns kind of the next token
@@ -123,6 +160,8 @@ class Parser:
         elif self.peek() == 'LBRACE':
             self.next()
             self.variables = {}
+            self.scope_log = []
+            self.scope_marks = []
             for ptype, pname, parray_part in params:
                 if parray_part:  # If it's an array (parray_part is not "")
                     self.variables[pname] = ptype + \
@@ -143,6 +182,23 @@ class Parser:
             raise SyntaxError(
                 f'Expected \';\' or \'{{\' after function declaration, got {self.peek()}, line {line_num}')
 
+    # ==============================================================
+    # Block scopes
+    # Each if/else/while body is a block; its locals go out of scope at '}'.
+
+    def enter_scope(self):
+        self.scope_marks.append(len(self.scope_log))
+
+    def leave_scope(self):
+        mark = self.scope_marks.pop()
+        for name in self.scope_log[mark:]:
+            del self.variables[name]
+        del self.scope_log[mark:]
+
+    def declare(self, var_name, var_type):
+        self.variables[var_name] = var_type
+        self.scope_log.append(var_name)
+
     # ==============================================================
     # Statements
 
@@ -195,7 +251,7 @@ class Parser:
                         raise TypeError(
                             f'Redefinition of \'{var_name}\' with a different type: \'{var_type}\' vs \'{self.variables[var_name]}\', line {line_num}')
                 else:
-                    self.variables[var_name] = var_type
+                    self.declare(var_name, var_type)
                     return f'{var_type} {var_name} = {rhs_expr};'
             else:
                 if var_name in self.env:
@@ -234,7 +290,7 @@ class Parser:
             # Store array type as 'base_type*' (e.g., 'int*')
             array_type = var_type + '*'
             if not is_global:
-                self.variables[var_name] = array_type
+                self.declare(var_name, array_type)
             else:
                 self.env[var_name] = array_type
 
@@ -249,7 +305,7 @@ class Parser:
                     raise TypeError(
                         f'Redefinition of \'{var_name}\', line {line_num}')
                 else:
-                    self.variables[var_name] = var_type
+                    self.declare(var_name, var_type)
                     return f'{var_type} {var_name};'
             else:
                 if var_name in self.env:
@@ -369,8 +425,10 @@ class Parser:
         cond = self.expr()[1]
         self.expect('LBRACE')
         then_body = []
+        self.enter_scope()
         while self.peek() not in ('RBRACE', 'EOF'):
             then_body.append(self.statement())
+        self.leave_scope()
         self.expect('RBRACE')
         code = f'if ({cond}) {{\n'
         code += '\n'.join(' ' * indent + '    ' + s for s in then_body)
@@ -395,8 +453,10 @@ class Parser:
             elif self.peek() == 'LBRACE':
                 self.next()
                 else_body = []
+                self.enter_scope()
                 while self.peek() not in ('RBRACE', 'EOF'):
                     else_body.append(self.statement())
+                self.leave_scope()
                 self.expect('RBRACE')
 
                 code += f'{else_indent}else {{\n'
@@ -415,8 +475,10 @@ class Parser:
         cond = self.expr()[1]
         self.expect('LBRACE')
         body = []
+        self.enter_scope()
         while self.peek() not in ('RBRACE', 'EOF'):
             body.append(self.statement())
+        self.leave_scope()
         self.expect('RBRACE')
         code = f'while ({cond}) {{\n'
         code += '\n'.join(' ' * indent + '    ' + s for s in body)
@@ -440,36 +502,51 @@ class Parser:
     # Expressions
     # returns type, value
     def expr(self):
-        return self.logical()
-
-    def logical(self):
-        res_type, result = self.relational()
-        while self.peek() in ('OR', 'AND'):
-            op = self.next()[1]
-            rhs = self.relational()[1]
-            res_type, result = 'int', f'{result} {op} {rhs}'
-        return res_type, result
+        return self.binary(1)
 
-    def relational(self):
-        res_type, result = self.additive()
-        while self.peek() in ('EQ', 'NE', 'LT', 'GT', 'LE', 'GE'):
+    def binary(self, min_prec):
+        """
+        Precedence climbing over BINARY_PREC: parses operands joined by
+        operators of precedence 'min_prec' or higher. The right operand
+        only takes tighter operators, so equal ones associate left.
+        """
+        res_type, result = self.unary()
+        while BINARY_PREC.get(self.peek(), 0) >= min_prec:
             tok = self.next()
-            op = tok[1]
-            line_num = tok[2]
-            rhs_type, rhs = self.additive()
+            prec = BINARY_PREC[tok[0]]
+            rhs_type, rhs = self.binary(prec + 1)
+            res_type, result = self.binary_op(
+                tok, prec, res_type, result, rhs_type, rhs)
+        return res_type, result
+
+    def binary_op(self, tok, prec, res_type, result, rhs_type, rhs):
+        """Type checks 'result op rhs', returns its (type, C code)."""
+        op = tok[1]
+        line_num = tok[2]
+
+        # --- Logical: || && ---
+        if prec <= 2:
+            return 'int', f'{result} {op} {rhs}'
+
+        # --- Relational: == != < > <= >= ---
+        if prec <= 4:
             if res_type == 'char*' and rhs_type == 'char*':
-                if op == "==":
-                    rhs_type, result = 'int', f'strcmp({result}, {rhs}) == 0'
-                elif op == '!=':
-                    rhs_type, result = 'int', f'strcmp({result}, {rhs}) != 0'
-                else:
+                if op not in ('==', '!='):
                     raise TypeError(
                         f'Operation \'{op}\' not allowed between \'{res_type}\' and \'{rhs_type}\', line {line_num}')
+                # Against a string literal, str_is() compares the first
+                # chars before calling strcmp()
+                if result.startswith('"'):
+                    result, rhs = rhs, result
+                if rhs.startswith('"'):
+                    neg = '!' if op == '!=' else ''
+                    return 'int', f'{neg}str_is({result}, {rhs})'
+                return 'int', f'strcmp({result}, {rhs}) {op} 0'
             elif (res_type == 'char*' and rhs_type == 'int') or \
                  (res_type == 'int' and rhs_type == 'char*'):
                 if op == '==' or op == '!=':
                     # Emit standard C pointer comparison: (ptr == 0)
-                    res_type, result = 'int', f'{result} {op} {rhs}'
+                    return 'int', f'{result} {op} {rhs}'
                 else:
                     raise TypeError(
                         f'Operation \'{op}\' not allowed between \'{res_type}\' and \'{rhs_type}\', line {line_num}')
@@ -477,52 +554,38 @@ class Parser:
                 raise TypeError(
                     f'Operation \'{op}\' not allowed between \'{res_type}\' and \'{rhs_type}\', line {line_num}')
             else:
-                res_type, result = 'int', f'{result} {op} {rhs}'
-        return res_type, result
-
-    def additive(self):
-        res_type, result = self.multiplicative()
-        while self.peek() in ('PLUS', 'MINUS'):
-            tok = self.next()
-            op = tok[1]
-            line_num = tok[2]
-            rhs_type, rhs = self.multiplicative()
+                return 'int', f'{result} {op} {rhs}'
 
+        # --- Additive: + -, with pointer arithmetic ---
+        if prec == 5:
             if res_type == 'int' and rhs_type == 'int':
-                res_type, result = 'int', f'{result} {op} {rhs}'
+                return 'int', f'{result} {op} {rhs}'
             # Check for pointer arithmetic
             elif (res_type[-1] == '*' and rhs_type == 'int') or \
                     (res_type == 'int' and rhs_type[-1] == '*'):
 
                 if op == '+':
                     res_type = res_type if res_type[-1] == '*' else rhs_type
-                    result = f'{result} {op} {rhs}'
+                    return res_type, f'{result} {op} {rhs}'
                 else:
                     if res_type == 'int':
                         raise TypeError(
                             f'Cannot subtract a pointer from an integer, line {line_num}')
                     # 'ptr - int' is allowed
-                    res_type, result = res_type, f'{result} {op} {rhs}'
+                    return res_type, f'{result} {op} {rhs}'
 
             elif res_type == 'char*' and rhs_type == 'char*' and op == "+":
-                res_type, result = res_type, f'concat({result}, {rhs})'
+                return res_type, f'concat({result}, {rhs})'
 
             else:
                 raise TypeError(
                     f'Operation \'{op}\' not allowed between \'{res_type}\' and \'{rhs_type}\', line {line_num}')
 
-        return res_type, result
-
-    def multiplicative(self):
-        res_type, result = self.unary()
-        while self.peek() in ('MUL', 'DIV'):
-            op = self.next()[1]
-            rhs_type, rhs = self.unary()
-            if res_type == 'char*' or rhs_type == 'char*':
-                raise TypeError(
-                    f'Operation \'{op}\' not allowed between \'{res_type}\' and \'{rhs_type}\'')
-            res_type, result = 'int', f'{result} {op} {rhs}'
-        return res_type, result
+        # --- Multiplicative: * / ---
+        if res_type == 'char*' or rhs_type == 'char*':
+            raise TypeError(
+                f'Operation \'{op}\' not allowed between \'{res_type}\' and \'{rhs_type}\'')
+        return 'int', f'{result} {op} {rhs}'
 
     def unary(self):
         if self.peek() == 'MINUS':
@@ -5,7 +5,7 @@ Description: stage0-compiler for the language dav to c
 """
 
 import sys
-from lexer.lexer import tokenize
+from lexer.lexer import tokenize_fast
 from parser.parser import Parser
 
 
@@ -15,7 +15,7 @@ def main():
         return
     src, dst = sys.argv[1], sys.argv[2]
     code = open(src).read()
-    tokens = tokenize(code)
+    tokens = tokenize_fast(code)
     parser = Parser(tokens)
     c_code = C_INCLUDE
     c_code += C_PROTOTYPE
@@ -29,24 +29,56 @@ C_INCLUDE = \
     "#include <stdio.h>\n" \
     "#include <stdlib.h>\n" \
     "#include <string.h>\n" \
+    "#include <fcntl.h>\n" \
+    "#include <signal.h>\n" \
+    "#include <sys/mman.h>\n" \
+    "#include <sys/stat.h>\n" \
+    "#include <sys/wait.h>\n" \
+    "#include <unistd.h>\n" \
     "\n"
 
 C_PROTOTYPE = \
     "char* concat(char* str1, char* str2);\n" \
+    "static inline int str_is(char* s, char* lit);\n" \
     "char* itos(int x);\n" \
     "char* ctos(char c);\n" \
+    "int ctoi(char c);\n" \
+    "char* substr(char* s, int start, int len);\n" \
+    "char** grow_strs(char** a, int cap);\n" \
+    "char* grow_chars(char* a, int cap);\n" \
+    "int* grow_ints(int* a, int cap);\n" \
+    "int skip_spaces(char* s, int pos);\n" \
+    "int scan_ident(char* s, int pos);\n" \
+    "int scan_line_end(char* s, int pos);\n" \
+    "int scan_string_end(char* s, int pos);\n" \
     "char* read_file(char* path);\n" \
     "void write_file(char* path, char* content);\n" \
+    "int open_output(char* path);\n" \
+    "int write_chars(int fd, char* buf, int len);\n" \
+    "void copy_chars(char* dst, char* src, int len);\n" \
+    "int open_cc(char* cmd);\n" \
+    "int close_cc();\n" \
+    "int* shared_ints(int n);\n" \
+    "void free_shared(int* p, int n);\n" \
+    "int fork_worker();\n" \
+    "int wait_workers();\n" \
+    "void exit_worker();\n" \
     "\n"
 
 C_HELPERS = \
     "\n" \
     "char* concat(char* str1, char* str2) {\n" \
-    "    static char buf[1024];\n" \
-    "    snprintf(buf, sizeof(buf), \"%s%s\", str1, str2);\n" \
+    "    size_t len1 = strlen(str1);\n" \
+    "    char* buf = malloc(len1 + strlen(str2) + 1);\n" \
+    "    memcpy(buf, str1, len1);\n" \
+    "    strcpy(buf + len1, str2);\n" \
     "    return buf;\n" \
     "}\n" \
     "\n" \
+    "static inline int str_is(char* s, char* lit) {\n" \
+    "    return s[0] == lit[0] && (lit[0] == '\\0' || strcmp(s + 1, lit + 1) == 0);\n" \
+    "}\n" \
+    "\n" \
     "char* itos(int x) {\n" \
     "    static char buf[32];\n" \
     "    snprintf(buf, sizeof(buf), \"%d\", x);\n" \
@@ -60,18 +92,166 @@ C_HELPERS = \
     "    return buf;\n" \
     "}\n" \
     "\n" \
-    "char* read_file(char* path) {\n" \
-    "    FILE* f = fopen(path, \"rb\");\n" \
-    "    if (!f) return NULL;\n" \
-    "    fseek(f, 0, SEEK_END);\n" \
-    "    long len = ftell(f);\n" \
-    "    fseek(f, 0, SEEK_SET);\n" \
+    "int ctoi(char c) {\n" \
+    "    return (unsigned char)c;\n" \
+    "}\n" \
+    "\n" \
+    "char* substr(char* s, int start, int len) {\n" \
     "    char* buf = malloc(len + 1);\n" \
-    "    if (buf) {\n" \
-    "        fread(buf, 1, len, f);\n" \
-    "        buf[len] = '\\0';\n" \
+    "    memcpy(buf, s + start, len);\n" \
+    "    buf[len] = '\\0';\n" \
+    "    return buf;\n" \
+    "}\n" \
+    "\n" \
+    "char** grow_strs(char** a, int cap) {\n" \
+    "    return realloc(a, cap * sizeof(char*));\n" \
+    "}\n" \
+    "\n" \
+    "char* grow_chars(char* a, int cap) {\n" \
+    "    return realloc(a, cap);\n" \
+    "}\n" \
+    "\n" \
+    "int* grow_ints(int* a, int cap) {\n" \
+    "    return realloc(a, cap * sizeof(int));\n" \
+    "}\n" \
+    "\n" \
+    "#if defined(__x86_64__)\n" \
+    "#include <immintrin.h>\n" \
+    "#endif\n" \
+    "\n" \
+    "static int scan_level = 0; // 0: scalar, 1: SSE2, 2: AVX2\n" \
+    "\n" \
+    "static inline int scan_stop(char c, int cls) {\n" \
+    "    if (cls == 0) return c != ' ' && c != '\\t' && c != '\\n';\n" \
+    "    if (cls == 1) return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_');\n" \
+    "    if (cls == 2) return c == '\\n' || c == '\\0';\n" \
+    "    return c == '\"' || c == '\\\\' || c == '\\0';\n" \
+    "}\n" \
+    "\n" \
+    "#if defined(__x86_64__)\n" \
+    "static inline __attribute__((always_inline)) unsigned scan_mask_sse2(__m128i v, int cls) {\n" \
+    "    if (cls == 0) return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\t'))), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\n')))) & 0xFFFF;\n" \
+    "    if (cls == 1) {\n" \
+    "        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), v));\n" \
+    "        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));\n" \
+    "        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));\n" \
+    "        __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));\n" \
+    "        return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(lower, upper), _mm_or_si128(digit, under))) & 0xFFFF;\n" \
     "    }\n" \
-    "    fclose(f);\n" \
+    "    __m128i stop = _mm_cmpeq_epi8(v, _mm_setzero_si128());\n" \
+    "    if (cls == 2) return _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\n'))));\n" \
+    "    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\"')));\n" \
+    "    return _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\\\'))));\n" \
+    "}\n" \
+    "\n" \
+    "static inline __attribute__((always_inline)) int scan_sse2(char* s, int pos, int cls) {\n" \
+    "    char* p = s + pos;\n" \
+    "    char* a = (char*)((size_t)p & ~(size_t)15);\n" \
+    "    unsigned mask = scan_mask_sse2(_mm_load_si128((__m128i*)a), cls) & (0xFFFFu << (p - a));\n" \
+    "    while (mask == 0) {\n" \
+    "        a = a + 16;\n" \
+    "        mask = scan_mask_sse2(_mm_load_si128((__m128i*)a), cls);\n" \
+    "    }\n" \
+    "    return (int)(a - s) + __builtin_ctz(mask);\n" \
+    "}\n" \
+    "\n" \
+    "__attribute__((target(\"avx2\"), always_inline))\n" \
+    "static inline unsigned scan_mask_avx2(__m256i v, int cls) {\n" \
+    "    if (cls == 0) return ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\t'))), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\n'))));\n" \
+    "    if (cls == 1) {\n" \
+    "        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));\n" \
+    "        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));\n" \
+    "        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));\n" \
+    "        __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));\n" \
+    "        return ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(lower, upper), _mm256_or_si256(digit, under)));\n" \
+    "    }\n" \
+    "    __m256i stop = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());\n" \
+    "    if (cls == 2) return _mm256_movemask_epi8(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\n'))));\n" \
+    "    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"')));\n" \
+    "    return _mm256_movemask_epi8(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\\\'))));\n" \
+    "}\n" \
+    "\n" \
+    "__attribute__((target(\"avx2\")))\n" \
+    "static int scan_avx2(char* s, int pos, int cls) {\n" \
+    "    char* p = s + pos;\n" \
+    "    char* a = (char*)((size_t)p & ~(size_t)31);\n" \
+    "    unsigned mask = scan_mask_avx2(_mm256_load_si256((__m256i*)a), cls) & (0xFFFFFFFFu << (p - a));\n" \
+    "    while (mask == 0) {\n" \
+    "        a = a + 32;\n" \
+    "        mask = scan_mask_avx2(_mm256_load_si256((__m256i*)a), cls);\n" \
+    "    }\n" \
+    "    return (int)(a - s) + __builtin_ctz(mask);\n" \
+    "}\n" \
+    "\n" \
+    "#endif\n" \
+    "\n" \
+    "static inline __attribute__((always_inline)) int scan(char* s, int pos, int cls) {\n" \
+    "    // Short runs are the common case, check two bytes before going wide\n" \
+    "    if (scan_stop(s[pos], cls)) return pos;\n" \
+    "    if (scan_stop(s[pos + 1], cls)) return pos + 1;\n" \
+    "#if defined(__x86_64__)\n" \
+    "    if (scan_level == 2) return scan_avx2(s, pos + 2, cls);\n" \
+    "    if (scan_level == 1) return scan_sse2(s, pos + 2, cls);\n" \
+    "#endif\n" \
+    "    while (!scan_stop(s[pos], cls)) pos++;\n" \
+    "    return pos;\n" \
+    "}\n" \
+    "\n" \
+    "__attribute__((constructor))\n" \
+    "static void scan_init(void) {\n" \
+    "#if defined(__x86_64__)\n" \
+    "    scan_level = __builtin_cpu_supports(\"avx2\") ? 2 : 1;\n" \
+    "#endif\n" \
+    "    if (getenv(\"DAV_SCALAR_LEX\")) scan_level = 0;\n" \
+    "}\n" \
+    "\n" \
+    "int skip_spaces(char* s, int pos) {\n" \
+    "    return scan(s, pos, 0);\n" \
+    "}\n" \
+    "\n" \
+    "int scan_ident(char* s, int pos) {\n" \
+    "    return scan(s, pos, 1);\n" \
+    "}\n" \
+    "\n" \
+    "int scan_line_end(char* s, int pos) {\n" \
+    "    return scan(s, pos, 2);\n" \
+    "}\n" \
+    "\n" \
+    "int scan_string_end(char* s, int pos) {\n" \
+    "    return scan(s, pos, 3);\n" \
+    "}\n" \
+    "\n" \
+    "char* read_file(char* path) {\n" \
+    "    int fd = strcmp(path, \"-\") == 0 ? 0 : open(path, O_RDONLY);\n" \
+    "    if (fd < 0) return NULL;\n" \
+    "    struct stat st;\n" \
+    "    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {\n" \
+    "        size_t len = st.st_size;\n" \
+    "        size_t page = sysconf(_SC_PAGESIZE);\n" \
+    "        size_t span = (len / page + 1) * page;\n" \
+    "        char* buf = mmap(NULL, span, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);\n" \
+    "        if (buf != MAP_FAILED) {\n" \
+    "            if (mmap(buf, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {\n" \
+    "                madvise(buf, len, MADV_SEQUENTIAL);\n" \
+    "                close(fd);\n" \
+    "                return buf;\n" \
+    "            }\n" \
+    "            munmap(buf, span);\n" \
+    "        }\n" \
+    "    }\n" \
+    "    size_t cap = 65536;\n" \
+    "    size_t len = 0;\n" \
+    "    ssize_t n;\n" \
+    "    char* buf = malloc(cap + 1);\n" \
+    "    while ((n = read(fd, buf + len, cap - len)) > 0) {\n" \
+    "        len = len + n;\n" \
+    "        if (len == cap) {\n" \
+    "            cap = cap * 2;\n" \
+    "            buf = realloc(buf, cap + 1);\n" \
+    "        }\n" \
+    "    }\n" \
+    "    buf[len] = '\\0';\n" \
+    "    if (fd != 0) close(fd);\n" \
     "    return buf;\n" \
     "}\n" \
     "\n" \
@@ -81,6 +261,62 @@ C_HELPERS = \
     "    fprintf(f, \"%s\", content);\n" \
     "    fclose(f);\n" \
     "}\n" \
+    "\n" \
+    "int open_output(char* path) {\n" \
+    "    if (strcmp(path, \"-\") == 0) return 1;\n" \
+    "    return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);\n" \
+    "}\n" \
+    "\n" \
+    "int write_chars(int fd, char* buf, int len) {\n" \
+    "    int done = 0;\n" \
+    "    while (done < len) {\n" \
+    "        ssize_t n = write(fd, buf + done, len - done);\n" \
+    "        if (n <= 0) return -1;\n" \
+    "        done = done + n;\n" \
+    "    }\n" \
+    "    return done;\n" \
+    "}\n" \
+    "\n" \
+    "void copy_chars(char* dst, char* src, int len) {\n" \
+    "    memcpy(dst, src, len);\n" \
+    "}\n" \
+    "\n" \
+    "static FILE* cc_pipe = NULL;\n" \
+    "\n" \
+    "int open_cc(char* cmd) {\n" \
+    "    signal(SIGPIPE, SIG_IGN);\n" \
+    "    fflush(stdout);\n" \
+    "    cc_pipe = popen(cmd, \"w\");\n" \
+    "    return cc_pipe ? fileno(cc_pipe) : -1;\n" \
+    "}\n" \
+    "\n" \
+    "int close_cc() {\n" \
+    "    int status = pclose(cc_pipe);\n" \
+    "    return status >= 0 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;\n" \
+    "}\n" \
+    "\n" \
+    "int* shared_ints(int n) {\n" \
+    "    int* p = mmap(NULL, (size_t)n * sizeof(int) + 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);\n" \
+    "    return p == MAP_FAILED ? NULL : p;\n" \
+    "}\n" \
+    "\n" \
+    "void free_shared(int* p, int n) {\n" \
+    "    munmap(p, (size_t)n * sizeof(int) + 1);\n" \
+    "}\n" \
+    "\n" \
+    "int fork_worker() {\n" \
+    "    fflush(stdout);\n" \
+    "    return fork();\n" \
+    "}\n" \
+    "\n" \
+    "int wait_workers() {\n" \
+    "    while (wait(NULL) > 0) {}\n" \
+    "    return 0;\n" \
+    "}\n" \
+    "\n" \
+    "void exit_worker() {\n" \
+    "    _exit(0);\n" \
+    "}\n" \
     "\n"
 
 if __name__ == '__main__':
@@ -1,12 +1,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 char* concat(char* str1, char* str2);
+static inline int str_is(char* s, char* lit);
 char* itos(int x);
 char* ctos(char c);
+int ctoi(char c);
+char* substr(char* s, int start, int len);
+char** grow_strs(char** a, int cap);
+char* grow_chars(char* a, int cap);
+int* grow_ints(int* a, int cap);
+int skip_spaces(char* s, int pos);
+int scan_ident(char* s, int pos);
+int scan_line_end(char* s, int pos);
+int scan_string_end(char* s, int pos);
 char* read_file(char* path);
 void write_file(char* path, char* content);
+int open_output(char* path);
+int write_chars(int fd, char* buf, int len);
+void copy_chars(char* dst, char* src, int len);
+int open_cc(char* cmd);
+int close_cc();
+int* shared_ints(int n);
+void free_shared(int* p, int n);
+int fork_worker();
+int wait_workers();
+void exit_worker();
 
 // File: compiler.dav
 // Author: David T.
@@ -15,43 +41,337 @@ void write_file(char* path, char* content);
 // =============================================================
 // Global Storage
 // =============================================================
+// --- Token Kinds ---
+// Small integer codes stored in token_recs, so the parser dispatches
+// with integer comparisons instead of strcmp on kind names.
+int TK_EOF = 0;
+int TK_ID = 1;
+int TK_NUMBER = 2;
+int TK_STRING = 3;
+int TK_CHAR = 4;
+int TK_TYPE = 5;
+int TK_FN = 6;
+int TK_LET = 7;
+int TK_PRINT = 8;
+int TK_IF = 9;
+int TK_ELSE = 10;
+int TK_WHILE = 11;
+int TK_RETURN = 12;
+int TK_ASSIGN = 13;
+int TK_EQ = 14;
+int TK_NE = 15;
+int TK_LT = 16;
+int TK_GT = 17;
+int TK_LE = 18;
+int TK_GE = 19;
+int TK_AND = 20;
+int TK_OR = 21;
+int TK_PLUS = 22;
+int TK_MINUS = 23;
+int TK_MUL = 24;
+int TK_DIV = 25;
+int TK_LPAREN = 26;
+int TK_RPAREN = 27;
+int TK_LBRACE = 28;
+int TK_RBRACE = 29;
+int TK_LSQUARE = 30;
+int TK_RSQUARE = 31;
+int TK_SEMICOL = 32;
+int TK_COMMA = 33;
+// Matched by the lexer but never stored as tokens
+int TK_COMMENT = 34;
+int TK_SKIP = 35;
+int TK_NEWLINE = 36;
+int TK_MISMATCH = 37;
+int N_TOKEN_KINDS = 38;
+// One past the last TK_*
+// --- Binary Operators ---
+// Precedence of each TK_* as a binary operator, one char per kind,
+// '0' if it is not one. Higher binds tighter. The levels are C's, since
+// EX_BINARY is emitted without parentheses: 1 ||, 2 &&, 3 == !=,
+// 4 < > <= >=, 5 + -, 6 * /. binary_node() type checks 1-2 as logical,
+// 3-4 as relational, 5 as additive and 6 as multiplicative.
+// A new operator needs its entry here and in op_to_c_op().
+char* OP_PREC = "00000000000000334444215566000000000000";
 // --- Tokenizer Storage ---
-char* token_types[50000];
-int token_values[50000];
-// Stores index into token_pool, or -1
-int token_lines[50000];
-int token_cols[50000];
-char token_pool[500000];
-// String pool for token values
+// Token text is not copied: each token is a span (start, len) into the
+// source buffer. See emit_span().
+// The lexer runs on demand: when the parser reaches the last lexed
+// token, peek() and next() call lex_fill() for the next
+// TOKEN_WINDOW / 2 tokens. Token 'idx' lives in record tok_rec(idx) of
+// a ring of TOKEN_WINDOW records, so memory does not grow with the
+// input. The parser only looks one token ahead, and the indices it
+// keeps of tokens it just consumed stay valid for at least another
+// TOKEN_WINDOW / 2 tokens.
+// A record is TOKEN_REC consecutive ints of token_recs, so reading a
+// token touches one place in memory instead of one array per field:
+//   [0] kind + len * 256 (the TK_* code in the low byte)
+//   [1] offset of the token text in source_buf
+// Lines are not stored, see line_of().
+// One more record after the ring stays all zero: an empty TK_EOF at
+// offset 0, which tok_rec() gives for idx -1 (a failed expect()).
+int TOKEN_WINDOW = 256;
+int TOKEN_REC = 2;
+char* source_buf;
+// Source code being compiled
+int token_recs[514];
+// (TOKEN_WINDOW + 1) * TOKEN_REC
 int n_tokens = 0;
-// Total number of tokens found
+// Number of tokens lexed so far
+int next_rec = 0;
+// Record offset of token n_tokens
+// --- Lexer State ---
+int lex_pos = 0;
+// Offset of the next char to lex
+int lex_end = 2147483647;
+// No token starts at or after this offset
+int lex_failed = 0;
+// 1 after a lexer error, only EOF follows
+int lex_quiet = 0;
+// 1 to not print lexer errors
+// --- Token DFA ---
+// Tokens are recognized by one DFA generated from TOKEN_SPEC in
+// python/lexer/custom_token.py, the same tables the stage0 lexer runs
+// on. dfa_init() decodes the DFA_* strings below into these arrays.
+// dfa_next is indexed by char class rather than byte, so the table
+// stays small enough for the L1 cache.
+int* dfa_class;
+// Char class of each byte
+int* dfa_next;
+// Next state, at state * DFA_CLASSES + class
+int* dfa_accept;
+// TK_* accepted in each state, or -1
+int* dfa_accel;
+// Scan kernel that skips runs in each state, or 0
+int* dfa_single;
+// TK_* of each byte that is a token by itself, or -1
+// --- BEGIN GENERATED: dfa ---
+// Token DFA, see lex_fill() and dfa_init().
+// Generated by python/lexer/gen_dfa.py from TOKEN_SPEC, do not edit.
+// Each char is one table value, stored as value + 40.
+int DFA_STATES = 54;
+int DFA_CLASSES = 38;
+char* DFA_CLASS_OF = "())))))))*+)))))))))))))))))))))*,-)))./012345678888888888)9:;<))==========================>?@)=)A=BC===DE====FG==H=I=J====KLM)))";
+// Per char code 0..128
+char* DFA_NEXT = "(((((((((((((((((((((((((((((((((((((((*+,-./0123456*789:;<=>*?=@==A====BCDE((((((((((((((((((((((((((((((((((((((((+((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((](((((((((((((((((((ZZZZ[ZZZZZZZZZZZZZZZZZ\\ZZZZZZZZZZZZZZ((((((Y((((((((((((((((((((((((((((((((VVVVVV(VVVVVVVVVVVVVVVWVVVVVVVVVVVVVV(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((U((((((((((((((((((((((((((((((((((((T(8((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((S(((((((((((((((((((((((((((((((((((((R(((((((((((((((((((((((((((((((((((((Q((((((((((((((((((((((((((((((((((=((((=(((==========(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((=((((=(((===M======(((((((((((((((((((=((((=(((=====J====(((((((((((((((((((=((((=(((======G===(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((F(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((=((((=(((====H=====(((((((((((((((((((=((((=(((==I=======(((((((((((((((((((=((((=(((==========(((((((((((((((((((=((((=(((========K=(((((((((((((L(((((=((((=(((==========(((((((((((((((((((((((((((((((((((((((((((((((((((((((((=((((=(((N=========(((((((((((((((((((=((((=(((=======O==(((((((((((((P(((((=((((=(((==========(((((((((((((L(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((T((((((((((((((((((((((UU(UUUUUUUUUUUUUUUUUUUUUUUUUUUUUUUUUU(((((((X(((((((((((((((((((((((((((((((VV(VVVVVVVVVVVVVVVVVVVVVVVVVVVVVVVVVV(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((ZZZZ[ZZZZZZZZZZZZZZZZZ\\ZZZZZZZZZZZZZZ(((((((((((((((((((((((((((((((((((((((ZZ(ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ((((((((((((((((((((((((((((((((((((((";
+char* DFA_ACCEPT = "((NLMNNNNCDA?J@B+I96:*GH***ENF>**.*..**..<7;+K((-=(,(8";
+// TK_* + 1, 0 if none
+char* DFA_ACCEL = "((((((((((((((((((((()(((((((((((((((((((((((*((((+(((";
+// --- END GENERATED: dfa ---
+// --- Parallel Lexing ---
+// lex_parallel() lexes the whole file ahead of the parser into
+// pre_recs (TOKEN_REC ints per token), then lex_fill() just copies
+// records from it into the token window.
+// Its shared mapping is kept and reused by the next run, so a process
+// that lexes many files in parallel maps it once per size increase.
+int* pre_recs;
+int n_pre = -1;
+// Records in pre_recs, -1 when unused
+int* pre_mem;
+// Shared ints: per chunk results, then pre_recs
+int pre_mem_cap = 0;
+// Ints in pre_mem
+int* pre_bounds;
+// Chunk starts, kept like pre_mem
+int pre_bounds_cap = 0;
+int pre_pos = 0;
+// Next record of pre_recs to hand out
+// --- Line Table ---
+// Offsets of the first char of each line of source_buf. Only error
+// messages need line numbers, so line_of() builds it on first use.
+int* line_starts;
+int n_lines = 0;
+// 0 until the table is built
+int line_cap = 0;
 // --- Parser State ---
 int parser_pos = 0;
 // Current token index for the parser
-char* current_fn_ret_type;
+int current_fn_ret_type;
 // Stores return type of fn being parsed
-char* expr_type;
+int expr_type = 0;
 // Type of the last parsed expression, works like a forgetful stack
+// --- Types ---
+// A type is one int: its base type plus TYPE_PTR per level of pointer,
+// so char** is TY_CHAR + 2 * TYPE_PTR. Types compare with ==, and
+// pointer_to() and deref() are one addition. type_name() gives the C
+// spelling, built on first use.
+int TY_NONE = 0;
+// No type: undeclared, or not written in a 'beg'
+int TY_VOID = 1;
+int TY_INT = 2;
+int TY_CHAR = 3;
+int TYPE_PTR = 4;
+// Added per '*'
+int TY_STR = 7;
+// char*
+char** type_names;
+// C spelling of types 0..n_type_names-1
+int n_type_names = 0;
+int type_name_cap = 0;
+// --- Errors ---
+// A syntax error puts the parser in panic mode: further errors are
+// not reported until it has skipped to the end of the statement, see
+// synchronize(). Parsing stops after MAX_ERRORS errors.
+int n_errors = 0;
+int MAX_ERRORS = 20;
+int panic_mode = 0;
+int print_errors = 1;
+// 0 to collect them in 'diagnostics' instead, see compile()
+char* diagnostics = "";
+// Collected error messages, one per line
+char* diag_mem;
+// Buffer 'diagnostics' points to, reused by every compile
+int diag_len = 0;
+int diag_cap = 0;
+int msg_len = 0;
+// Length of the message diag_add() is building after them
+// --- Syntax Tree ---
+// The parser builds the tree of the whole file, type checking as it
+// goes, then emit_program() writes its C in one pass. A node is a
+// record of consecutive ints in one bump arena, 'ast', and is known by
+// its offset there. The first int of a record is its kind + value * 256,
+// the rest depends on the kind, see below. Names are stored as
+// identifier ids, types as type ids (see Types) and literals as spans
+// of source_buf, since the token window has moved on by the time a
+// node is emitted.
+// Lists of children (statements of a block, call arguments, parameters,
+// declarations) are stored at the end of their parent's record. The
+// parser collects them on ast_stack until the list is complete.
+// ast_reset() empties both for the next compile.
+//                              value           then
+int EX_LEAF = 0;
+// token kind      pos, len
+int EX_BINARY = 1;
+// operator kind   left, right
+int EX_CALL = 2;
+// n args          pos, len, args...
+int EX_INDEX = 3;
+//                 pos, len, index
+int EX_PAREN = 4;
+//                 inner
+int EX_NEG = 5;
+//                 operand
+int EX_CONCAT = 6;
+//                 left, right
+int EX_STRCMP = 7;
+// operator kind   left, right
+int EX_PTR_ADD = 8;
+//                 left, right (int + pointer)
+int ST_LET = 9;
+//                 type, name, value
+int ST_ARRAY = 10;
+//                 type, name, size pos, size len
+int ST_DECL = 11;
+//                 type, name
+int ST_PRINT = 12;
+// 0 int, 1 char, 2 char*   value
+int ST_ASSIGN = 13;
+//                 name, value
+int ST_STORE = 14;
+//                 name, index, value
+int ST_CALL = 15;
+//                 call
+int ST_IF = 16;
+//                 cond, then, else (ST_IF, ST_BLOCK or -1)
+int ST_WHILE = 17;
+//                 cond, body
+int ST_RETURN = 18;
+//                 value
+int ST_BLOCK = 19;
+// n statements    statements...
+int FN_DECL = 20;
+// n params        type, name, body (-1 if prototype), params...
+int FN_PARAM = 21;
+// 0, 1 [], 2 [n]  type, name, size pos, size len
+int PROGRAM = 22;
+// n declarations  declarations...
+int* ast;
+int ast_top = 0;
+int ast_cap = 0;
+int* ast_stack;
+int ast_stack_top = 0;
+int ast_stack_cap = 0;
+// --- Identifier Table ---
+// Every distinct identifier is stored once, see intern(), and known by
+// its index there, its id. Equal names have equal ids, so the symbol
+// tables compare ints instead of strings, and the names they keep are
+// shared instead of copied out of the source for each declaration.
+char** intern_names;
+// NUL-terminated name of each id
+int* intern_hashes;
+// name_hash() of each name
+int* intern_name_caps;
+// Bytes allocated for each name
+int n_interned = 0;
+int n_name_bufs = 0;
+// Ids that own a name buffer, kept by intern_reset()
+int intern_cap = 0;
+int* intern_slots;
+// Hash table of ids, -1 for a free slot
+int intern_slot_cap = 0;
 // --- Symbol Table Storage ---
-// We store 'char*' pointers for names and types.
-// The Stage 0 compiler will get the name strings from the token_pool.
-// The type strings will be string literals (e.g., "int", "char*").
+// We store the id of each name and its type (see Types).
+// The arrays start empty and add_symbol() doubles them when full,
+// so there is no fixed limit on the number of symbols.
+//
+// Each scope also has an open-addressing hash table over its symbols,
+// keyed by id, so a lookup costs about one int compare however many
+// symbols there are. A slot holds a symbol index and is in use only if
+// its stamp equals the scope's current generation, so bumping the
+// generation empties the table in O(1). The table is kept at most half
+// full and rebuilt twice as large when it would fill up.
+//
+// Every if/else/while body is a block scope. Its locals are the last
+// ones added, so enter_scope() just records n_locals and leave_scope()
+// frees the slots of the locals added since, newest first. A slot freed
+// in that order is never in the probe path of a name still in the table.
 // Global Scope (self.env)
-char* global_names[1000];
-char* global_types[1000];
+int* global_syms;
+int* global_types;
 int n_globals = 0;
+int global_cap = 0;
+int* global_slots;
+// Symbol index per slot
+int* global_stamps;
+// Generation per slot
+int global_slot_cap = 0;
+int global_gen = 1;
 // Local Scope (self.variables)
-char* local_names[1000];
-char* local_types[1000];
+int* local_syms;
+int* local_types;
 int n_locals = 0;
-// --- C Code Generation Buffer ---
-char c_code_buffer[1000000];
-// 1MB buffer for generated C
-int c_code_pos = 0;
-// Current position in the buffer
-// --- Peek Buffer ---
-char expr_peek_buffer[4096];
-// Scratchpad for peeking code
+int local_cap = 0;
+int* local_slots;
+int* local_stamps;
+int local_slot_cap = 0;
+int local_gen = 1;
+int* local_slot_of;
+// Slot of each local, to free it again
+int* scope_marks;
+// n_locals when each open block was entered
+int n_scopes = 0;
+int scope_cap = 0;
+// --- C Code Output ---
+// Generated C is written to the output file as it is emitted, one
+// block of OUT_BLOCK chars at a time, so the output can be any size
+// and only one block is held. The file is opened only after a parse
+// without errors, see main().
+int OUT_BLOCK = 65536;
+char out_block[65536];
+// OUT_BLOCK chars not written yet
+int out_pos = 0;
+// Chars used in out_block
+int out_fd = -1;
+// Output file, from open_output(), -1 for out_mem
+int out_failed = 0;
+// 1 after a failed write
+char* out_mem;
+// Whole output of compile(), NUL-terminated
+int out_mem_len = 0;
+int out_mem_cap = 0;
+char* src_mem;
+// NUL-terminated copy of compile()'s source
+int src_mem_cap = 0;
 // =============================================================
 // Function Declarations
 // =============================================================
@@ -59,10 +379,16 @@ char expr_peek_buffer[4096];
 int is_letter(char c);
 int is_digit(char c);
 int is_space(char c);
-int is_ident_char(char c);
-char* check_keywords(char* s);
-int add_simple_token(int index, char* type, int line, int col);
-int tokenize(char* source_code);
+int check_keywords(char* s, int len);
+int dfa_init();
+int add_simple_token(int rec, int type, int start, int len);
+int lex_init(char* source_code);
+int lex_fill(int count);
+int fill_from_pre(int count);
+int lex_chunk(int from, int to, int base);
+int lex_parallel(int jobs);
+int lex_only(char* source_code, int repeat, int jobs);
+int parse_only(char* source_code, int repeat);
 // --- Parser Helpers ---
 int parse();
 int global_decl();
@@ -74,23 +400,73 @@ int if_stmt();
 int while_stmt();
 int return_stmt();
 int id_stmt();
+int block();
 int expr();
-int logical();
-int relational();
-int additive();
-int multiplicative();
+int binary_expr(int min_prec);
+int op_prec(int kind);
+int binary_node(int op_kind, int op_pos, int prec, int left, int left_type, int right, int right_type);
 int unary();
 int atom();
-char* peek();
+int call_args(int tok_idx);
+int new_expr(int kind, int value, int a, int b);
+// --- Syntax Tree Helpers ---
+int new_node(int kind, int value, int size);
+int node_kind(int node);
+int node_value(int node);
+int push_node(int node);
+int pop_nodes(int dest, int mark);
+int ast_reset();
+// --- Code Generation ---
+int emit_program(int program);
+int emit_fn(int fn);
+int emit_stmt(int node);
+int emit_expr(int node);
+int peek();
 int next();
-int expect(char* kind);
+int expect(int kind);
+int diag_add(char* s);
+int diag_drop();
+int report_error();
+int add_error();
+int syntax_error();
+int synchronize(int is_global);
+char* token_name(int kind);
+int tok_rec(int idx);
+int tok_kind(int idx);
+int tok_start(int idx);
+int tok_len(int idx);
+int tok_lineno(int idx);
+int line_of(int pos);
+int tok_sym(int idx);
+int type_of_tok(int idx);
+int pointer_to(int type);
+int deref(int type);
+int is_pointer(int type);
+char* type_name(int type);
 int clear_local_symbols();
-char* get_symbol_type(int is_global, char* name);
-int add_symbol(int is_global, char* name, char* type);
-int str_ends_with(char* s, char c);
-char* op_to_c_op(char* tok_type);
+int clear_global_symbols();
+int enter_scope();
+int leave_scope();
+int get_symbol_type(int is_global, int sym);
+int find_symbol(int is_global, int sym);
+int add_symbol(int is_global, int sym, int type);
+int insert_slot(int is_global, int i);
+int rehash_symbols(int is_global);
+int intern(char* s, int len);
+int intern_str(char* s);
+int intern_reset();
+char* sym_name(int sym);
+int name_equals(char* name, char* s, int len);
+int name_hash(char* s, int len);
+int rehash_names();
+char* op_to_c_op(int tok_type);
 int emit(char* s);
-char* peek_code(char* level);
+int emit_span(int start, int len);
+int emit_chars(char* s, int len);
+int flush_output();
+char* shell_quote(char* s);
+char* compile(char* source, int len);
+int compile_reset(char* code);
 int c_include();
 int c_prototype();
 int c_helper();
@@ -99,345 +475,451 @@ int preset_global_functions();
 // Main Entry Point
 // =============================================================
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        printf("%s\n", "Usage: compiler <input_file.dav> <output_file.c>");
+    // Lexer benchmark mode: compiler --lex <input_file.dav> <repeat> [jobs]
+    if (argc == 4 && str_is(argv[1], "--lex")) {
+        return lex_only(read_file(argv[2]), atoi(argv[3]), 1);
+    }
+    if (argc == 5 && str_is(argv[1], "--lex")) {
+        return lex_only(read_file(argv[2]), atoi(argv[3]), atoi(argv[4]));
+    }
+    // Parser benchmark mode: compiler --parse <input_file.dav> <repeat>
+
+    if (argc == 4 && str_is(argv[1], "--parse")) {
+        return parse_only(read_file(argv[2]), atoi(argv[3]));
+    }
+    // Lex with N processes: compiler --jobs N <input_file.dav> <output_file.c>
+    // Build an executable: compiler --cc gcc <input_file.dav> <executable>
+    // pipes the C into 'gcc -x c - -o <executable>', no .c file is written
+
+    int jobs = 1;
+    char* cc = "";
+    int arg = 1;
+    while (arg + 3 < argc && (str_is(argv[arg], "--jobs") || str_is(argv[arg], "--cc"))) {
+        if (str_is(argv[arg], "--jobs")) {
+            jobs = atoi(argv[arg + 1]);
+        } else {
+            cc = argv[arg + 1];
+        }
+        arg = arg + 2;
+    }
+    if (argc - arg != 2) {
+        printf("%s\n", "Usage: compiler [--jobs N] [--cc CC] <input_file.dav> <output_file.c>  (input - reads stdin, output - writes stdout)");
         return 1;
     }
-    char* input_file = argv[1];
-    char* output_file = argv[2];
+    char* input_file = argv[arg];
+    char* output_file = argv[arg + 1];
     // 1. Read Input File
+    // read_file maps the file read-only, the lexer scans the mapping
     char* code = read_file(input_file);
     if (code == 0) {
         // NULL check
         printf("%s\n", "Error: Could not read input file.");
         return 1;
     }
-    // 2. Setup Code Generation
+    // 2. Setup the global scope, start the lexer. Tokens are pulled
+    // by the parser
+
+    compile_reset(code);
+    if (jobs > 1) {
+        lex_parallel(jobs);
+    }
+    // 3. Parse
+    // Nothing is written if there were errors, so a build stops here
+    // instead of at gcc
+
+    int program = parse();
+    if (n_errors > 0) {
+        printf("%s\n", concat(concat(concat(itos(n_errors), " error(s), "), output_file), " not written."));
+        return 1;
+    }
+    // 4. Emit the C, straight into the output file, or into the C
+    // compiler, which compiles it as it comes in
 
+    if (str_is(cc, "")) {
+        out_fd = open_output(output_file);
+    } else {
+        out_fd = open_cc(concat(concat(cc, " -x c - -o "), shell_quote(output_file)));
+    }
+    if (out_fd < 0) {
+        printf("%s\n", "Error: Could not open output file.");
+        return 1;
+    }
     c_include();
     c_prototype();
-    preset_global_functions();
-    // 3. Tokenize
-    tokenize(code);
-    // 4. Parse
-    parse();
-    // 5. Emit Helpers
+    emit_program(program);
     c_helper();
-    // 6. Write Output File
-    write_file(output_file, c_code_buffer);
+    flush_output();
+    if (!str_is(cc, "")) {
+        // The C compiler has printed its own errors, if any
+        int status = close_cc();
+        if (status != 0) {
+            printf("%s\n", concat(concat(concat(concat("Error: ", cc), " failed, "), output_file), " not built."));
+            return 1;
+        }
+    }
+    if (out_failed == 1) {
+        printf("%s\n", "Error: Could not write output file.");
+        return 1;
+    }
     // boo("Done.");
+
+    return 0;
+}
+
+char* shell_quote(char* s) {
+    // Quotes 's' as one /bin/sh word, for the --cc command line:
+    // in single quotes, with each ' written as '\''.
+    char* quoted = "'";
+    int start = 0;
+    int i = 0;
+    while (s[i] != '\0') {
+        if (s[i] == '\'') {
+            quoted = concat(concat(quoted, substr(s, start, i - start)), "'\\''");
+            start = i + 1;
+        }
+        i = i + 1;
+    }
+    return concat(concat(quoted, substr(s, start, i - start)), "'");
+}
+
+char* compile(char* source, int len) {
+    // Library entry point: compiles the first 'len' chars of 'source'
+    // and returns the C code, or "" if there were errors. Then
+    // 'n_errors' counts the errors and 'diagnostics' holds them.
+    // Can be called any number of times in one process, for example
+    // from C after building this file with -Dmain=stage1_main. The
+    // returned buffer and 'diagnostics' are reused by the next call.
+    // The lexer stops at a '\0', so the source is copied to add one,
+    // into a buffer that is kept for the next call
+    if (len + 1 > src_mem_cap) {
+        src_mem_cap = (len + 1) * 2;
+        src_mem = grow_chars(src_mem, src_mem_cap);
+    }
+    copy_chars(src_mem, source, len);
+    src_mem[len] = '\0';
+    compile_reset(src_mem);
+    print_errors = 0;
+    out_fd = -1;
+    out_mem_len = 0;
+    int program = parse();
+    if (n_errors > 0) {
+        return "";
+    }
+    c_include();
+    c_prototype();
+    emit_program(program);
+    c_helper();
+    flush_output();
+    return out_mem;
+}
+
+int compile_reset(char* code) {
+    // Resets all compiler state to compile 'code'. What is kept from
+    // earlier compiles (name buffers, type names, DFA tables) is
+    // only a cache.
+    n_errors = 0;
+    panic_mode = 0;
+    diagnostics = "";
+    diag_len = 0;
+    msg_len = 0;
+    out_pos = 0;
+    out_failed = 0;
+    clear_global_symbols();
+    clear_local_symbols();
+    intern_reset();
+    preset_global_functions();
+    lex_init(code);
     return 0;
 }
 
 // =============================================================
 // Parser
+//
+// Every parser function returns the node it built, or -1 after an
+// error, and emits nothing. See emit_program().
 // =============================================================
 int parse() {
     // Main parser entry point.
-    // Loops until EOF, parsing all global declarations.
-    while (strcmp(peek(), "EOF") != 0) {
-        global_decl();
+    // Loops until EOF, parsing all global declarations into
+    // one PROGRAM node.
+    ast_reset();
+    int mark = ast_stack_top;
+    int decl;
+    while (peek() != TK_EOF && n_errors < MAX_ERRORS) {
+        decl = global_decl();
+        push_node(decl);
+        if (decl < 0 || panic_mode == 1) {
+            synchronize(1);
+        }
     }
-    return 0;
+    int program = new_node(PROGRAM, ast_stack_top - mark, 1 + ast_stack_top - mark);
+    pop_nodes(program + 1, mark);
+    return program;
 }
 
 int global_decl() {
     // Dispatches to the correct parser function
     // based on the next token.
-    char* tok = peek();
-    if (strcmp(tok, "FN") == 0) {
-        fn_decl();
-    } else if (strcmp(tok, "LET") == 0) {
-               let_stmt(1);
+    int tok = peek();
+    if (tok == TK_FN) {
+        return fn_decl();
+    } else if (tok == TK_LET) {
+               return let_stmt(1);
                // 1 for global
            } else {
                // Error handling
-               int tok_line = token_lines[parser_pos];
-               printf("%s\n", concat("Error: Unexpected global token on line ", itos(tok_line)));
-               printf("%s\n", concat("Expected FN, LET, or COMMENT, but got: ", tok));
+               int tok_line = tok_lineno(parser_pos);
+               diag_add("Error: Unexpected global token on line ");
+               diag_add(itos(tok_line));
+               diag_add("\nExpected FN, LET, or COMMENT, but got: ");
+               diag_add(token_name(tok));
+               syntax_error();
                // Consume the bad token to prevent infinite loop
                next();
                return -1;
            }
-    return 0;
+    return -1;
 }
 
 int fn_decl() {
     // Parses a function declaration or definition
-    int fn_tok_idx = expect("FN");
-    int line_num = token_lines[fn_tok_idx];
+    int fn_tok_idx = expect(TK_FN);
+    int line_pos = tok_start(fn_tok_idx);
     // --- Get Type ---
-    char* fn_type = "void";
+    int fn_type = TY_VOID;
     // Default type
-    if (strcmp(peek(), "TYPE") == 0) {
-        int fn_type_idx = next();
-        fn_type = token_pool + token_values[fn_type_idx];
+    if (peek() == TK_TYPE) {
+        fn_type = type_of_tok(next());
     }
     // --- Get Pointer ---
 
-    if (strcmp(peek(), "MUL") == 0) {
+    while (peek() == TK_MUL) {
         next();
-        if (strcmp(fn_type, "int") == 0) {
-            fn_type = "int*";
-        } else if (strcmp(fn_type, "char") == 0) {
-                 fn_type = "char*";
-             } else if (strcmp(fn_type, "char*") == 0) {
-                 fn_type = "char**";
-             } else {
-                 printf("%s\n", concat("Error: Cannot make array of type ", fn_type));
-                 return -1;
-             }
+        fn_type = pointer_to(fn_type);
     }
     // --- Get Name ---
-
-    int fn_name_idx = expect("ID");
-    char* fn_name = token_pool + token_values[fn_name_idx];
+    int fn_sym = tok_sym(expect(TK_ID));
     // --- Store for type-checking 'return' ---
     current_fn_ret_type = fn_type;
-    add_symbol(1, fn_name, fn_type);
-    expect("LPAREN");
-    emit(fn_type);
-    emit(" ");
-    emit(fn_name);
-    emit("(");
+    add_symbol(1, fn_sym, fn_type);
+    expect(TK_LPAREN);
     // --- Parse parameters ---
-    // Parallel arrays to store parameters
-    char* param_types[20];
-    char* param_names[20];
-    int param_has_arrays_part[20];
-    int n_params = 0;
-    int i = 0;
-    while (strcmp(peek(), "RPAREN") != 0) {
-        if (n_params > 0) {
-            expect("COMMA");
-            emit(", ");
+    // Parameters go straight into the local scope of the body
+    clear_local_symbols();
+    int mark = ast_stack_top;
+    while (peek() != TK_RPAREN && peek() != TK_EOF && panic_mode == 0) {
+        if (ast_stack_top > mark) {
+            expect(TK_COMMA);
         }
         // Get param type (default int)
 
-        char* param_type = "int";
-        if (strcmp(peek(), "TYPE") == 0) {
-            int param_type_idx = next();
-            param_type = token_pool + token_values[param_type_idx];
+        int param_type = TY_INT;
+        if (peek() == TK_TYPE) {
+            param_type = type_of_tok(next());
         }
         // Get param pointer
 
-        if (strcmp(peek(), "MUL") == 0) {
+        while (peek() == TK_MUL) {
             next();
-            if (strcmp(param_type, "int") == 0) {
-                param_type = "int*";
-            } else if (strcmp(param_type, "char") == 0) {
-                     param_type = "char*";
-                 } else if (strcmp(param_type, "char*") == 0) {
-                     param_type = "char**";
-                 } else {
-                     printf("%s\n", concat("Error: Cannot make array of type ", param_type));
-                     return -1;
-                 }
+            param_type = pointer_to(param_type);
         }
         // Get param name
-
-        int param_name_idx = expect("ID");
-        char* param_name = token_pool + token_values[param_name_idx];
-        emit(param_type);
-        emit(" ");
-        emit(param_name);
+        int param_sym = tok_sym(expect(TK_ID));
+        int param = new_node(FN_PARAM, 0, 5);
+        ast[param + 1] = param_type;
+        ast[param + 2] = param_sym;
         // Check for array param part
-        int param_array_part = 0;
-        if (strcmp(peek(), "LSQUARE") == 0) {
+        if (peek() == TK_LSQUARE) {
             next();
-            param_array_part = 1;
-            if (strcmp(peek(), "NUMBER") == 0) {
+            param_type = pointer_to(param_type);
+            ast[param] = FN_PARAM + 256;
+            if (peek() == TK_NUMBER) {
                 int size_idx = next();
-                char* size_str = token_pool + token_values[size_idx];
-                emit("[");
-                emit(size_str);
-                emit("]");
-            } else {
-                emit("[]");
+                ast[param] = FN_PARAM + 512;
+                ast[param + 3] = tok_start(size_idx);
+                ast[param + 4] = tok_len(size_idx);
             }
-            expect("RSQUARE");
+            expect(TK_RSQUARE);
         }
         // Store param
 
-        param_types[n_params] = param_type;
-        param_names[n_params] = param_name;
-        param_has_arrays_part[n_params] = param_array_part;
-        n_params = n_params + 1;
+        add_symbol(0, param_sym, param_type);
+        push_node(param);
     }
-    expect("RPAREN");
-    emit(")");
+    expect(TK_RPAREN);
+    int n_params = ast_stack_top - mark;
+    int fn = new_node(FN_DECL, n_params, 4 + n_params);
+    ast[fn + 1] = fn_type;
+    ast[fn + 2] = fn_sym;
+    ast[fn + 3] = -1;
+    pop_nodes(fn + 4, mark);
     // --- Check for Prototype (;) or Definition ({) ---
-    if (strcmp(peek(), "SEMICOL") == 0) {
+    if (peek() == TK_SEMICOL) {
         // Function Declaration (Prototype)
         next();
-        emit(";\n");
-        return 0;
-    } else if (strcmp(peek(), "LBRACE") == 0) {
+        clear_local_symbols();
+        return fn;
+    } else if (peek() == TK_LBRACE) {
              // Function Definition
              next();
-             emit(" {\n");
-             // --- Setup local scope ---
-             clear_local_symbols();
-             i = 0;
-             while (i < n_params) {
-            char* var_type = param_types[i];
-            if (param_has_arrays_part[i] == 1) {
-                if (strcmp(var_type, "int") == 0) {
-                    var_type = "int*";
-                } else if (strcmp(var_type, "char") == 0) {
-                         var_type = "char*";
-                     } else if (strcmp(var_type, "char*") == 0) {
-                         var_type = "char**";
-                     } else {
-                         printf("%s\n", concat("Error: Cannot make array of type ", var_type));
-                     }
-            }
-            add_symbol(0, param_names[i], var_type);
-            i = i + 1;
-        }
              // --- Parse function body ---
-             while (strcmp(peek(), "RBRACE") != 0 && strcmp(peek(), "EOF") != 0) {
-            statement();
-        }
-             expect("RBRACE");
-             emit("}\n");
-             return 0;
+             int body = block();
+             ast[fn + 3] = body;
+             expect(TK_RBRACE);
+             return fn;
          } else {
-             printf("%s\n", concat("Error: Expected ';' or '{' after function signature, line ", itos(line_num)));
+             diag_add("Error: Expected ';' or '{' after function signature, line ");
+             diag_add(itos(line_of(line_pos)));
+             syntax_error();
              return -1;
          }
 }
 
+int block() {
+    // Parses statements up to the closing '}' (not consumed)
+    // into an ST_BLOCK node. Also stops before an 'fn', which
+    // cannot start a statement: the '}' is missing.
+    int mark = ast_stack_top;
+    int stmt;
+    while (peek() != TK_RBRACE && peek() != TK_EOF && peek() != TK_FN && n_errors < MAX_ERRORS) {
+        stmt = statement();
+        push_node(stmt);
+        if (stmt < 0 || panic_mode == 1) {
+            synchronize(0);
+        }
+    }
+    int body = new_node(ST_BLOCK, ast_stack_top - mark, 1 + ast_stack_top - mark);
+    pop_nodes(body + 1, mark);
+    return body;
+}
+
 int statement() {
     // Dispatches to the correct statement parser.
-    char* tok = peek();
-    if (strcmp(tok, "LET") == 0) {
-        let_stmt(0);
+    int tok = peek();
+    if (tok == TK_LET) {
+        return let_stmt(0);
         // 0 for local
-    } else if (strcmp(tok, "PRINT") == 0) {
-               print_stmt();
-           } else if (strcmp(tok, "IF") == 0) {
-               if_stmt();
-           } else if (strcmp(tok, "WHILE") == 0) {
-               while_stmt();
-           } else if (strcmp(tok, "RETURN") == 0) {
-               return_stmt();
-           } else if (strcmp(tok, "ID") == 0) {
-               id_stmt();
+    } else if (tok == TK_PRINT) {
+               return print_stmt();
+           } else if (tok == TK_IF) {
+               return if_stmt();
+           } else if (tok == TK_WHILE) {
+               return while_stmt();
+           } else if (tok == TK_RETURN) {
+               return return_stmt();
+           } else if (tok == TK_ID) {
+               return id_stmt();
            } else {
-               printf("%s\n", concat(concat(concat("Error: Unexpected statement: ", tok), " on line "), itos(token_lines[parser_pos])));
+               diag_add("Error: Unexpected statement: ");
+               diag_add(token_name(tok));
+               diag_add(" on line ");
+               diag_add(itos(tok_lineno(parser_pos)));
+               syntax_error();
                next();
                // Consume bad token
                return -1;
            }
-    return 0;
+    return -1;
 }
 
 int let_stmt(int is_global) {
-    int line_num = token_lines[parser_pos];
-    expect("LET");
+    int line_pos = tok_start(parser_pos);
+    expect(TK_LET);
     // --- Get Type ---
-    char* var_type = "undefined";
+    int var_type = TY_NONE;
     // Unspecified type
-    if (strcmp(peek(), "TYPE") == 0) {
-        int var_type_idx = next();
-        var_type = token_pool + token_values[var_type_idx];
+    if (peek() == TK_TYPE) {
+        var_type = type_of_tok(next());
     }
     // --- Get Pointer ---
 
-    if (strcmp(peek(), "MUL") == 0) {
+    while (peek() == TK_MUL) {
         next();
-        if (strcmp(var_type, "int") == 0) {
-            var_type = "int*";
-        } else if (strcmp(var_type, "char") == 0) {
-                 var_type = "char*";
-             } else {
-                 printf("%s\n", concat("Error: Cannot make array of type ", var_type));
-                 return -1;
-             }
+        var_type = pointer_to(var_type);
     }
     // --- Get Name ---
-
-    int var_name_idx = expect("ID");
-    char* var_name = token_pool + token_values[var_name_idx];
+    int var_sym = tok_sym(expect(TK_ID));
+    char* var_name = sym_name(var_sym);
     // Check redefinition
-    if ((is_global == 0 && strcmp(get_symbol_type(0, var_name), "") != 0) || (is_global == 1 && strcmp(get_symbol_type(1, var_name), "") != 0)) {
-        printf("%s\n", concat(concat(concat("Error: Redefinition of variable ", var_name), ", line "), itos(line_num)));
+    if ((is_global == 0 && get_symbol_type(0, var_sym) != TY_NONE) || (is_global == 1 && get_symbol_type(1, var_sym) != TY_NONE)) {
+        diag_add("Error: Redefinition of variable ");
+        diag_add(var_name);
+        diag_add(", line ");
+        diag_add(itos(line_of(line_pos)));
+        report_error();
         return -1;
         // Error
     }
     // --- Parsing Cases ---
 
-    if (strcmp(peek(), "ASSIGN") == 0) {
+    if (peek() == TK_ASSIGN) {
         // --- Case 1: Declaration with Assignment (e.g., beg x = 10) ---
         next();
-        emit(var_type);
-        emit(" ");
-        emit(var_name);
-        emit(" = ");
-        expr();
-        // This emits the C code for the RHS
-        emit(";\n");
-        char* right_type = expr_type;
-        // TODO: inference not working, come back to fix me please
-        if (strcmp(var_type, "undefined") == 0) {
+        int value = expr();
+        // RHS
+        int right_type = expr_type;
+        if (var_type == TY_NONE) {
             var_type = right_type;
             // Infer type
-        } else if (strcmp(var_type, right_type) != 0) {
-                   printf("%s\n", concat(concat(concat(concat(concat("Error: Incompatible type ", right_type), " to "), var_type), ", line "), itos(line_num)));
+        } else if (var_type != right_type) {
+                   diag_add("Error: Incompatible type ");
+                   diag_add(type_name(right_type));
+                   diag_add(" to ");
+                   diag_add(type_name(var_type));
+                   diag_add(", line ");
+                   diag_add(itos(line_of(line_pos)));
+                   report_error();
+                   add_symbol(is_global, var_sym, var_type);
+                   // Still declared, for later statements
                    return -1;
                }
-        expect("SEMICOL");
-        add_symbol(is_global, var_name, var_type);
-        return 0;
-    } else if (strcmp(peek(), "LSQUARE") == 0) {
+        expect(TK_SEMICOL);
+        add_symbol(is_global, var_sym, var_type);
+        // C code: e.g., "int x = 10;", with the declared or inferred type
+        int let = new_node(ST_LET, 0, 4);
+        ast[let + 1] = var_type;
+        ast[let + 2] = var_sym;
+        ast[let + 3] = value;
+        return let;
+    } else if (peek() == TK_LSQUARE) {
              // --- Case 2: Array Declaration (e.g., beg int arr[10]) ---
              next();
-             if (strcmp(var_type, "undefined") == 0) {
-            printf("%s\n", concat("Error: Array declaration must have an explicit type on line", itos(line_num)));
+             if (var_type == TY_NONE || var_type == TY_VOID) {
+            diag_add("Error: Array declaration must have an explicit type on line");
+            diag_add(itos(line_of(line_pos)));
+            report_error();
             return -1;
         }
-             int size_tok = expect("NUMBER");
-             char* size = token_pool + token_values[size_tok];
-             expect("RSQUARE");
-             expect("SEMICOL");
+             int size_tok = expect(TK_NUMBER);
+             expect(TK_RSQUARE);
+             expect(TK_SEMICOL);
              // Store array type as 'base_type*' (e.g., 'int*')
-             char* array_type = "int*";
-             // Default
-             if (strcmp(var_type, "int") == 0) {
-            array_type = "int*";
-        } else if (strcmp(var_type, "char") == 0) {
-                 array_type = "char*";
-             } else if (strcmp(var_type, "char*") == 0) {
-                 array_type = "char**";
-             } else {
-                 printf("%s\n", concat("Error: Cannot make array of type ", var_type));
-                 return -1;
-             }
-             add_symbol(is_global, var_name, array_type);
+             add_symbol(is_global, var_sym, pointer_to(var_type));
              // C code: e.g., "int arr[10];"
-             emit(var_type);
-             emit(" ");
-             emit(var_name);
-             emit("[");
-             emit(size);
-             emit("];\n");
-             return 0;
-         } else if (strcmp(peek(), "SEMICOL") == 0) {
+             int array = new_node(ST_ARRAY, 0, 5);
+             ast[array + 1] = var_type;
+             ast[array + 2] = var_sym;
+             ast[array + 3] = tok_start(size_tok);
+             ast[array + 4] = tok_len(size_tok);
+             return array;
+         } else if (peek() == TK_SEMICOL) {
              // --- Case 3: Declaration without Assignment (e.g., beg int x;) ---
              next();
-             if (strcmp(var_type, "undefined") == 0) {
-            printf("%s\n", concat("Error: Declaration without assignment must have explicit type on line", itos(line_num)));
+             if (var_type == TY_NONE) {
+            diag_add("Error: Declaration without assignment must have explicit type on line");
+            diag_add(itos(line_of(line_pos)));
+            report_error();
             return -1;
         }
-             add_symbol(is_global, var_name, var_type);
-             emit(var_type);
-             emit(" ");
-             emit(var_name);
-             emit(";\n");
-             return 0;
+             add_symbol(is_global, var_sym, var_type);
+             int decl = new_node(ST_DECL, 0, 3);
+             ast[decl + 1] = var_type;
+             ast[decl + 2] = var_sym;
+             return decl;
          } else {
-             printf("%s\n", concat("Error: Expected '=', '[', or ';' after variable name on line", itos(line_num)));
+             diag_add("Error: Expected '=', '[', or ';' after variable name on line");
+             diag_add(itos(line_of(line_pos)));
+             syntax_error();
              next();
              // Consume bad token
              return -1;
@@ -445,30 +927,32 @@ int let_stmt(int is_global) {
 }
 
 int print_stmt() {
-    int line_num = token_lines[parser_pos];
-    expect("PRINT");
-    expect("LPAREN");
-    // Peek the code for the expression to determine its type
-    // Level "expr" calls the top-level expr() parser
-    char* expr_code = peek_code("expr");
-    char* type = expr_type;
-    // peek_code sets this global
-    if (strcmp(type, "int") == 0) {
-        emit("printf(\"%d\\n\", ");
-    } else if (strcmp(type, "char") == 0) {
-               emit("printf(\"%c\\n\", ");
-           } else if (strcmp(type, "char*") == 0) {
-               emit("printf(\"%s\\n\", ");
+    int line_pos = tok_start(parser_pos);
+    expect(TK_PRINT);
+    expect(TK_LPAREN);
+    // The expression type picks the printf format
+    int value = expr();
+    int type = expr_type;
+    int format = 0;
+    if (type == TY_INT) {
+        format = 0;
+    } else if (type == TY_CHAR) {
+               format = 1;
+           } else if (type == TY_STR) {
+               format = 2;
            } else {
-               printf("%s\n", concat(concat(concat("Error: Unprintable type '", type), "' on line "), itos(line_num)));
+               diag_add("Error: Unprintable type '");
+               diag_add(type_name(type));
+               diag_add("' on line ");
+               diag_add(itos(line_of(line_pos)));
+               report_error();
                return -1;
            }
-    // Now emit the code we peeked
-    emit(expr_code);
-    emit(");\n");
-    expect("RPAREN");
-    expect("SEMICOL");
-    return 0;
+    expect(TK_RPAREN);
+    expect(TK_SEMICOL);
+    int print = new_node(ST_PRINT, format, 2);
+    ast[print + 1] = value;
+    return print;
 }
 
 int id_stmt() {
@@ -477,172 +961,186 @@ int id_stmt() {
     // 2. my_func(10);   (Function Call)
     // 3. arr[0] = 5;    (Array Assignment)
     int tok_idx = next();
-    int line_num = token_lines[tok_idx];
-    char* var_name = token_pool + token_values[tok_idx];
+    int line_pos = tok_start(tok_idx);
+    int var_sym = tok_sym(tok_idx);
+    char* var_name;
     // Get variable from local/global scope
-    char* var_type = get_symbol_type(0, var_name);
-    // Declare this here since this compiler can't handle
-    // sub-function (if/while body) scoped declarations
-    char* right_type;
-    if (strcmp(var_type, "") == 0) {
-        printf("%s\n", concat(concat(concat("Error: Undeclared identifier '", var_name), "' on line "), itos(line_num)));
+    int var_type = get_symbol_type(0, var_sym);
+    if (var_type == TY_NONE) {
+        var_name = sym_name(var_sym);
+        diag_add("Error: Undeclared identifier '");
+        diag_add(var_name);
+        diag_add("' on line ");
+        diag_add(itos(line_of(line_pos)));
+        report_error();
         return -1;
     }
     // --- Case 1: Variable Assignment ---
 
-    if (strcmp(peek(), "ASSIGN") == 0) {
+    if (peek() == TK_ASSIGN) {
         next();
-        emit(var_name);
-        emit(" = ");
-        expr();
-        // Emits RHS
-        emit(";\n");
+        int value = expr();
+        // RHS
+        int assign = new_node(ST_ASSIGN, 0, 3);
+        ast[assign + 1] = var_sym;
+        ast[assign + 2] = value;
         // Type check
-        right_type = expr_type;
-        if (strcmp(var_type, right_type) != 0) {
-            printf("%s\n", concat(concat(concat(concat(concat("Error: Incompatible ", right_type), " to "), var_type), " conversion on line "), itos(line_num)));
+        int right_type = expr_type;
+        if (var_type != right_type) {
+            diag_add("Error: Incompatible ");
+            diag_add(type_name(right_type));
+            diag_add(" to ");
+            diag_add(type_name(var_type));
+            diag_add(" conversion on line ");
+            diag_add(itos(line_of(line_pos)));
+            report_error();
             return -1;
         }
-        expect("SEMICOL");
-        return 0;
+        expect(TK_SEMICOL);
+        return assign;
     }
     // --- Case 2: Function Call ---
-    else if (strcmp(peek(), "LPAREN") == 0) {
+    else if (peek() == TK_LPAREN) {
              next();
              // TODO: Check if var_type is a function type
              // For now, we assume if it's not an assignment, it's a function call.
-             emit(var_name);
-             emit("(");
-             int arg_count = 0;
-             while (strcmp(peek(), "RPAREN") != 0) {
-            if (arg_count > 0) {
-                expect("COMMA");
-                emit(", ");
-            }
-            expr();
-            // Emits argument
-            arg_count = arg_count + 1;
-        }
-             expect("RPAREN");
-             expect("SEMICOL");
-             emit(");\n");
-             return 0;
+             int call = call_args(tok_idx);
+             expect(TK_SEMICOL);
+             int stmt = new_node(ST_CALL, 0, 2);
+             ast[stmt + 1] = call;
+             return stmt;
          }
          // --- Case 3: Array Assignment ---
-         else if (strcmp(peek(), "LSQUARE") == 0) {
+         else if (peek() == TK_LSQUARE) {
              next();
              // Check if var_type is a pointer
-             if (str_ends_with(var_type, '*') == 0) {
-            printf("%s\n", concat(concat(concat("Error: Variable '", var_name), "' is not an array and cannot be indexed, line "), itos(line_num)));
+             if (is_pointer(var_type) == 0) {
+            var_name = sym_name(var_sym);
+            diag_add("Error: Variable '");
+            diag_add(var_name);
+            diag_add("' is not an array and cannot be indexed, line ");
+            diag_add(itos(line_of(line_pos)));
+            report_error();
             return -1;
         }
-             emit(var_name);
-             emit("[");
-             expr();
-             // Emits index
-             emit("] = ");
-             if (strcmp(expr_type, "int") != 0) {
-            printf("%s\n", concat(concat(concat("Error: Array index must be an integer, got ", expr_type), ", line "), itos(line_num)));
+             int index = expr();
+             if (expr_type != TY_INT) {
+            diag_add("Error: Array index must be an integer, got ");
+            diag_add(type_name(expr_type));
+            diag_add(", line ");
+            diag_add(itos(line_of(line_pos)));
+            report_error();
             return -1;
         }
-             expect("RSQUARE");
-             expect("ASSIGN");
-             expr();
-             // Emits RHS
-             emit(";\n");
+             expect(TK_RSQUARE);
+             expect(TK_ASSIGN);
+             int value = expr();
+             // RHS
              // Type check
-             right_type = expr_type;
-             char* base_type = "int";
-             // Default to int
-             if (strcmp(var_type, "int*") == 0) {
-            base_type = "int";
-        } else if (strcmp(var_type, "char*") == 0) {
-                 base_type = "char";
-             } else if (strcmp(var_type, "char**") == 0) {
-                 base_type = "char*";
-             }
-             if (strcmp(base_type, right_type) != 0) {
-            printf("%s\n", concat(concat(concat(concat(concat("Error: Incompatible types: cannot assign ", right_type), " to array element of type "), base_type), ", line "), itos(line_num)));
+             int right_type = expr_type;
+             int base_type = deref(var_type);
+             if (base_type != right_type) {
+            diag_add("Error: Incompatible types: cannot assign ");
+            diag_add(type_name(right_type));
+            diag_add(" to array element of type ");
+            diag_add(type_name(base_type));
+            diag_add(", line ");
+            diag_add(itos(line_of(line_pos)));
+            report_error();
             return -1;
         }
-             expect("SEMICOL");
-             return 0;
+             expect(TK_SEMICOL);
+             int store = new_node(ST_STORE, 0, 4);
+             ast[store + 1] = var_sym;
+             ast[store + 2] = index;
+             ast[store + 3] = value;
+             return store;
          }
          // --- Case 4: Error ---
          else {
-             printf("%s\n", concat(concat(concat("Error: Invalid statement start. Expected '=', '(', or '[' after ID '", var_name), "', line "), itos(line_num)));
+             var_name = sym_name(var_sym);
+             diag_add("Error: Invalid statement start. Expected '=', '(', or '[' after ID '");
+             diag_add(var_name);
+             diag_add("', line ");
+             diag_add(itos(line_of(line_pos)));
+             syntax_error();
              return -1;
          }
 }
 
 int if_stmt() {
-    expect("IF");
-    emit("if (");
-    expr();
-    // Emit condition
-    emit(") {\n");
-    expect("LBRACE");
-    while (strcmp(peek(), "RBRACE") != 0 && strcmp(peek(), "EOF") != 0) {
-        statement();
-    }
-    expect("RBRACE");
-    emit("}\n");
+    expect(TK_IF);
+    int cond = expr();
+    int else_part = -1;
+    expect(TK_LBRACE);
+    enter_scope();
+    int then_part = block();
+    leave_scope();
+    expect(TK_RBRACE);
     // Handle else
-    if (strcmp(peek(), "ELSE") == 0) {
+    if (peek() == TK_ELSE) {
         next();
-        emit("else ");
         // Case 1: else-if
-        if (strcmp(peek(), "IF") == 0) {
-            if_stmt();
+        if (peek() == TK_IF) {
+            else_part = if_stmt();
         }
         // Case 2: else
-        else if (strcmp(peek(), "LBRACE") == 0) {
+        else if (peek() == TK_LBRACE) {
                  next();
-                 emit("{\n");
-                 while (strcmp(peek(), "RBRACE") != 0 && strcmp(peek(), "EOF") != 0) {
-                statement();
-            }
-                 expect("RBRACE");
-                 emit("}\n");
+                 enter_scope();
+                 else_part = block();
+                 leave_scope();
+                 expect(TK_RBRACE);
              }
              // Case 3: Error
              else {
-                 int tok_line = token_lines[parser_pos];
-                 printf("%s\n", concat("Error: Expected 'if' or '{' after 'else', line ", itos(tok_line)));
+                 int tok_line = tok_lineno(parser_pos);
+                 diag_add("Error: Expected 'if' or '{' after 'else', line ");
+                 diag_add(itos(tok_line));
+                 syntax_error();
                  return -1;
              }
     }
-    return 0;
+    int node = new_node(ST_IF, 0, 4);
+    ast[node + 1] = cond;
+    ast[node + 2] = then_part;
+    ast[node + 3] = else_part;
+    return node;
 }
 
 int while_stmt() {
-    expect("WHILE");
-    emit("while (");
-    expr();
-    emit(") {\n");
-    expect("LBRACE");
-    while (strcmp(peek(), "RBRACE") != 0 && strcmp(peek(), "EOF") != 0) {
-        statement();
-    }
-    expect("RBRACE");
-    emit("}\n");
-    return 0;
+    expect(TK_WHILE);
+    int cond = expr();
+    expect(TK_LBRACE);
+    enter_scope();
+    int body = block();
+    leave_scope();
+    expect(TK_RBRACE);
+    int node = new_node(ST_WHILE, 0, 3);
+    ast[node + 1] = cond;
+    ast[node + 2] = body;
+    return node;
 }
 
 int return_stmt() {
-    int line_num = token_lines[parser_pos];
-    expect("RETURN");
-    emit("return ");
-    expr();
-    // Emit expression
-    emit(";\n");
-    char* ret_type = expr_type;
-    expect("SEMICOL");
-    if (strcmp(current_fn_ret_type, ret_type) != 0) {
-        printf("%s\n", concat(concat(concat(concat(concat("Error: Incompatible ", ret_type), " to "), current_fn_ret_type), " conversion on line "), itos(line_num)));
+    int line_pos = tok_start(parser_pos);
+    expect(TK_RETURN);
+    int value = expr();
+    int ret_type = expr_type;
+    if (current_fn_ret_type != ret_type) {
+        diag_add("Error: Incompatible ");
+        diag_add(type_name(ret_type));
+        diag_add(" to ");
+        diag_add(type_name(current_fn_ret_type));
+        diag_add(" conversion on line ");
+        diag_add(itos(line_of(line_pos)));
+        report_error();
         return -1;
     }
-    return 0;
+    expect(TK_SEMICOL);
+    int node = new_node(ST_RETURN, 0, 2);
+    ast[node + 1] = value;
+    return node;
 }
 
 // =============================================================
@@ -650,226 +1148,177 @@ int return_stmt() {
 // =============================================================
 int expr() {
     // Main entry point for parsing an expression.
-    // Emits C code. Sets global 'expr_type'.
-    return logical();
+    // Returns its node, see emit_expr(). Sets global 'expr_type'.
+    // A bad expression leaves no type to check the statement with, so
+    // it enters panic mode like a syntax error.
+    int node = binary_expr(1);
+    if (node < 0) {
+        panic_mode = 1;
+    }
+    return node;
 }
 
-int logical() {
-    // Handles: expr (&& | ||) expr
-    relational();
-    // Emits left side
-    char* left_type = expr_type;
-    while (strcmp(peek(), "OR") == 0 || strcmp(peek(), "AND") == 0) {
+int binary_expr(int min_prec) {
+    // Precedence climbing: parses operands joined by binary operators
+    // of precedence 'min_prec' or higher, see OP_PREC. The right operand
+    // only takes tighter operators, so equal ones associate left.
+    int left = unary();
+    int left_type = expr_type;
+    if (left < 0) {
+        return -1;
+    }
+    while (op_prec(peek()) >= min_prec) {
+        // Read the operator before the right operand, which may be long
+        // enough to push it out of the token window
         int op_idx = next();
-        char* op = op_to_c_op(token_types[op_idx]);
-        emit(" ");
-        emit(op);
-        emit(" ");
-        logical();
-        // Emits right side
-        char* right_type = expr_type;
-        // Type check: logical ops must be on ints (or chars)
-        if (strcmp(left_type, "int") != 0 || strcmp(right_type, "int") != 0) {
-            printf("%s\n", concat("Error: Logical operators '&&' and '||' can only be used on integers, line ", itos(token_lines[op_idx])));
+        int op_kind = tok_kind(op_idx);
+        int op_pos = tok_start(op_idx);
+        int prec = op_prec(op_kind);
+        int right = binary_expr(prec + 1);
+        if (right < 0) {
             return -1;
         }
-        expr_type = "int";
-        // Result is always an int
-        left_type = "int";
+        left = binary_node(op_kind, op_pos, prec, left, left_type, right, expr_type);
+        if (left < 0) {
+            return -1;
+        }
+        left_type = expr_type;
     }
     expr_type = left_type;
-    // Set final type
-    return 0;
+    return left;
 }
 
-int relational() {
-    // Handles: expr (== | != | < | > | <= | >=) expr
-    // 1. Peek LHS (using additive parser)
-    char* left_ptr = peek_code("additive");
-    char* left_type = expr_type;
-    // Need local copy because peek_code buffer will be overwritten
-    char left_buf[2048];
-    int i = 0;
-    while (left_ptr[i] != '\0') {
-        left_buf[i] = left_ptr[i];
-        i = i + 1;
-    }
-    left_buf[i] = '\0';
-    if (strcmp(peek(), "EQ") == 0 || strcmp(peek(), "NE") == 0 || strcmp(peek(), "LT") == 0 || strcmp(peek(), "GT") == 0 || strcmp(peek(), "LE") == 0 || strcmp(peek(), "GE") == 0) {
-        while (strcmp(peek(), "EQ") == 0 || strcmp(peek(), "NE") == 0 || strcmp(peek(), "LT") == 0 || strcmp(peek(), "GT") == 0 || strcmp(peek(), "LE") == 0 || strcmp(peek(), "GE") == 0) {
-            int op_idx = next();
-            char* op = op_to_c_op(token_types[op_idx]);
-            int line = token_lines[op_idx];
-            // 2. Peek RHS
-            char* right_code = peek_code("relational");
-            char* right_type = expr_type;
-            // 3. Generate Code
-            if (strcmp(left_type, "char*") == 0 && strcmp(right_type, "char*") == 0) {
-                if (strcmp(op, "==") == 0) {
-                    emit("strcmp(");
-                    emit(left_buf);
-                    emit(", ");
-                    emit(right_code);
-                    emit(") == 0");
-                } else if (strcmp(op, "!=") == 0) {
-                           emit("strcmp(");
-                           emit(left_buf);
-                           emit(", ");
-                           emit(right_code);
-                           emit(") != 0");
-                       } else {
-                           printf("%s\n", concat(concat(concat("Error: Operator '", op), "' not allowed on strings, line "), itos(line)));
-                           return -1;
-                       }
-            } else if ((strcmp(left_type, "char*") == 0 && strcmp(right_type, "int") == 0) || (strcmp(left_type, "int") == 0 && strcmp(right_type, "char*") == 0)) {
-                       if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0) {
-                    emit(left_buf);
-                    emit(" ");
-                    emit(op);
-                    emit(" ");
-                    emit(right_code);
-                } else {
-                    printf("%s\n", concat(concat(concat("Error: Operator '", op), "' not allowed on strings, line "), itos(line)));
-                    return -1;
-                }
-                   } else if (strcmp(left_type, "char*") == 0 || strcmp(right_type, "char*") == 0) {
-                       printf("%s\n", concat("Error: Comparison between string and non-string, line ", itos(line)));
-                       return -1;
-                   } else {
-                       // Standard int/char
-                       emit(left_buf);
-                       emit(" ");
-                       emit(op);
-                       emit(" ");
-                       emit(right_code);
-                   }
-            expr_type = "int";
-            left_type = "int";
-        }
-    } else {
-        // No operators, just emit LHS
-        emit(left_buf);
-        expr_type = left_type;
-        // Restore type
+int op_prec(int kind) {
+    // Precedence of token kind 'kind' as a binary operator, 0 if none.
+    if (kind >= N_TOKEN_KINDS) {
+        return 0;
     }
-    return 0;
+    return ctoi(OP_PREC[kind]) - ctoi('0');
 }
 
-int additive() {
-    // Handles: expr (+ | -) expr
-    // This also handles pointer arithmetic.
-    // 1. Peek LHS (using multiplicative parser)
-    char* left_ptr = peek_code("multiplicative");
-    char* left_type = expr_type;
-    // Need local copy because peek_code buffer will be overwritten
-    char left_buf[2048];
-    int i = 0;
-    while (left_ptr[i] != '\0') {
-        left_buf[i] = left_ptr[i];
-        i = i + 1;
-    }
-    left_buf[i] = '\0';
-    if (strcmp(peek(), "PLUS") == 0 || strcmp(peek(), "MINUS") == 0) {
-        while (strcmp(peek(), "PLUS") == 0 || strcmp(peek(), "MINUS") == 0) {
-            int op_idx = next();
-            char* op = op_to_c_op(token_types[op_idx]);
-            int line = token_lines[op_idx];
-            // 2. Peek RHS
-            char* right_code = peek_code("additive");
-            char* right_type = expr_type;
-            // 3. Generate Code
-            // Case 1: int + int
-            if (strcmp(left_type, "int") == 0 && strcmp(right_type, "int") == 0) {
-                emit(left_buf);
-                emit(" ");
-                emit(op);
-                emit(" ");
-                emit(right_code);
-                expr_type = "int";
-            }
-            // Case 2: Pointer Arithmetic
-            else if (str_ends_with(left_type, '*') && strcmp(right_type, "int") == 0) {
-                     emit(left_buf);
-                     emit(" ");
-                     emit(op);
-                     emit(" ");
-                     emit(right_code);
-                     expr_type = left_type;
-                     // e.g., int* + int = int*
-                 } else if (strcmp(left_type, "int") == 0 && str_ends_with(right_type, '*')) {
-                     if (strcmp(op, "+") == 0) {
-                    emit(left_buf);
-                    emit(op);
-                    emit(right_code);
-                    expr_type = right_type;
-                    // int + int* = int*
-                } else {
-                    printf("%s\n", concat("Error: Cannot subtract a pointer from an integer, line ", itos(line)));
-                    return -1;
-                }
-                 }
-                 // Case 3: String Concat (char* + char*)
-                 else if (strcmp(left_type, "char*") == 0 && strcmp(right_type, "char*") == 0 && strcmp(op, "+") == 0) {
-                     emit("concat(");
-                     emit(left_buf);
-                     emit(", ");
-                     emit(right_code);
-                     emit(")");
-                     expr_type = "char*";
-                 }
-                 // Case 4: Error
-                 else {
-                     printf("%s\n", concat(concat(concat(concat(concat(concat(concat("Error: Operator '", op), "' not allowed between '"), left_type), "' and '"), right_type), "', line "), itos(line)));
-                     return -1;
-                 }
-            left_type = expr_type;
+int binary_node(int op_kind, int op_pos, int prec, int left, int left_type, int right, int right_type) {
+    // Type checks 'left op right' and returns its node, or -1.
+    // 'op_pos' is where the operator starts, for error messages.
+    // Sets 'expr_type' to the type of the result.
+    char* op = op_to_c_op(op_kind);
+    // --- Logical: || && ---
+    if (prec <= 2) {
+        // Logical ops must be on ints (or chars)
+        if (left_type != TY_INT || right_type != TY_INT) {
+            diag_add("Error: Logical operators '&&' and '||' can only be used on integers, line ");
+            diag_add(itos(line_of(op_pos)));
+            report_error();
+            return -1;
         }
-    } else {
-        // No operators, just emit LHS
-        emit(left_buf);
-        expr_type = left_type;
-        // Restore type
+        expr_type = TY_INT;
+        // Result is always an int
+        return new_expr(EX_BINARY, op_kind, left, right);
     }
-    expr_type = left_type;
-    return 0;
-}
+    // --- Relational: == != < > <= >= ---
 
-int multiplicative() {
-    // Handles: expr (* | /) expr
-    unary();
-    char* left_type = expr_type;
-    while (strcmp(peek(), "MUL") == 0 || strcmp(peek(), "DIV") == 0) {
-        int op_idx = next();
-        char* op = op_to_c_op(token_types[op_idx]);
-        emit(" ");
-        emit(op);
-        emit(" ");
-        unary();
-        char* right_type = expr_type;
-        if (strcmp(left_type, "int") != 0 || strcmp(right_type, "int") != 0) {
-            printf("%s\n", concat("Error: Operators '*' and '/' can only be used on integers, line ", itos(token_lines[op_idx])));
+    if (prec <= 4) {
+        expr_type = TY_INT;
+        if (left_type == TY_STR && right_type == TY_STR) {
+            if (op_kind == TK_EQ || op_kind == TK_NE) {
+                return new_expr(EX_STRCMP, op_kind, left, right);
+            }
+            diag_add("Error: Operator '");
+            diag_add(op);
+            diag_add("' not allowed on strings, line ");
+            diag_add(itos(line_of(op_pos)));
+            report_error();
             return -1;
+        } else if ((left_type == TY_STR && right_type == TY_INT) || (left_type == TY_INT && right_type == TY_STR)) {
+                   if (op_kind == TK_EQ || op_kind == TK_NE) {
+                return new_expr(EX_BINARY, op_kind, left, right);
+            }
+                   diag_add("Error: Operator '");
+                   diag_add(op);
+                   diag_add("' not allowed on strings, line ");
+                   diag_add(itos(line_of(op_pos)));
+                   report_error();
+                   return -1;
+               } else if (left_type == TY_STR || right_type == TY_STR) {
+                   diag_add("Error: Comparison between string and non-string, line ");
+                   diag_add(itos(line_of(op_pos)));
+                   report_error();
+                   return -1;
+               }
+               // Standard int/char
+
+        return new_expr(EX_BINARY, op_kind, left, right);
+    }
+    // --- Additive: + -, with pointer arithmetic ---
+
+    if (prec == 5) {
+        // Case 1: int + int
+        if (left_type == TY_INT && right_type == TY_INT) {
+            expr_type = TY_INT;
+            return new_expr(EX_BINARY, op_kind, left, right);
         }
-        expr_type = "int";
-        left_type = "int";
+        // Case 2: Pointer Arithmetic
+        else if (is_pointer(left_type) && right_type == TY_INT) {
+                 expr_type = left_type;
+                 // e.g., int* + int = int*
+                 return new_expr(EX_BINARY, op_kind, left, right);
+             } else if (left_type == TY_INT && is_pointer(right_type)) {
+                 if (op_kind == TK_PLUS) {
+                expr_type = right_type;
+                // int + int* = int*
+                return new_expr(EX_PTR_ADD, 0, left, right);
+            }
+                 diag_add("Error: Cannot subtract a pointer from an integer, line ");
+                 diag_add(itos(line_of(op_pos)));
+                 report_error();
+                 return -1;
+             }
+             // Case 3: String Concat (char* + char*)
+             else if (left_type == TY_STR && right_type == TY_STR && op_kind == TK_PLUS) {
+                 expr_type = TY_STR;
+                 return new_expr(EX_CONCAT, 0, left, right);
+             }
+             // Case 4: Error
+
+        diag_add("Error: Operator '");
+        diag_add(op);
+        diag_add("' not allowed between '");
+        diag_add(type_name(left_type));
+        diag_add("' and '");
+        diag_add(type_name(right_type));
+        diag_add("', line ");
+        diag_add(itos(line_of(op_pos)));
+        report_error();
+        return -1;
     }
-    expr_type = left_type;
-    return 0;
+    // --- Multiplicative: * / ---
+
+    if (left_type != TY_INT || right_type != TY_INT) {
+        diag_add("Error: Operators '*' and '/' can only be used on integers, line ");
+        diag_add(itos(line_of(op_pos)));
+        report_error();
+        return -1;
+    }
+    expr_type = TY_INT;
+    return new_expr(EX_BINARY, op_kind, left, right);
 }
 
 int unary() {
     // Handles: -expr
-    if (strcmp(peek(), "MINUS") == 0) {
+    if (peek() == TK_MINUS) {
         int op_idx = next();
-        emit("-");
-        unary();
+        int op_pos = tok_start(op_idx);
+        int operand = unary();
         // Recursive call
-        if (strcmp(expr_type, "int") != 0) {
-            printf("%s\n", concat("Error: Unary '-' operator can only be applied to integers, line ", itos(token_lines[op_idx])));
+        if (expr_type != TY_INT) {
+            diag_add("Error: Unary '-' operator can only be applied to integers, line ");
+            diag_add(itos(line_of(op_pos)));
+            report_error();
             return -1;
         }
-        expr_type = "int";
-        return 0;
+        expr_type = TY_INT;
+        int neg = new_node(EX_NEG, 0, 2);
+        ast[neg + 1] = operand;
+        return neg;
     }
     return atom();
 }
@@ -878,248 +1327,1184 @@ int atom() {
     // Handles: literals, variables, (expr), fn_call(), arr[idx]
     // This is the first function to set the global 'expr_type'.
     int tok_idx = next();
-    char* tok_type = token_types[tok_idx];
-    int tok_val_idx = token_values[tok_idx];
-    int tok_line = token_lines[tok_idx];
+    int tok_type = tok_kind(tok_idx);
+    int tok_pos = tok_start(tok_idx);
+    char* var_name;
     // Case 1: Literals
-    if (strcmp(tok_type, "NUMBER") == 0) {
-        expr_type = "int";
-        emit(token_pool + tok_val_idx);
-    } else if (strcmp(tok_type, "CHAR") == 0) {
-             expr_type = "char";
-             emit("'");
-             emit(token_pool + tok_val_idx);
-             emit("'");
-         } else if (strcmp(tok_type, "STRING") == 0) {
-             expr_type = "char*";
-             emit("\"");
-             emit(token_pool + tok_val_idx);
-             emit("\"");
+    if (tok_type == TK_NUMBER) {
+        expr_type = TY_INT;
+        return new_expr(EX_LEAF, tok_type, tok_pos, tok_len(tok_idx));
+    } else if (tok_type == TK_CHAR) {
+             expr_type = TY_CHAR;
+             return new_expr(EX_LEAF, tok_type, tok_pos, tok_len(tok_idx));
+         } else if (tok_type == TK_STRING) {
+             expr_type = TY_STR;
+             return new_expr(EX_LEAF, tok_type, tok_pos, tok_len(tok_idx));
          }
          // Case 2: Parenthesized Expression
-         else if (strcmp(tok_type, "LPAREN") == 0) {
-             emit("(");
-             expr();
-             emit(")");
-             expect("RPAREN");
+         else if (tok_type == TK_LPAREN) {
+             int inner = expr();
+             expect(TK_RPAREN);
+             int paren = new_node(EX_PAREN, 0, 2);
+             ast[paren + 1] = inner;
+             return paren;
          }
          // Case 3: Identifier (var, array index, function call)
-         else if (strcmp(tok_type, "ID") == 0) {
-             char* var_name = token_pool + tok_val_idx;
+         else if (tok_type == TK_ID) {
              // Look for symbol in local, then global scope
-             char* sym_type = get_symbol_type(0, var_name);
-             if (strcmp(sym_type, "") == 0) {
-            printf("%s\n", concat(concat(concat("Error: Undeclared identifier '", var_name), "' on line "), itos(tok_line)));
+             int sym_type = get_symbol_type(0, tok_sym(tok_idx));
+             if (sym_type == TY_NONE) {
+            var_name = sym_name(tok_sym(tok_idx));
+            diag_add("Error: Undeclared identifier '");
+            diag_add(var_name);
+            diag_add("' on line ");
+            diag_add(itos(line_of(tok_pos)));
+            report_error();
             return -1;
         }
         // Sub-case 3a: Function Call - ID()
 
-             if (strcmp(peek(), "LPAREN") == 0) {
+             if (peek() == TK_LPAREN) {
             next();
-            emit(var_name);
-            emit("(");
-            int arg_count = 0;
-            while (strcmp(peek(), "RPAREN") != 0) {
-                if (arg_count > 0) {
-                    expect("COMMA");
-                    emit(", ");
-                }
-                expr();
-                arg_count = arg_count + 1;
-            }
+            int call = call_args(tok_idx);
             expr_type = sym_type;
             // Type is the function's return type
-            expect("RPAREN");
-            emit(")");
+            return call;
         }
         // Sub-case 3b: Array Access - ID[]
-        else if (strcmp(peek(), "LSQUARE") == 0) {
-                 if (str_ends_with(sym_type, '*') == 0) {
-                printf("%s\n", concat(concat(concat("Error: Variable '", var_name), "' is not an array and cannot be indexed, line "), itos(tok_line)));
+        else if (peek() == TK_LSQUARE) {
+                 if (is_pointer(sym_type) == 0) {
+                var_name = sym_name(tok_sym(tok_idx));
+                diag_add("Error: Variable '");
+                diag_add(var_name);
+                diag_add("' is not an array and cannot be indexed, line ");
+                diag_add(itos(line_of(tok_pos)));
+                report_error();
                 return -1;
             }
+            // The index may be long enough to push the name out of the token window
+
+                 int name_len = tok_len(tok_idx);
                  next();
-                 emit(var_name);
-                 emit("[");
-                 expr();
-                 if (strcmp(expr_type, "int") != 0) {
-                printf("%s\n", concat("Error: Array index must be an integer, line ", itos(tok_line)));
+                 int index = expr();
+                 if (expr_type != TY_INT) {
+                diag_add("Error: Array index must be an integer, line ");
+                diag_add(itos(line_of(tok_pos)));
+                report_error();
                 return -1;
             }
-                 expect("RSQUARE");
-                 emit("]");
+                 expect(TK_RSQUARE);
                  // Set type to the base type (e.g., "int*" -> "int")
-                 // TODO: We need a string function for this.
-                 // For now, we assume simple types.
-                 if (strcmp(sym_type, "int*") == 0) {
-                expr_type = "int";
-            } else if (strcmp(sym_type, "char*") == 0) {
-                     expr_type = "char";
-                 } else if (strcmp(sym_type, "char**") == 0) {
-                     expr_type = "char*";
-                 } else {
-                     expr_type = "int";
-                 }
-                 // Default assumption
+                 expr_type = deref(sym_type);
+                 int node = new_node(EX_INDEX, 0, 4);
+                 ast[node + 1] = tok_pos;
+                 ast[node + 2] = name_len;
+                 ast[node + 3] = index;
+                 return node;
              }
              // Sub-case 3c: Simple Variable
              else {
                  expr_type = sym_type;
-                 emit(var_name);
+                 return new_expr(EX_LEAF, tok_type, tok_pos, tok_len(tok_idx));
              }
          }
          // Case 4: Error
          else {
-             printf("%s\n", concat(concat(concat("Error: Unexpected token in expression: ", tok_type), " on line "), itos(tok_line)));
+             diag_add("Error: Unexpected token in expression: ");
+             diag_add(token_name(tok_type));
+             diag_add(" on line ");
+             diag_add(itos(line_of(tok_pos)));
+             syntax_error();
              return -1;
          }
-    return 0;
+    return -1;
+}
+
+int call_args(int tok_idx) {
+    // Parses the arguments of a call to function token 'tok_idx',
+    // up to and including ')', into an EX_CALL node.
+    int name_pos = tok_start(tok_idx);
+    int name_len = tok_len(tok_idx);
+    int mark = ast_stack_top;
+    int arg_count = 0;
+    while (peek() != TK_RPAREN && peek() != TK_EOF && panic_mode == 0) {
+        if (arg_count > 0) {
+            expect(TK_COMMA);
+        }
+        push_node(expr());
+        arg_count = arg_count + 1;
+    }
+    expect(TK_RPAREN);
+    int n_args = ast_stack_top - mark;
+    int call = new_node(EX_CALL, n_args, 3 + n_args);
+    ast[call + 1] = name_pos;
+    ast[call + 2] = name_len;
+    pop_nodes(call + 3, mark);
+    return call;
+}
+
+int new_expr(int kind, int value, int a, int b) {
+    // Adds an expression node with two fields, see Syntax Tree.
+    int node = new_node(kind, value, 3);
+    ast[node + 1] = a;
+    ast[node + 2] = b;
+    return node;
 }
 
 // =============================================================
-// Parser Helpers
+// Syntax Tree Helpers
 // =============================================================
-char* peek() {
-    // Returns the type of the current token.
-    return token_types[parser_pos];
+int new_node(int kind, int value, int size) {
+    // Allocates a record of 'size' ints in the arena and returns its
+    // offset. Only the first int is set.
+    while (ast_top + size > ast_cap) {
+        ast_cap = ast_cap * 2 + 4096;
+        ast = grow_ints(ast, ast_cap);
+    }
+    int node = ast_top;
+    ast[node] = kind + value * 256;
+    ast_top = ast_top + size;
+    return node;
 }
 
-int next() {
-    // Consumes the current token and returns its index.
-    int current_pos = parser_pos;
-    parser_pos = parser_pos + 1;
-    return current_pos;
+int node_kind(int node) {
+    int word = ast[node];
+    return word - (word / 256) * 256;
 }
 
-int expect(char* kind) {
-    // Checks if the current token is of the expected 'kind'.
-    // If yes, consumes it and returns its index.
-    // If no, prints an error and returns -1.
-    // Skips comments and gets type
-    char* tok_type = peek();
-    if (strcmp(tok_type, kind) == 0) {
-        // Consume and return index
-        return next();
+int node_value(int node) {
+    return ast[node] / 256;
+}
+
+int push_node(int node) {
+    // Adds 'node' to the list being collected on ast_stack.
+    // A failed parse (-1) is left out, its error is already printed.
+    if (node < 0) {
+        return 0;
     }
-    // Handle error
+    if (ast_stack_top == ast_stack_cap) {
+        ast_stack_cap = ast_stack_cap * 2 + 256;
+        ast_stack = grow_ints(ast_stack, ast_stack_cap);
+    }
+    ast_stack[ast_stack_top] = node;
+    ast_stack_top = ast_stack_top + 1;
+    return 0;
+}
 
-    int tok_line = token_lines[parser_pos];
-    printf("%s\n", concat("Error: Syntax Error on line ", itos(tok_line)));
-    printf("%s\n", concat("Expected token: ", kind));
-    printf("%s\n", concat("... but got token: ", tok_type));
-    // In a real compiler, we'd exit here.
-    return -1;
-    // Indicate error
+int pop_nodes(int dest, int mark) {
+    // Moves the nodes pushed since ast_stack_top was 'mark' into the
+    // arena at 'dest', in order.
+    int i = mark;
+    while (i < ast_stack_top) {
+        ast[dest + i - mark] = ast_stack[i];
+        i = i + 1;
+    }
+    ast_stack_top = mark;
+    return 0;
+}
+
+int ast_reset() {
+    // Empties the arena, for the next compile.
+    ast_top = 0;
+    ast_stack_top = 0;
+    return 0;
 }
 
 // =============================================================
-// Symbol Table Helpers
+// Code Generation
 // =============================================================
-int clear_local_symbols() {
-    // Clears the local (function-level) symbol table.
-    // Called when entering a new function.
-    n_locals = 0;
+int emit_program(int program) {
+    // Emits the C code of every declaration of the file.
+    int n = node_value(program);
+    int i = 1;
+    while (i <= n) {
+        int decl = ast[program + i];
+        if (node_kind(decl) == FN_DECL) {
+            emit_fn(decl);
+        } else {
+            emit_stmt(decl);
+        }
+        i = i + 1;
+    }
     return 0;
 }
 
-char* get_symbol_type(int is_global, char* name) {
-    // Searches for a variable 'name' in the given 'scope'.
-    // Returns its type (e.g., "int", "char*") if found.
-    // Returns "" (empty string) if not found.
+int emit_fn(int fn) {
+    // Emits a function prototype or definition.
+    emit(type_name(ast[fn + 1]));
+    emit(" ");
+    emit(sym_name(ast[fn + 2]));
+    emit("(");
+    int n_params = node_value(fn);
     int i = 0;
-    if (is_global == 0) {
-        while (i < n_locals) {
-            if (strcmp(local_names[i], name) == 0) {
-                return local_types[i];
-            }
-            i = i + 1;
+    while (i < n_params) {
+        if (i > 0) {
+            emit(", ");
         }
+        int param = ast[fn + 4 + i];
+        emit(type_name(ast[param + 1]));
+        emit(" ");
+        emit(sym_name(ast[param + 2]));
+        if (node_value(param) == 1) {
+            emit("[]");
+        } else if (node_value(param) == 2) {
+                   emit("[");
+                   emit_span(ast[param + 3], ast[param + 4]);
+                   emit("]");
+               }
+        i = i + 1;
+    }
+    emit(")");
+    if (ast[fn + 3] < 0) {
+        emit(";\n");
     } else {
-        // "global"
-        while (i < n_globals) {
-            if (strcmp(global_names[i], name) == 0) {
-                return global_types[i];
-            }
+        emit(" ");
+        emit_stmt(ast[fn + 3]);
+    }
+    return 0;
+}
+
+int emit_stmt(int node) {
+    // Emits the C code of statement 'node'.
+    int kind = node_kind(node);
+    if (kind == ST_BLOCK) {
+        emit("{\n");
+        int n = node_value(node);
+        int i = 1;
+        while (i <= n) {
+            emit_stmt(ast[node + i]);
             i = i + 1;
         }
-    }
-    // Not found, check outer scope (if local)
-    if (is_global == 0) {
-        return get_symbol_type(1, name);
-    }
-    return "";
-    // Not found anywhere
+        emit("}\n");
+    } else if (kind == ST_LET) {
+               emit(type_name(ast[node + 1]));
+               emit(" ");
+               emit(sym_name(ast[node + 2]));
+               emit(" = ");
+               emit_expr(ast[node + 3]);
+               emit(";\n");
+           } else if (kind == ST_ARRAY) {
+               emit(type_name(ast[node + 1]));
+               emit(" ");
+               emit(sym_name(ast[node + 2]));
+               emit("[");
+               emit_span(ast[node + 3], ast[node + 4]);
+               emit("];\n");
+           } else if (kind == ST_DECL) {
+               emit(type_name(ast[node + 1]));
+               emit(" ");
+               emit(sym_name(ast[node + 2]));
+               emit(";\n");
+           } else if (kind == ST_PRINT) {
+               // Value 0 int, 1 char, 2 char*
+               char* format = "printf(\"%d\\n\", ";
+               if (node_value(node) == 1) {
+            format = "printf(\"%c\\n\", ";
+        }
+               if (node_value(node) == 2) {
+            format = "printf(\"%s\\n\", ";
+        }
+               emit(format);
+               emit_expr(ast[node + 1]);
+               emit(");\n");
+           } else if (kind == ST_ASSIGN) {
+               emit(sym_name(ast[node + 1]));
+               emit(" = ");
+               emit_expr(ast[node + 2]);
+               emit(";\n");
+           } else if (kind == ST_STORE) {
+               emit(sym_name(ast[node + 1]));
+               emit("[");
+               emit_expr(ast[node + 2]);
+               emit("] = ");
+               emit_expr(ast[node + 3]);
+               emit(";\n");
+           } else if (kind == ST_CALL) {
+               emit_expr(ast[node + 1]);
+               emit(";\n");
+           } else if (kind == ST_IF) {
+               emit("if (");
+               emit_expr(ast[node + 1]);
+               emit(") ");
+               emit_stmt(ast[node + 2]);
+               if (ast[node + 3] >= 0) {
+            emit("else ");
+            emit_stmt(ast[node + 3]);
+        }
+           } else if (kind == ST_WHILE) {
+               emit("while (");
+               emit_expr(ast[node + 1]);
+               emit(") ");
+               emit_stmt(ast[node + 2]);
+           } else if (kind == ST_RETURN) {
+               emit("return ");
+               emit_expr(ast[node + 1]);
+               emit(";\n");
+           }
+    return 0;
 }
 
-int add_symbol(int is_global, char* name, char* type) {
-    // Adds a new variable to the symbol table.
-    // Returns 0 on success.
-    // NOTE: This function assumes you have already checked for redefinition.
-    if (is_global == 0) {
-        local_names[n_locals] = name;
-        local_types[n_locals] = type;
-        n_locals = n_locals + 1;
-    } else {
-        global_names[n_globals] = name;
-        global_types[n_globals] = type;
-        n_globals = n_globals + 1;
+int emit_expr(int node) {
+    // Emits the C code of expression 'node'.
+    // A failed parse (-1) emits nothing, its error is already printed.
+    if (node < 0) {
+        return -1;
     }
+    int kind = node_kind(node);
+    if (kind == EX_LEAF) {
+        if (node_value(node) == TK_CHAR) {
+            emit("'");
+            emit_span(ast[node + 1], ast[node + 2]);
+            emit("'");
+        } else if (node_value(node) == TK_STRING) {
+                   emit("\"");
+                   emit_span(ast[node + 1], ast[node + 2]);
+                   emit("\"");
+               } else {
+                   emit_span(ast[node + 1], ast[node + 2]);
+               }
+    } else if (kind == EX_BINARY) {
+               emit_expr(ast[node + 1]);
+               emit(" ");
+               emit(op_to_c_op(node_value(node)));
+               emit(" ");
+               emit_expr(ast[node + 2]);
+           } else if (kind == EX_CALL) {
+               emit_span(ast[node + 1], ast[node + 2]);
+               emit("(");
+               int n_args = node_value(node);
+               int i = 0;
+               while (i < n_args) {
+            if (i > 0) {
+                emit(", ");
+            }
+            emit_expr(ast[node + 3 + i]);
+            i = i + 1;
+        }
+               emit(")");
+           } else if (kind == EX_INDEX) {
+               emit_span(ast[node + 1], ast[node + 2]);
+               emit("[");
+               emit_expr(ast[node + 3]);
+               emit("]");
+           } else if (kind == EX_PAREN) {
+               emit("(");
+               emit_expr(ast[node + 1]);
+               emit(")");
+           } else if (kind == EX_NEG) {
+               emit("-");
+               emit_expr(ast[node + 1]);
+           } else if (kind == EX_CONCAT) {
+               emit("concat(");
+               emit_expr(ast[node + 1]);
+               emit(", ");
+               emit_expr(ast[node + 2]);
+               emit(")");
+           } else if (kind == EX_STRCMP) {
+               // Against a string literal, str_is() compares the first chars
+               // before calling strcmp()
+               int str = ast[node + 1];
+               int lit = ast[node + 2];
+               if (node_kind(str) == EX_LEAF && node_value(str) == TK_STRING) {
+            str = ast[node + 2];
+            lit = ast[node + 1];
+        }
+               if (node_kind(lit) == EX_LEAF && node_value(lit) == TK_STRING) {
+            if (node_value(node) == TK_NE) {
+                emit("!");
+            }
+            emit("str_is(");
+            emit_expr(str);
+            emit(", ");
+            emit_expr(lit);
+            emit(")");
+        } else {
+            emit("strcmp(");
+            emit_expr(ast[node + 1]);
+            emit(", ");
+            emit_expr(ast[node + 2]);
+            emit(") ");
+            emit(op_to_c_op(node_value(node)));
+            emit(" 0");
+        }
+           } else if (kind == EX_PTR_ADD) {
+               // int + pointer, written without spaces
+               emit_expr(ast[node + 1]);
+               emit("+");
+               emit_expr(ast[node + 2]);
+           }
     return 0;
 }
 
 // =============================================================
-// Parser Utils
+// Parser Helpers
 // =============================================================
-int str_ends_with(char* s, char c) {
-    // Checks if string 's' ends with character 'c'.
-    // Returns 1 (true) or 0 (false).
-    int len = strlen(s);
-    if (len == 0) {
-        return 0;
-        // Empty string
-    }
-    if (s[len - 1] == c) {
-        return 1;
+int peek() {
+    // Returns the kind (TK_*) of the current token.
+    // Refills the token window when the parser has caught up.
+    if (parser_pos == n_tokens) {
+        lex_fill(TOKEN_WINDOW / 2);
     }
-    return 0;
+    return tok_kind(parser_pos);
 }
 
-char* op_to_c_op(char* tok_type) {
-    // Translates a token type (e.g., "PLUS") to its C operator (e.g., "+").
-    if (strcmp(tok_type, "PLUS") == 0) {
-        return "+";
-    }
-    if (strcmp(tok_type, "MINUS") == 0) {
-        return "-";
+int next() {
+    // Consumes the current token and returns its index.
+    if (parser_pos == n_tokens) {
+        lex_fill(TOKEN_WINDOW / 2);
     }
-    if (strcmp(tok_type, "MUL") == 0) {
-        return "*";
+    int current_pos = parser_pos;
+    parser_pos = parser_pos + 1;
+    return current_pos;
+}
+
+int expect(int kind) {
+    // Checks if the current token is of the expected 'kind'.
+    // If yes, consumes it and returns its index.
+    // If no, reports a syntax error and returns -1.
+    // Matching a ';', '{' or '}' ends panic mode.
+    // Skips comments and gets type
+    int tok_type = peek();
+    if (tok_type == kind) {
+        if (kind == TK_SEMICOL || kind == TK_LBRACE || kind == TK_RBRACE) {
+            panic_mode = 0;
+        }
+        // Consume and return index
+
+        return next();
+    }
+    // Handle error
+
+    int tok_line = tok_lineno(parser_pos);
+    diag_add("Error: Syntax Error on line ");
+    diag_add(itos(tok_line));
+    diag_add("\nExpected token: ");
+    diag_add(token_name(kind));
+    diag_add("\n... but got token: ");
+    diag_add(token_name(tok_type));
+    syntax_error();
+    return -1;
+    // Indicate error
+}
+
+int diag_add(char* s) {
+    // Appends 's' to the error message being built in diag_mem, after
+    // the kept diagnostics. report_error(), add_error() or
+    // syntax_error() then reports it. Messages are built piece by piece
+    // instead of with '+', whose copies compile() would leak per error.
+    // Nothing may lex between the first piece and the report: a lexer
+    // error would be built into the same place.
+    int len = strlen(s);
+    if (diag_len + msg_len + len + 2 > diag_cap) {
+        diag_cap = (diag_len + msg_len + len + 2) * 2;
+        diag_mem = grow_chars(diag_mem, diag_cap);
+    }
+    copy_chars(diag_mem + diag_len + msg_len, s, len);
+    msg_len = msg_len + len;
+    diag_mem[diag_len + msg_len] = '\0';
+    return 0;
+}
+
+int diag_drop() {
+    // Discards the diag_add() message, for an error that is not reported.
+    msg_len = 0;
+    diag_mem[diag_len] = '\0';
+    return 0;
+}
+
+int report_error() {
+    // Prints (or collects) the diag_add() message and counts it, unless
+    // the parser is in panic mode or MAX_ERRORS were already reported.
+    // Returns -1.
+    if (panic_mode == 1) {
+        diag_drop();
+        return -1;
+    }
+    return add_error();
+}
+
+int add_error() {
+    // report_error() regardless of panic mode, for the lexer: it runs
+    // ahead of the parser, so the parser's state says nothing about it.
+    if (n_errors >= MAX_ERRORS) {
+        diag_drop();
+        return -1;
+    }
+    n_errors = n_errors + 1;
+    if (n_errors == MAX_ERRORS) {
+        diag_add("\nError: Too many errors, stopping.");
+    }
+    if (print_errors == 1) {
+        printf("%s\n", diag_mem + diag_len);
+        diag_drop();
+        return -1;
+    }
+    // Kept in place, so many compiles with errors do not pile up copies
+
+    diag_mem[diag_len + msg_len] = '\n';
+    diag_mem[diag_len + msg_len + 1] = '\0';
+    diag_len = diag_len + msg_len + 1;
+    msg_len = 0;
+    diagnostics = diag_mem;
+    return -1;
+}
+
+int syntax_error() {
+    // Reports the diag_add() message as a syntax error and enters panic
+    // mode. Returns -1.
+    // A lexer error ends the tokens early; errors at that EOF only
+    // follow from it and are not reported. The caller already peeked
+    // at the current token, so this peek() does not lex.
+    if (lex_failed == 0 || peek() != TK_EOF) {
+        report_error();
+    } else {
+        diag_drop();
+    }
+    panic_mode = 1;
+    return -1;
+}
+
+int synchronize(int is_global) {
+    // Leaves panic mode after a bad statement by skipping to where
+    // the next statement likely starts: past a ';', or before a '}'
+    // or a keyword that starts a statement. It also stops before an
+    // 'fn', where block() ends, so a missing '}' does not swallow the
+    // next function. Between globals, skips to the next 'fn' or 'let'.
+    int tok = peek();
+    if (is_global == 1) {
+        while (tok != TK_FN && tok != TK_LET && tok != TK_EOF) {
+            next();
+            tok = peek();
+        }
+        panic_mode = 0;
+        return 0;
+    }
+    // The bad statement may have ended already
+
+    if (parser_pos > 0) {
+        int prev = tok_kind(parser_pos - 1);
+        if (prev == TK_SEMICOL || prev == TK_RBRACE) {
+            panic_mode = 0;
+            return 0;
+        }
+    }
+    while (tok != TK_SEMICOL && tok != TK_RBRACE && tok != TK_EOF && tok != TK_FN && tok != TK_LET && tok != TK_PRINT && tok != TK_IF && tok != TK_WHILE && tok != TK_RETURN) {
+        next();
+        tok = peek();
+    }
+    if (tok == TK_SEMICOL) {
+        next();
+    }
+    panic_mode = 0;
+    return 0;
+}
+
+char* token_name(int kind) {
+    // Translates a token kind (e.g., TK_LPAREN) back to its name
+    // (e.g., "LPAREN"). Only used for error messages.
+    if (kind == TK_EOF) {
+        return "EOF";
+    }
+    if (kind == TK_ID) {
+        return "ID";
+    }
+    if (kind == TK_NUMBER) {
+        return "NUMBER";
+    }
+    if (kind == TK_STRING) {
+        return "STRING";
+    }
+    if (kind == TK_CHAR) {
+        return "CHAR";
+    }
+    if (kind == TK_TYPE) {
+        return "TYPE";
+    }
+    if (kind == TK_FN) {
+        return "FN";
+    }
+    if (kind == TK_LET) {
+        return "LET";
+    }
+    if (kind == TK_PRINT) {
+        return "PRINT";
+    }
+    if (kind == TK_IF) {
+        return "IF";
+    }
+    if (kind == TK_ELSE) {
+        return "ELSE";
+    }
+    if (kind == TK_WHILE) {
+        return "WHILE";
+    }
+    if (kind == TK_RETURN) {
+        return "RETURN";
+    }
+    if (kind == TK_ASSIGN) {
+        return "ASSIGN";
+    }
+    if (kind == TK_EQ) {
+        return "EQ";
+    }
+    if (kind == TK_NE) {
+        return "NE";
+    }
+    if (kind == TK_LT) {
+        return "LT";
+    }
+    if (kind == TK_GT) {
+        return "GT";
+    }
+    if (kind == TK_LE) {
+        return "LE";
+    }
+    if (kind == TK_GE) {
+        return "GE";
+    }
+    if (kind == TK_AND) {
+        return "AND";
+    }
+    if (kind == TK_OR) {
+        return "OR";
+    }
+    if (kind == TK_PLUS) {
+        return "PLUS";
+    }
+    if (kind == TK_MINUS) {
+        return "MINUS";
+    }
+    if (kind == TK_MUL) {
+        return "MUL";
+    }
+    if (kind == TK_DIV) {
+        return "DIV";
+    }
+    if (kind == TK_LPAREN) {
+        return "LPAREN";
+    }
+    if (kind == TK_RPAREN) {
+        return "RPAREN";
+    }
+    if (kind == TK_LBRACE) {
+        return "LBRACE";
+    }
+    if (kind == TK_RBRACE) {
+        return "RBRACE";
+    }
+    if (kind == TK_LSQUARE) {
+        return "LSQUARE";
+    }
+    if (kind == TK_RSQUARE) {
+        return "RSQUARE";
+    }
+    if (kind == TK_SEMICOL) {
+        return "SEMICOL";
+    }
+    if (kind == TK_COMMA) {
+        return "COMMA";
+    }
+    // Should never happen, but good to have a default.
+
+    return "UNKNOWN";
+}
+
+int tok_rec(int idx) {
+    // Returns the offset in token_recs of the record of token 'idx'.
+    // Counted back from next_rec, which avoids a division.
+    if (idx < 0) {
+        return TOKEN_WINDOW * TOKEN_REC;
+    }
+    int rec = next_rec - (n_tokens - idx) * TOKEN_REC;
+    if (rec < 0) {
+        rec = rec + TOKEN_WINDOW * TOKEN_REC;
+    }
+    return rec;
+}
+
+int tok_kind(int idx) {
+    // Returns the kind (TK_*) of token 'idx'.
+    int packed = token_recs[tok_rec(idx)];
+    return packed - (packed / 256) * 256;
+}
+
+int tok_start(int idx) {
+    // Returns the offset of the text of token 'idx' in source_buf.
+    return token_recs[tok_rec(idx) + 1];
+}
+
+int tok_len(int idx) {
+    // Returns the length of the text of token 'idx'.
+    return token_recs[tok_rec(idx)] / 256;
+}
+
+int tok_lineno(int idx) {
+    // Returns the source line of token 'idx'.
+    return line_of(tok_start(idx));
+}
+
+int line_of(int pos) {
+    // Returns the line number of offset 'pos' in source_buf.
+    // Builds the line table on the first call, then binary searches
+    // for the last line starting at or before 'pos'.
+    if (n_lines == 0) {
+        int p = 0;
+        while (p >= 0) {
+            if (n_lines == line_cap) {
+                line_cap = line_cap * 2 + 1024;
+                line_starts = grow_ints(line_starts, line_cap);
+            }
+            line_starts[n_lines] = p;
+            n_lines = n_lines + 1;
+            p = scan_line_end(source_buf, p);
+            if (source_buf[p] == '\0') {
+                p = -1;
+            } else {
+                p = p + 1;
+            }
+        }
+    }
+    int lo = 0;
+    int hi = n_lines - 1;
+    int mid;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (line_starts[mid] <= pos) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo + 1;
+}
+
+int tok_sym(int idx) {
+    // Returns the identifier id of token 'idx', see intern().
+    return intern(source_buf + tok_start(idx), tok_len(idx));
+}
+
+int type_of_tok(int idx) {
+    // Returns the type of TYPE token 'idx', see Types.
+    // Pointer types written without spaces ("char*") are one token,
+    // each char past the base name is a '*'.
+    char c = source_buf[tok_start(idx)];
+    int len = tok_len(idx);
+    if (c == 'i') {
+        return TY_INT + (len - 3) * TYPE_PTR;
+    }
+    if (c == 'c') {
+        return TY_CHAR + (len - 4) * TYPE_PTR;
+    }
+    return TY_VOID;
+}
+
+// =============================================================
+// Type Helpers
+// =============================================================
+int pointer_to(int type) {
+    // Returns the type of a pointer to 'type'.
+    return type + TYPE_PTR;
+}
+
+int deref(int type) {
+    // Returns the type 'type' points to. 'type' must be a pointer.
+    return type - TYPE_PTR;
+}
+
+int is_pointer(int type) {
+    // Returns 1 if 'type' is a pointer type, else 0.
+    return type >= TYPE_PTR;
+}
+
+char* type_name(int type) {
+    // Returns the C spelling of 'type', e.g. "char**". Names are built
+    // in order of type up to 'type', each from the one with one '*'
+    // less, and kept for later calls.
+    while (n_type_names <= type) {
+        if (n_type_names == type_name_cap) {
+            type_name_cap = type_name_cap * 2 + 16;
+            type_names = grow_strs(type_names, type_name_cap);
+        }
+        if (n_type_names == TY_NONE) {
+            type_names[n_type_names] = "undefined";
+        } else if (n_type_names == TY_VOID) {
+                 type_names[n_type_names] = "void";
+             } else if (n_type_names == TY_INT) {
+                 type_names[n_type_names] = "int";
+             } else if (n_type_names == TY_CHAR) {
+                 type_names[n_type_names] = "char";
+             } else {
+                 type_names[n_type_names] = concat(type_names[deref(n_type_names)], "*");
+             }
+        n_type_names = n_type_names + 1;
+    }
+    return type_names[type];
+}
+
+// =============================================================
+// Symbol Table Helpers
+// =============================================================
+int clear_local_symbols() {
+    // Clears the local (function-level) symbol table.
+    // Called when entering a new function.
+    n_locals = 0;
+    n_scopes = 0;
+    local_gen = local_gen + 1;
+    return 0;
+}
+
+int enter_scope() {
+    // Opens a block scope, see leave_scope().
+    if (n_scopes == scope_cap) {
+        scope_cap = scope_cap * 2 + 16;
+        scope_marks = grow_ints(scope_marks, scope_cap);
+    }
+    scope_marks[n_scopes] = n_locals;
+    n_scopes = n_scopes + 1;
+    return 0;
+}
+
+int leave_scope() {
+    // Closes the innermost block scope: drops the locals declared
+    // in it, in O(1) plus their number.
+    n_scopes = n_scopes - 1;
+    while (n_locals > scope_marks[n_scopes]) {
+        n_locals = n_locals - 1;
+        local_stamps[local_slot_of[n_locals]] = 0;
+    }
+    return 0;
+}
+
+int clear_global_symbols() {
+    // Clears the global symbol table, for compiling another file.
+    n_globals = 0;
+    global_gen = global_gen + 1;
+    return 0;
+}
+
+int get_symbol_type(int is_global, int sym) {
+    // Searches for the variable with id 'sym' (see tok_sym()) in the given 'scope'.
+    // Returns its type (see Types) if found.
+    // Returns TY_NONE if not found.
+    int i;
+    if (is_global == 0) {
+        i = find_symbol(0, sym);
+        if (i >= 0) {
+            return local_types[i];
+        }
+    }
+    // Not found, check outer scope (if local)
+
+    i = find_symbol(1, sym);
+    if (i >= 0) {
+        return global_types[i];
+    }
+    return TY_NONE;
+    // Not found anywhere
+}
+
+int find_symbol(int is_global, int sym) {
+    // Returns the index of the symbol with id 'sym' in the given
+    // scope, or -1. If a name was added twice, finds the first one.
+    int slot;
+    int i;
+    if (is_global == 0) {
+        if (local_slot_cap == 0) {
+            return -1;
+        }
+        slot = sym - (sym / local_slot_cap) * local_slot_cap;
+        while (local_stamps[slot] == local_gen) {
+            i = local_slots[slot];
+            if (local_syms[i] == sym) {
+                return i;
+            }
+            slot = slot + 1;
+            if (slot == local_slot_cap) {
+                slot = 0;
+            }
+        }
+    } else {
+        if (global_slot_cap == 0) {
+            return -1;
+        }
+        slot = sym - (sym / global_slot_cap) * global_slot_cap;
+        while (global_stamps[slot] == global_gen) {
+            i = global_slots[slot];
+            if (global_syms[i] == sym) {
+                return i;
+            }
+            slot = slot + 1;
+            if (slot == global_slot_cap) {
+                slot = 0;
+            }
+        }
+    }
+    return -1;
+}
+
+int add_symbol(int is_global, int sym, int type) {
+    // Adds a new variable, with id 'sym', to the symbol table.
+    // Returns 0 on success.
+    // NOTE: This function assumes you have already checked for redefinition.
+    if (is_global == 0) {
+        if (n_locals == local_cap) {
+            local_cap = local_cap * 2 + 64;
+            local_syms = grow_ints(local_syms, local_cap);
+            local_types = grow_ints(local_types, local_cap);
+            local_slot_of = grow_ints(local_slot_of, local_cap);
+        }
+        local_syms[n_locals] = sym;
+        local_types[n_locals] = type;
+        n_locals = n_locals + 1;
+        if (n_locals * 2 > local_slot_cap) {
+            rehash_symbols(0);
+        } else {
+            insert_slot(0, n_locals - 1);
+        }
+    } else {
+        if (n_globals == global_cap) {
+            global_cap = global_cap * 2 + 64;
+            global_syms = grow_ints(global_syms, global_cap);
+            global_types = grow_ints(global_types, global_cap);
+        }
+        global_syms[n_globals] = sym;
+        global_types[n_globals] = type;
+        n_globals = n_globals + 1;
+        if (n_globals * 2 > global_slot_cap) {
+            rehash_symbols(1);
+        } else {
+            insert_slot(1, n_globals - 1);
+        }
+    }
+    return 0;
+}
+
+int insert_slot(int is_global, int i) {
+    // Puts symbol 'i' of the given scope into the first free slot
+    // from its hash on.
+    int slot;
+    if (is_global == 0) {
+        slot = local_syms[i] - (local_syms[i] / local_slot_cap) * local_slot_cap;
+        while (local_stamps[slot] == local_gen) {
+            slot = slot + 1;
+            if (slot == local_slot_cap) {
+                slot = 0;
+            }
+        }
+        local_slots[slot] = i;
+        local_stamps[slot] = local_gen;
+        local_slot_of[i] = slot;
+    } else {
+        slot = global_syms[i] - (global_syms[i] / global_slot_cap) * global_slot_cap;
+        while (global_stamps[slot] == global_gen) {
+            slot = slot + 1;
+            if (slot == global_slot_cap) {
+                slot = 0;
+            }
+        }
+        global_slots[slot] = i;
+        global_stamps[slot] = global_gen;
+    }
+    return 0;
+}
+
+int rehash_symbols(int is_global) {
+    // Doubles the hash table of the given scope and inserts its
+    // symbols again, in order, so find_symbol() still finds the
+    // first of two equal names.
+    int i = 0;
+    int n;
+    if (is_global == 0) {
+        local_slot_cap = local_slot_cap * 2 + 64;
+        local_slots = grow_ints(local_slots, local_slot_cap);
+        local_stamps = grow_ints(local_stamps, local_slot_cap);
+        while (i < local_slot_cap) {
+            local_stamps[i] = 0;
+            i = i + 1;
+        }
+        n = n_locals;
+    } else {
+        global_slot_cap = global_slot_cap * 2 + 64;
+        global_slots = grow_ints(global_slots, global_slot_cap);
+        global_stamps = grow_ints(global_stamps, global_slot_cap);
+        while (i < global_slot_cap) {
+            global_stamps[i] = 0;
+            i = i + 1;
+        }
+        n = n_globals;
+    }
+    i = 0;
+    while (i < n) {
+        insert_slot(is_global, i);
+        i = i + 1;
+    }
+    return 0;
+}
+
+int intern(char* s, int len) {
+    // Returns the id of the identifier made of the 'len' chars at 's',
+    // adding it to the identifier table if it is new.
+    int hash = name_hash(s, len);
+    int slot;
+    int id;
+    if (n_interned * 2 >= intern_slot_cap) {
+        rehash_names();
+    }
+    slot = hash - (hash / intern_slot_cap) * intern_slot_cap;
+    while (intern_slots[slot] >= 0) {
+        id = intern_slots[slot];
+        if (intern_hashes[id] == hash && name_equals(intern_names[id], s, len)) {
+            return id;
+        }
+        slot = slot + 1;
+        if (slot == intern_slot_cap) {
+            slot = 0;
+        }
+    }
+    // New name: 'slot' is free
+    if (n_interned == intern_cap) {
+        intern_cap = intern_cap * 2 + 256;
+        intern_names = grow_strs(intern_names, intern_cap);
+        intern_hashes = grow_ints(intern_hashes, intern_cap);
+        intern_name_caps = grow_ints(intern_name_caps, intern_cap);
+    }
+    id = n_interned;
+    if (id == n_name_bufs) {
+        intern_names[id] = substr(s, 0, len);
+        intern_name_caps[id] = len + 1;
+        n_name_bufs = n_name_bufs + 1;
+    } else {
+        // The buffer of this id in an earlier compile, see intern_reset()
+        if (intern_name_caps[id] < len + 1) {
+            intern_name_caps[id] = len + 1;
+            intern_names[id] = grow_chars(intern_names[id], len + 1);
+        }
+        char* name = intern_names[id];
+        copy_chars(name, s, len);
+        name[len] = '\0';
+    }
+    intern_hashes[id] = hash;
+    intern_slots[slot] = id;
+    n_interned = n_interned + 1;
+    return id;
+}
+
+int intern_str(char* s) {
+    // intern() for a NUL-terminated string.
+    return intern(s, strlen(s));
+}
+
+int intern_reset() {
+    // Empties the identifier table for the next compile. The name
+    // buffers are kept: intern() refills them in id order.
+    int i = 0;
+    while (i < intern_slot_cap) {
+        intern_slots[i] = -1;
+        i = i + 1;
+    }
+    n_interned = 0;
+    return 0;
+}
+
+char* sym_name(int sym) {
+    // Returns the name of identifier id 'sym'. Equal names share it.
+    return intern_names[sym];
+}
+
+int name_equals(char* name, char* s, int len) {
+    // Compares the string 'name' with the 'len' chars at 's', which
+    // need not be NUL-terminated (like a token inside source_buf).
+    // Returns 1 (true) or 0 (false).
+    int i = 0;
+    while (i < len) {
+        if (name[i] != s[i]) {
+            return 0;
+        }
+        i = i + 1;
+    }
+    if (name[len] != '\0') {
+        return 0;
+    }
+    return 1;
+}
+
+int name_hash(char* s, int len) {
+    // Hashes the 'len' chars at 's' to an int in [0, 1000003).
+    int h = len;
+    int i = 0;
+    while (i < len) {
+        h = h * 31 + ctoi(s[i]);
+        h = h - (h / 1000003) * 1000003;
+        i = i + 1;
+    }
+    return h;
+}
+
+int rehash_names() {
+    // Doubles the hash table of the identifier table and inserts
+    // every id again.
+    int i = 0;
+    int slot;
+    intern_slot_cap = intern_slot_cap * 2 + 512;
+    intern_slots = grow_ints(intern_slots, intern_slot_cap);
+    while (i < intern_slot_cap) {
+        intern_slots[i] = -1;
+        i = i + 1;
+    }
+    i = 0;
+    while (i < n_interned) {
+        slot = intern_hashes[i] - (intern_hashes[i] / intern_slot_cap) * intern_slot_cap;
+        while (intern_slots[slot] >= 0) {
+            slot = slot + 1;
+            if (slot == intern_slot_cap) {
+                slot = 0;
+            }
+        }
+        intern_slots[slot] = i;
+        i = i + 1;
+    }
+    return 0;
+}
+
+// =============================================================
+// Parser Utils
+// =============================================================
+char* op_to_c_op(int tok_type) {
+    // Translates a token kind (e.g., TK_PLUS) to its C operator (e.g., "+").
+    if (tok_type == TK_PLUS) {
+        return "+";
+    }
+    if (tok_type == TK_MINUS) {
+        return "-";
     }
-    if (strcmp(tok_type, "DIV") == 0) {
+    if (tok_type == TK_MUL) {
+        return "*";
+    }
+    if (tok_type == TK_DIV) {
         return "/";
     }
-    if (strcmp(tok_type, "EQ") == 0) {
+    if (tok_type == TK_EQ) {
         return "==";
     }
-    if (strcmp(tok_type, "NE") == 0) {
+    if (tok_type == TK_NE) {
         return "!=";
     }
-    if (strcmp(tok_type, "LT") == 0) {
+    if (tok_type == TK_LT) {
         return "<";
     }
-    if (strcmp(tok_type, "GT") == 0) {
+    if (tok_type == TK_GT) {
         return ">";
     }
-    if (strcmp(tok_type, "LE") == 0) {
+    if (tok_type == TK_LE) {
         return "<=";
     }
-    if (strcmp(tok_type, "GE") == 0) {
+    if (tok_type == TK_GE) {
         return ">=";
     }
-    if (strcmp(tok_type, "AND") == 0) {
+    if (tok_type == TK_AND) {
         return "&&";
     }
-    if (strcmp(tok_type, "OR") == 0) {
+    if (tok_type == TK_OR) {
         return "||";
     }
     // Should never happen, but good to have a default.
@@ -1128,86 +2513,127 @@ char* op_to_c_op(char* tok_type) {
 }
 
 int emit(char* s) {
-    // Appends a string 's' to the global c_code_buffer.
+    // Appends a string 's' to the output, see C Code Output.
+    // Most are a few chars long, so they are copied here directly,
+    // without first taking their length.
     int i = 0;
-    int len = strlen(s);
-    // --- Bounds check ---
-    if (c_code_pos + len >= 1000000) {
-        printf("%s\n", "CRITICAL ERROR: C code output buffer overflow! Increase c_code_buffer size.");
-        return -1;
-        // This will likely cascade errors, but it prints the warning.
-    }
-    while (i < len) {
-        c_code_buffer[c_code_pos] = s[i];
-        c_code_pos = c_code_pos + 1;
+    while (s[i] != '\0') {
+        if (out_pos == OUT_BLOCK) {
+            flush_output();
+        }
+        out_block[out_pos] = s[i];
+        out_pos = out_pos + 1;
         i = i + 1;
     }
-    c_code_buffer[c_code_pos] = '\0';
-    // Keep buffer null-terminated
     return 0;
 }
 
-char* peek_code(char* level) {
-    int start_pos = c_code_pos;
-    if (strcmp(level, "expr") == 0) {
-        expr();
-    } else if (strcmp(level, "logical") == 0) {
-             logical();
-         } else if (strcmp(level, "relational") == 0) {
-             relational();
-         } else if (strcmp(level, "additive") == 0) {
-             additive();
-         } else if (strcmp(level, "multiplicative") == 0) {
-             multiplicative();
-         } else if (strcmp(level, "unary") == 0) {
-             unary();
-         } else if (strcmp(level, "atom") == 0) {
-             atom();
-         } else {
-             printf("%s\n", concat("Error: Unknown peek level: ", level));
-             return "";
-         }
-    int end_pos = c_code_pos;
-    int len = end_pos - start_pos;
-    if (len >= 4096) {
-        printf("%s\n", "Error: Expression too complex to peek (max 4096 chars).");
-        return "";
+int emit_span(int start, int len) {
+    // Appends 'len' chars of source_buf from 'start' to the output.
+    return emit_chars(source_buf + start, len);
+}
+
+int emit_chars(char* s, int len) {
+    // Appends 'len' chars from 's' to the output, copying as much
+    // as fits in out_block at a time.
+    if (out_pos + len <= OUT_BLOCK) {
+        copy_chars(out_block + out_pos, s, len);
+        out_pos = out_pos + len;
+        return 0;
     }
-    int i = 0;
-    while (i < len) {
-        expr_peek_buffer[i] = c_code_buffer[start_pos + i];
-        i = i + 1;
+    int n;
+    while (len > 0) {
+        if (out_pos == OUT_BLOCK) {
+            flush_output();
+        }
+        n = OUT_BLOCK - out_pos;
+        if (n > len) {
+            n = len;
+        }
+        copy_chars(out_block + out_pos, s, n);
+        out_pos = out_pos + n;
+        s = s + n;
+        len = len - n;
     }
-    expr_peek_buffer[i] = '\0';
-    // Rewind
-    c_code_pos = start_pos;
-    return expr_peek_buffer;
+    return 0;
+}
+
+int flush_output() {
+    // Writes the chars in out_block to out_fd, or appends them to
+    // out_mem if there is no output file, and empties it.
+    if (out_pos > 0 && out_fd < 0) {
+        if (out_mem_len + out_pos >= out_mem_cap) {
+            out_mem_cap = (out_mem_len + out_pos) * 2 + 1;
+            out_mem = grow_chars(out_mem, out_mem_cap);
+        }
+        copy_chars(out_mem + out_mem_len, out_block, out_pos);
+        out_mem_len = out_mem_len + out_pos;
+        out_mem[out_mem_len] = '\0';
+    } else if (out_pos > 0) {
+               if (write_chars(out_fd, out_block, out_pos) != out_pos) {
+            out_failed = 1;
+        }
+           }
+    out_pos = 0;
+    return 0;
 }
 
 int c_include() {
     // Emit C include
     emit("#include <stdio.h>\n");
     emit("#include <stdlib.h>\n");
-    emit("#include <string.h>\n\n");
+    emit("#include <string.h>\n");
+    emit("#include <fcntl.h>\n");
+    emit("#include <signal.h>\n");
+    emit("#include <sys/mman.h>\n");
+    emit("#include <sys/stat.h>\n");
+    emit("#include <sys/wait.h>\n");
+    emit("#include <unistd.h>\n\n");
     return 0;
 }
 
 int c_prototype() {
     // Emit C prototype
     emit("char* concat(char* str1, char* str2);\n");
+    emit("static inline int str_is(char* s, char* lit);\n");
     emit("char* itos(int x);\n");
-    emit("char* ctos(char c);\n\n");
+    emit("char* ctos(char c);\n");
+    emit("int ctoi(char c);\n");
+    emit("char* substr(char* s, int start, int len);\n");
+    emit("char** grow_strs(char** a, int cap);\n");
+    emit("char* grow_chars(char* a, int cap);\n");
+    emit("int* grow_ints(int* a, int cap);\n");
+    emit("int skip_spaces(char* s, int pos);\n");
+    emit("int scan_ident(char* s, int pos);\n");
+    emit("int scan_line_end(char* s, int pos);\n");
+    emit("int scan_string_end(char* s, int pos);\n\n");
     emit("char* read_file(char* path);\n");
     emit("void write_file(char* path, char* content);\n");
+    emit("int open_output(char* path);\n");
+    emit("int write_chars(int fd, char* buf, int len);\n");
+    emit("void copy_chars(char* dst, char* src, int len);\n");
+    emit("int open_cc(char* cmd);\n");
+    emit("int close_cc();\n");
+    emit("int* shared_ints(int n);\n");
+    emit("void free_shared(int* p, int n);\n");
+    emit("int fork_worker();\n");
+    emit("int wait_workers();\n");
+    emit("void exit_worker();\n");
     return 0;
 }
 
 int c_helper() {
     // Emit C helper
     emit("\nchar* concat(char* str1, char* str2) {\n");
-    emit("static char buf[1024];\n");
-    emit("snprintf(buf, sizeof(buf), \"%s%s\", str1, str2);\n");
+    emit("size_t len1 = strlen(str1);\n");
+    emit("char* buf = malloc(len1 + strlen(str2) + 1);\n");
+    emit("memcpy(buf, str1, len1);\n");
+    emit("strcpy(buf + len1, str2);\n");
     emit("return buf;\n}\n\n");
+    // s == "literal": most mismatches differ in the first char, which
+    // is a constant here, and strcmp() is skipped
+    emit("static inline int str_is(char* s, char* lit) {\n");
+    emit("return s[0] == lit[0] && (lit[0] == '\\0' || strcmp(s + 1, lit + 1) == 0);\n}\n\n");
     emit("char* itos(int x) {\n");
     emit("static char buf[32];\n");
     emit("snprintf(buf, sizeof(buf), \"%d\", x);\n");
@@ -1217,347 +2643,662 @@ int c_helper() {
     emit("buf[0] = c;\n");
     emit("buf[1] = '\\0';\n");
     emit("return buf;\n}\n\n");
-    emit("char* read_file(char* path) {\n");
-    emit("FILE* f = fopen(path, \"rb\");\n");
-    emit("if (!f) return NULL;\n");
-    emit("fseek(f, 0, SEEK_END);\n");
-    emit("long len = ftell(f);\n");
-    emit("fseek(f, 0, SEEK_SET);\n");
+    emit("int ctoi(char c) {\n");
+    emit("return (unsigned char)c;\n}\n\n");
+    emit("char* substr(char* s, int start, int len) {\n");
     emit("char* buf = malloc(len + 1);\n");
-    emit("fread(buf, 1, len, f);\n");
+    emit("memcpy(buf, s + start, len);\n");
+    emit("buf[len] = '\\0';\n");
+    emit("return buf;\n}\n\n");
+    emit("char** grow_strs(char** a, int cap) {\n");
+    emit("return realloc(a, cap * sizeof(char*));\n}\n\n");
+    emit("char* grow_chars(char* a, int cap) {\n");
+    emit("return realloc(a, cap);\n}\n\n");
+    emit("int* grow_ints(int* a, int cap) {\n");
+    emit("return realloc(a, cap * sizeof(int));\n}\n\n");
+    // Lexer scan kernels: SSE2/AVX2 with a scalar fallback,
+    // picked once at startup by scan_init().
+    emit("#if defined(__x86_64__)\n");
+    emit("#include <immintrin.h>\n");
+    emit("#endif\n\n");
+    emit("static int scan_level = 0; // 0: scalar, 1: SSE2, 2: AVX2\n\n");
+    emit("static inline int scan_stop(char c, int cls) {\n");
+    emit("if (cls == 0) return c != ' ' && c != '\\t' && c != '\\n';\n");
+    emit("if (cls == 1) return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_');\n");
+    emit("if (cls == 2) return c == '\\n' || c == '\\0';\n");
+    emit("return c == '\"' || c == '\\\\' || c == '\\0';\n");
+    emit("}\n\n");
+    emit("#if defined(__x86_64__)\n");
+    emit("static inline __attribute__((always_inline)) unsigned scan_mask_sse2(__m128i v, int cls) {\n");
+    emit("if (cls == 0) return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\t'))), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\n')))) & 0xFFFF;\n");
+    emit("if (cls == 1) {\n");
+    emit("__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), v));\n");
+    emit("__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));\n");
+    emit("__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));\n");
+    emit("__m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));\n");
+    emit("return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(lower, upper), _mm_or_si128(digit, under))) & 0xFFFF;\n");
+    emit("}\n");
+    emit("__m128i stop = _mm_cmpeq_epi8(v, _mm_setzero_si128());\n");
+    emit("if (cls == 2) return _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\n'))));\n");
+    emit("stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\"')));\n");
+    emit("return _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\\\'))));\n");
+    emit("}\n\n");
+    emit("static inline __attribute__((always_inline)) int scan_sse2(char* s, int pos, int cls) {\n");
+    emit("char* p = s + pos;\n");
+    emit("char* a = (char*)((size_t)p & ~(size_t)15);\n");
+    emit("unsigned mask = scan_mask_sse2(_mm_load_si128((__m128i*)a), cls) & (0xFFFFu << (p - a));\n");
+    emit("while (mask == 0) {\n");
+    emit("a = a + 16;\n");
+    emit("mask = scan_mask_sse2(_mm_load_si128((__m128i*)a), cls);\n");
+    emit("}\n");
+    emit("return (int)(a - s) + __builtin_ctz(mask);\n");
+    emit("}\n\n");
+    emit("__attribute__((target(\"avx2\"), always_inline))\n");
+    emit("static inline unsigned scan_mask_avx2(__m256i v, int cls) {\n");
+    emit("if (cls == 0) return ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\t'))), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\n'))));\n");
+    emit("if (cls == 1) {\n");
+    emit("__m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));\n");
+    emit("__m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));\n");
+    emit("__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));\n");
+    emit("__m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));\n");
+    emit("return ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(lower, upper), _mm256_or_si256(digit, under)));\n");
+    emit("}\n");
+    emit("__m256i stop = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());\n");
+    emit("if (cls == 2) return _mm256_movemask_epi8(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\n'))));\n");
+    emit("stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"')));\n");
+    emit("return _mm256_movemask_epi8(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\\\'))));\n");
+    emit("}\n\n");
+    emit("__attribute__((target(\"avx2\")))\n");
+    emit("static int scan_avx2(char* s, int pos, int cls) {\n");
+    emit("char* p = s + pos;\n");
+    emit("char* a = (char*)((size_t)p & ~(size_t)31);\n");
+    emit("unsigned mask = scan_mask_avx2(_mm256_load_si256((__m256i*)a), cls) & (0xFFFFFFFFu << (p - a));\n");
+    emit("while (mask == 0) {\n");
+    emit("a = a + 32;\n");
+    emit("mask = scan_mask_avx2(_mm256_load_si256((__m256i*)a), cls);\n");
+    emit("}\n");
+    emit("return (int)(a - s) + __builtin_ctz(mask);\n");
+    emit("}\n\n");
+    emit("#endif\n\n");
+    emit("static inline __attribute__((always_inline)) int scan(char* s, int pos, int cls) {\n");
+    emit("// Short runs are the common case, check two bytes before going wide\n");
+    emit("if (scan_stop(s[pos], cls)) return pos;\n");
+    emit("if (scan_stop(s[pos + 1], cls)) return pos + 1;\n");
+    emit("#if defined(__x86_64__)\n");
+    emit("if (scan_level == 2) return scan_avx2(s, pos + 2, cls);\n");
+    emit("if (scan_level == 1) return scan_sse2(s, pos + 2, cls);\n");
+    emit("#endif\n");
+    emit("while (!scan_stop(s[pos], cls)) pos++;\n");
+    emit("return pos;\n");
+    emit("}\n\n");
+    emit("__attribute__((constructor))\n");
+    emit("static void scan_init(void) {\n");
+    emit("#if defined(__x86_64__)\n");
+    emit("scan_level = __builtin_cpu_supports(\"avx2\") ? 2 : 1;\n");
+    emit("#endif\n");
+    emit("if (getenv(\"DAV_SCALAR_LEX\")) scan_level = 0;\n");
+    emit("}\n\n");
+    emit("int skip_spaces(char* s, int pos) {\n");
+    emit("return scan(s, pos, 0);\n");
+    emit("}\n\n");
+    emit("int scan_ident(char* s, int pos) {\n");
+    emit("return scan(s, pos, 1);\n");
+    emit("}\n\n");
+    emit("int scan_line_end(char* s, int pos) {\n");
+    emit("return scan(s, pos, 2);\n");
+    emit("}\n\n");
+    emit("int scan_string_end(char* s, int pos) {\n");
+    emit("return scan(s, pos, 3);\n");
+    emit("}\n\n");
+    emit("char* read_file(char* path) {\n");
+    emit("int fd = strcmp(path, \"-\") == 0 ? 0 : open(path, O_RDONLY);\n");
+    emit("if (fd < 0) return NULL;\n");
+    emit("struct stat st;\n");
+    emit("if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {\n");
+    emit("size_t len = st.st_size;\n");
+    emit("size_t page = sysconf(_SC_PAGESIZE);\n");
+    emit("size_t span = (len / page + 1) * page;\n");
+    emit("char* buf = mmap(NULL, span, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);\n");
+    emit("if (buf != MAP_FAILED) {\n");
+    emit("if (mmap(buf, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {\n");
+    emit("madvise(buf, len, MADV_SEQUENTIAL);\n");
+    emit("close(fd);\n");
+    emit("return buf;\n");
+    emit("}\n");
+    emit("munmap(buf, span);\n");
+    emit("}\n");
+    emit("}\n");
+    emit("size_t cap = 65536;\n");
+    emit("size_t len = 0;\n");
+    emit("ssize_t n;\n");
+    emit("char* buf = malloc(cap + 1);\n");
+    emit("while ((n = read(fd, buf + len, cap - len)) > 0) {\n");
+    emit("len = len + n;\n");
+    emit("if (len == cap) {\n");
+    emit("cap = cap * 2;\n");
+    emit("buf = realloc(buf, cap + 1);\n");
+    emit("}\n");
+    emit("}\n");
     emit("buf[len] = '\\0';\n");
-    emit("fclose(f);\n");
+    emit("if (fd != 0) close(fd);\n");
     emit("return buf;\n}\n\n");
     emit("void write_file(char* path, char* content) {\n");
     emit("FILE* f = fopen(path, \"w\");\n");
     emit("if (!f) return;\n");
     emit("fprintf(f, \"%s\", content);\n");
-    emit("fclose(f);\n}\n");
+    emit("fclose(f);\n}\n\n");
+    emit("int open_output(char* path) {\n");
+    emit("if (strcmp(path, \"-\") == 0) return 1;\n");
+    emit("return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);\n}\n\n");
+    emit("int write_chars(int fd, char* buf, int len) {\n");
+    emit("int done = 0;\n");
+    emit("while (done < len) {\n");
+    emit("ssize_t n = write(fd, buf + done, len - done);\n");
+    emit("if (n <= 0) return -1;\n");
+    emit("done = done + n;\n");
+    emit("}\n");
+    emit("return done;\n}\n\n");
+    emit("void copy_chars(char* dst, char* src, int len) {\n");
+    emit("memcpy(dst, src, len);\n}\n\n");
+    // Pipe to a C compiler, for compiler --cc
+    emit("static FILE* cc_pipe = NULL;\n\n");
+    emit("int open_cc(char* cmd) {\n");
+    emit("signal(SIGPIPE, SIG_IGN);\n");
+    emit("fflush(stdout);\n");
+    emit("cc_pipe = popen(cmd, \"w\");\n");
+    emit("return cc_pipe ? fileno(cc_pipe) : -1;\n}\n\n");
+    emit("int close_cc() {\n");
+    emit("int status = pclose(cc_pipe);\n");
+    emit("return status >= 0 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;\n}\n\n");
+    // Process helpers for lex_parallel()
+    emit("int* shared_ints(int n) {\n");
+    emit("int* p = mmap(NULL, (size_t)n * sizeof(int) + 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);\n");
+    emit("return p == MAP_FAILED ? NULL : p;\n}\n\n");
+    emit("void free_shared(int* p, int n) {\n");
+    emit("munmap(p, (size_t)n * sizeof(int) + 1);\n}\n\n");
+    emit("int fork_worker() {\n");
+    emit("fflush(stdout);\n");
+    emit("return fork();\n}\n\n");
+    emit("int wait_workers() {\n");
+    emit("while (wait(NULL) > 0) {}\n");
+    emit("return 0;\n}\n\n");
+    emit("void exit_worker() {\n");
+    emit("_exit(0);\n}\n");
     return 0;
 }
 
 int preset_global_functions() {
     // Preset global scope with util functions
-    add_symbol(1, "concat", "char*");
-    add_symbol(1, "ctos", "char*");
-    add_symbol(1, "itos", "char*");
-    add_symbol(1, "strlen", "int");
-    add_symbol(1, "strcmp", "int");
-    add_symbol(1, "read_file", "char*");
-    add_symbol(1, "write_file", "void");
+    add_symbol(1, intern_str("concat"), TY_STR);
+    add_symbol(1, intern_str("ctos"), TY_STR);
+    add_symbol(1, intern_str("ctoi"), TY_INT);
+    add_symbol(1, intern_str("itos"), TY_STR);
+    add_symbol(1, intern_str("substr"), TY_STR);
+    add_symbol(1, intern_str("grow_strs"), pointer_to(TY_STR));
+    add_symbol(1, intern_str("grow_chars"), TY_STR);
+    add_symbol(1, intern_str("grow_ints"), pointer_to(TY_INT));
+    add_symbol(1, intern_str("skip_spaces"), TY_INT);
+    add_symbol(1, intern_str("scan_ident"), TY_INT);
+    add_symbol(1, intern_str("scan_line_end"), TY_INT);
+    add_symbol(1, intern_str("scan_string_end"), TY_INT);
+    add_symbol(1, intern_str("atoi"), TY_INT);
+    add_symbol(1, intern_str("strlen"), TY_INT);
+    add_symbol(1, intern_str("strcmp"), TY_INT);
+    add_symbol(1, intern_str("read_file"), TY_STR);
+    add_symbol(1, intern_str("write_file"), TY_VOID);
+    add_symbol(1, intern_str("open_output"), TY_INT);
+    add_symbol(1, intern_str("write_chars"), TY_INT);
+    add_symbol(1, intern_str("copy_chars"), TY_VOID);
+    add_symbol(1, intern_str("open_cc"), TY_INT);
+    add_symbol(1, intern_str("close_cc"), TY_INT);
+    add_symbol(1, intern_str("shared_ints"), pointer_to(TY_INT));
+    add_symbol(1, intern_str("free_shared"), TY_VOID);
+    add_symbol(1, intern_str("fork_worker"), TY_INT);
+    add_symbol(1, intern_str("wait_workers"), TY_INT);
+    add_symbol(1, intern_str("exit_worker"), TY_VOID);
     return 0;
 }
 
 // =============================================================
 // Tokenizer
 //
-// This is the main lexer logic, ported from python/lexer/lexer.py
+// This is the main lexer logic. Like python/lexer/lexer.py it runs
+// the token DFA generated from TOKEN_SPEC, see dfa_init().
 // =============================================================
-int tokenize(char* source_code) {
-    int pos = 0;
-    int line_num = 1;
-    int line_start = 0;
-    char buffer[100];
-    int i = 0;
-    int token_count = 0;
-    int pool_pos = 0;
-    char c;
-    int col;
-    int j;
-    char token_val;
-    int token_start_col;
-    while (source_code[pos] != '\0') {
-        c = source_code[pos];
-        col = pos - line_start;
-        i = 0;
-        // --- Bounds check ---
-        if (token_count >= 50000) {
-            printf("%s\n", "CRITICAL ERROR: Too many tokens! Increase token array sizes.");
-            return 0;
-        }
-        if (pool_pos >= 499000) {
-            // Leave some safety margin
-            printf("%s\n", "CRITICAL ERROR: String pool overflow! Increase token_pool size.");
-            return 0;
-        }
-        // --- 1. Skip Whitespace ---
+int lex_init(char* source_code) {
+    // Points the lexer at the start of 'source_code'.
+    // Tokens are produced later, on demand, by lex_fill().
+    if (dfa_next == 0) {
+        dfa_init();
+    }
+    source_buf = source_code;
+    lex_pos = 0;
+    lex_end = 2147483647;
+    n_lines = 0;
+    lex_failed = 0;
+    lex_quiet = 0;
+    n_pre = -1;
+    pre_pos = 0;
+    n_tokens = 0;
+    next_rec = 0;
+    parser_pos = 0;
+    return 0;
+}
 
-        if (is_space(c)) {
-            if (c == '\n') {
-                line_num = line_num + 1;
-                line_start = pos + 1;
-            }
-            pos = pos + 1;
-        }
-        // --- 2. Check for Numbers ---
-        else if (is_digit(c)) {
-                 token_start_col = col;
-                 while (is_digit(c)) {
-                buffer[i] = c;
-                i = i + 1;
-                pos = pos + 1;
-                c = source_code[pos];
+int lex_fill(int count) {
+    // Lexes up to 'count' more tokens into the token window and
+    // returns the kind of the last one. Stops early after TK_EOF.
+    // Once the input is exhausted (or a lexer error was reported)
+    // every further token is TK_EOF.
+    char* source_code = source_buf;
+    int pos = lex_pos;
+    int kind = -1;
+    int start;
+    int len;
+    char c;
+    int done = 0;
+    int* class_of = dfa_class;
+    int* next_state = dfa_next;
+    int* accept = dfa_accept;
+    int* accel_of = dfa_accel;
+    int* single = dfa_single;
+    int classes = DFA_CLASSES;
+    int state;
+    int last;
+    int to;
+    int accel;
+    int p;
+    if (n_pre >= 0) {
+        return fill_from_pre(count);
+    }
+    while (done < count) {
+        kind = -1;
+        start = pos;
+        while (kind == -1 && lex_failed == 0 && source_code[pos] != '\0' && pos < lex_end) {
+            c = source_code[pos];
+            start = pos;
+            // --- 1. Skip Whitespace ---
+            if (is_space(c)) {
+                pos = skip_spaces(source_code, pos);
             }
-                 if (c == '.') {
-                buffer[i] = c;
-                i = i + 1;
-                pos = pos + 1;
-                c = source_code[pos];
-                while (is_digit(c)) {
-                    buffer[i] = c;
-                    i = i + 1;
+            // --- 2. Shortcuts ---
+            // Runs of ident chars and digits are scanned directly, the DFA
+            // would step through them one char at a time. Type names still
+            // go through the DFA, which knows which of them continue with '*'.
+            // One-char tokens like '(' or ';' come from dfa_single.
+            else {
+                kind = single[ctoi(c)];
+                if (kind >= 0) {
                     pos = pos + 1;
-                    c = source_code[pos];
-                }
-            }
-                 buffer[i] = '\0';
-                 token_types[token_count] = "NUMBER";
-                 token_lines[token_count] = line_num;
-                 token_cols[token_count] = token_start_col;
-                 // Copy buffer to string pool
-                 token_values[token_count] = pool_pos;
-                 j = 0;
-                 // <= to include the '\0'
-                 while (j <= i) {
-                token_pool[pool_pos] = buffer[j];
-                pool_pos = pool_pos + 1;
-                j = j + 1;
-            }
-                 token_count = token_count + 1;
-             }
-             // --- 3. Check for Identifiers & Keywords ---
-             else if (is_letter(c)) {
-                 token_start_col = col;
-                 while (is_ident_char(c)) {
-                buffer[i] = c;
-                i = i + 1;
-                pos = pos + 1;
-                c = source_code[pos];
-            }
-                 buffer[i] = '\0';
-                 char* tok_type = check_keywords(buffer);
-                 token_types[token_count] = tok_type;
-                 token_lines[token_count] = line_num;
-                 token_cols[token_count] = token_start_col;
-                 // Copy buffer to string pool
-                 if (strcmp(tok_type, "ID") != 0 && strcmp(tok_type, "TYPE") != 0) {
-                token_values[token_count] = -1;
-            } else {
-                token_values[token_count] = pool_pos;
-                j = 0;
-                while (j <= i) {
-                    token_pool[pool_pos] = buffer[j];
-                    pool_pos = pool_pos + 1;
-                    j = j + 1;
+                } else if (is_letter(c)) {
+                           p = scan_ident(source_code, pos + 1);
+                           kind = check_keywords(source_code + start, p - start);
+                           if (kind == TK_TYPE) {
+                        kind = -1;
+                    } else {
+                        pos = p;
+                    }
+                       } else if (is_digit(c)) {
+                           while (is_digit(c)) {
+                        pos = pos + 1;
+                        c = source_code[pos];
+                    }
+                           if (c == '.') {
+                        pos = pos + 1;
+                        c = source_code[pos];
+                        while (is_digit(c)) {
+                            pos = pos + 1;
+                            c = source_code[pos];
+                        }
+                    }
+                           kind = TK_NUMBER;
+                       }
+                       // --- 3. Run the token DFA ---
+                       // Steps until the dead state; '\0' has no transition, so
+                       // this stops at the end of the input. The token is what the
+                       // state before the dead one accepts.
+
+                if (kind == -1) {
+                    state = 1;
+                    last = 0;
+                    p = start;
+                    while (state != 0) {
+                        to = next_state[state * classes + class_of[ctoi(source_code[p])]];
+                        if (to == state && accel_of[state] != 0) {
+                            // A run of chars this state loops on: skip it in one go
+                            accel = accel_of[state];
+                            if (accel == 1) {
+                                p = scan_ident(source_code, p);
+                            } else if (accel == 2) {
+                                       p = scan_line_end(source_code, p);
+                                   } else {
+                                       p = scan_string_end(source_code, p);
+                                   }
+                        } else {
+                            last = state;
+                            state = to;
+                            p = p + 1;
+                        }
+                    }
+                    kind = accept[last];
+                    pos = p - 1;
+                    if (kind < 0) {
+                        // Died inside an unfinished token (an unclosed string):
+                        // step again from 'start', keeping the longest match.
+                        // A char no token starts with is a mismatch.
+                        kind = TK_MISMATCH;
+                        pos = start + 1;
+                        state = 1;
+                        p = start;
+                        while (state != 0) {
+                            if (accept[state] >= 0) {
+                                kind = accept[state];
+                                pos = p;
+                            }
+                            state = next_state[state * classes + class_of[ctoi(source_code[p])]];
+                            p = p + 1;
+                        }
+                    }
+                    // --- 4. Classify the match ---
+
+                    if (kind == TK_ID) {
+                        kind = check_keywords(source_code + start, pos - start);
+                    } else if (kind == TK_COMMENT || kind == TK_SKIP || kind == TK_NEWLINE) {
+                               kind = -1;
+                           } else if (kind == TK_MISMATCH) {
+                               // Not a syntax error: the lexer runs ahead of the
+                               // parser, so this must not put it in panic mode
+                               if (lex_quiet == 0) {
+                            if (c == '"') {
+                                diag_add("Error: Unclosed string literal!");
+                                add_error();
+                            } else if (c == '\'') {
+                                       diag_add("Error: Unclosed or invalid char literal!");
+                                       add_error();
+                                   } else {
+                                       diag_add("Error: Unexpected character!");
+                                       diag_add(ctos(c));
+                                       add_error();
+                                   }
+                        }
+                               kind = -1;
+                               lex_failed = 1;
+                           }
                 }
             }
-                 token_count = token_count + 1;
-             }
-             // --- 4. Check for Multi-Char Tokens ---
-             else if (c == '=') {
-                 if (source_code[pos + 1] == '=') {
-                add_simple_token(token_count, "EQ", line_num, col);
-                token_count = token_count + 1;
-                pos = pos + 2;
-            } else {
-                add_simple_token(token_count, "ASSIGN", line_num, col);
-                token_count = token_count + 1;
-                pos = pos + 1;
-            }
-             } else if (c == '!' && source_code[pos + 1] == '=') {
-                 add_simple_token(token_count, "NE", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 2;
-             } else if (c == '>') {
-                 if (source_code[pos + 1] == '=') {
-                add_simple_token(token_count, "GE", line_num, col);
-                token_count = token_count + 1;
-                pos = pos + 2;
-            } else {
-                add_simple_token(token_count, "GT", line_num, col);
-                token_count = token_count + 1;
-                pos = pos + 1;
-            }
-             } else if (c == '<') {
-                 if (source_code[pos + 1] == '=') {
-                add_simple_token(token_count, "LE", line_num, col);
-                token_count = token_count + 1;
-                pos = pos + 2;
-            } else {
-                add_simple_token(token_count, "LT", line_num, col);
-                token_count = token_count + 1;
-                pos = pos + 1;
-            }
-             } else if (c == '&' && source_code[pos + 1] == '&') {
-                 add_simple_token(token_count, "AND", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 2;
-             } else if (c == '|' && source_code[pos + 1] == '|') {
-                 add_simple_token(token_count, "OR", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 2;
-             } else if (c == '/') {
-                 if (source_code[pos + 1] == '/') {
-                // TODO: Maybe add comments
-                // add_simple_token(token_count, "COMMENT", line_num, col);
-                // token_count = token_count + 1; pos = pos + 2;
-                // Loop to skip till after newline or EOL
-                while (source_code[pos] != '\n' && source_code[pos] != '\n') {
-                    pos = pos + 1;
-                }
-            } else {
-                add_simple_token(token_count, "DIV", line_num, col);
-                token_count = token_count + 1;
-                pos = pos + 1;
+        }
+        // --- 5. End of input ---
+        if (kind == -1) {
+            kind = TK_EOF;
+            start = pos;
+        }
+        // The span of strings and chars is the text between the quotes,
+        // escapes included, so it can be emitted back into C unchanged.
+
+        len = pos - start;
+        if (kind == TK_STRING || kind == TK_CHAR) {
+            start = start + 1;
+            len = len - 2;
+        }
+        add_simple_token(next_rec, kind, start, len);
+        n_tokens = n_tokens + 1;
+        next_rec = next_rec + TOKEN_REC;
+        if (next_rec == TOKEN_WINDOW * TOKEN_REC) {
+            next_rec = 0;
+        }
+        done = done + 1;
+        if (kind == TK_EOF) {
+            done = count;
+        }
+    }
+    lex_pos = pos;
+    return kind;
+}
+
+int fill_from_pre(int count) {
+    // lex_fill() for a file lexed by lex_parallel(): copies up to
+    // 'count' records from pre_recs into the token window and returns
+    // the kind of the last one, TK_EOF once pre_recs is used up.
+    int done = 0;
+    int kind = TK_EOF;
+    int packed;
+    while (done < count) {
+        if (pre_pos < n_pre) {
+            packed = pre_recs[pre_pos * TOKEN_REC];
+            token_recs[next_rec] = packed;
+            token_recs[next_rec + 1] = pre_recs[pre_pos * TOKEN_REC + 1];
+            pre_pos = pre_pos + 1;
+            kind = packed - (packed / 256) * 256;
+        } else {
+            add_simple_token(next_rec, TK_EOF, lex_pos, 0);
+            kind = TK_EOF;
+            done = count;
+        }
+        n_tokens = n_tokens + 1;
+        next_rec = next_rec + TOKEN_REC;
+        if (next_rec == TOKEN_WINDOW * TOKEN_REC) {
+            next_rec = 0;
+        }
+        done = done + 1;
+    }
+    return kind;
+}
+
+int lex_chunk(int from, int to, int base) {
+    // Lexes the tokens of source_buf that start in [from, to) into
+    // pre_recs, from record 'base' on, and returns how many there are.
+    // 'from' must not be inside a token. The last token may end past 'to'.
+    int count = 0;
+    int idx;
+    int rec;
+    int kind = -1;
+    lex_pos = from;
+    lex_end = to;
+    n_tokens = 0;
+    next_rec = 0;
+    while (kind != TK_EOF) {
+        idx = n_tokens;
+        kind = lex_fill(TOKEN_WINDOW);
+        while (idx < n_tokens) {
+            if (tok_kind(idx) != TK_EOF) {
+                rec = tok_rec(idx);
+                pre_recs[(base + count) * TOKEN_REC] = token_recs[rec];
+                pre_recs[(base + count) * TOKEN_REC + 1] = token_recs[rec + 1];
+                count = count + 1;
             }
-             }
-             // --- 5. Check for Single-Char Tokens ---
-             else if (c == '(') {
-                 add_simple_token(token_count, "LPAREN", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             } else if (c == ')') {
-                 add_simple_token(token_count, "RPAREN", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             } else if (c == '{') {
-                 add_simple_token(token_count, "LBRACE", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             } else if (c == '}') {
-                 add_simple_token(token_count, "RBRACE", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             } else if (c == '[') {
-                 add_simple_token(token_count, "LSQUARE", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             } else if (c == ']') {
-                 add_simple_token(token_count, "RSQUARE", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             } else if (c == '+') {
-                 add_simple_token(token_count, "PLUS", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             } else if (c == '-') {
-                 add_simple_token(token_count, "MINUS", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             } else if (c == '*') {
-                 add_simple_token(token_count, "MUL", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             } else if (c == ';') {
-                 add_simple_token(token_count, "SEMICOL", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             } else if (c == ',') {
-                 add_simple_token(token_count, "COMMA", line_num, col);
-                 token_count = token_count + 1;
-                 pos = pos + 1;
-             }
-             // --- 6. Handle Strings and Chars ---
-             else if (c == '"') {
-                 token_start_col = col;
-                 pos = pos + 1;
-                 c = source_code[pos];
-                 while (c != '"' && c != '\0') {
-                if (c == '\\') {
-                    buffer[i] = '\\';
-                    i = i + 1;
-                    pos = pos + 1;
-                    c = source_code[pos];
-                    if (c == 'n') {
-                        buffer[i] = 'n';
-                    } else if (c == 't') {
-                               buffer[i] = 't';
-                           } else if (c == '"') {
-                               buffer[i] = '"';
-                           } else if (c == '\\') {
-                               buffer[i] = '\\';
-                           } else {
-                               buffer[i] = c;
-                           }
-                } else {
-                    buffer[i] = c;
-                }
-                i = i + 1;
-                pos = pos + 1;
-                c = source_code[pos];
+            idx = idx + 1;
+        }
+    }
+    return count;
+}
+
+int lex_parallel(int jobs) {
+    // Lexes all of source_buf with 'jobs' worker processes, for very
+    // large inputs. Call right after lex_init(). Produces exactly the
+    // tokens of the serial lexer; returns -1 (and leaves the serial
+    // lexer in place) if the file has a lexer error or workers can't
+    // be set up.
+    //
+    // The file is cut into chunks at line starts. Each worker lexes
+    // the tokens starting in its chunk into its own part of pre_recs,
+    // which holds one record per source char plus one per chunk, so
+    // no chunk can run out of room. A comment always ends before the
+    // next line, but a string literal may contain newlines: if the
+    // last token of a chunk runs past the start of the next one, that
+    // chunk was lexed from the wrong state and is lexed again here,
+    // from the end of that token. Token offsets are absolute, so no
+    // other fixup is needed (lines come from line_of()).
+    int len = strlen(source_buf);
+    int need = jobs * 2 + (len + jobs) * TOKEN_REC;
+    int k = 1;
+    int p;
+    if (jobs < 2) {
+        return -1;
+    }
+    if (need > pre_mem_cap) {
+        if (pre_mem_cap > 0) {
+            free_shared(pre_mem, pre_mem_cap);
+        }
+        pre_mem_cap = 0;
+        pre_mem = shared_ints(need);
+        if (pre_mem == 0) {
+            return -1;
+        }
+        pre_mem_cap = need;
+    }
+    if (jobs + 1 > pre_bounds_cap) {
+        pre_bounds_cap = jobs + 1;
+        pre_bounds = grow_ints(pre_bounds, pre_bounds_cap);
+        if (pre_bounds == 0) {
+            pre_bounds_cap = 0;
+            return -1;
+        }
+    }
+    int* bounds = pre_bounds;
+    int* results = pre_mem;
+    // Per chunk: count, failed
+    pre_recs = pre_mem + jobs * 2;
+    // --- 1. Cut at line starts ---
+    bounds[0] = 0;
+    while (k < jobs) {
+        p = (len / jobs) * k;
+        if (p < bounds[k - 1]) {
+            p = bounds[k - 1];
+        } else {
+            p = scan_line_end(source_buf, p);
+            if (source_buf[p] != '\0') {
+                p = p + 1;
             }
-                 // Check unclosed string
-                 if (c == '\0') {
-                printf("%s\n", "Error: Unclosed string literal!");
-                return 1;
+        }
+        bounds[k] = p;
+        k = k + 1;
+    }
+    bounds[jobs] = len;
+    // --- 2. Lex every chunk in a worker ---
+    lex_quiet = 1;
+    k = 0;
+    while (k < jobs) {
+        p = fork_worker();
+        if (p <= 0) {
+            // Child, or no more processes: lex the chunk right here
+            results[k * 2] = lex_chunk(bounds[k], bounds[k + 1], bounds[k] + k);
+            results[k * 2 + 1] = lex_failed;
+            if (p == 0) {
+                exit_worker();
             }
-                 pos = pos + 1;
-                 buffer[i] = '\0';
-                 // Add token
-                 token_types[token_count] = "STRING";
-                 token_lines[token_count] = line_num;
-                 token_cols[token_count] = token_start_col;
-                 token_values[token_count] = pool_pos;
-                 j = 0;
-                 while (j <= i) {
-                token_pool[pool_pos] = buffer[j];
-                pool_pos = pool_pos + 1;
-                j = j + 1;
+            lex_failed = 0;
+        }
+        k = k + 1;
+    }
+    wait_workers();
+    // --- 3. Repair and stitch the chunks in order ---
+    int total = 0;
+    int carry = 0;
+    // End of the last token so far
+    int failed = 0;
+    int base;
+    int count;
+    int i;
+    int packed;
+    int kind;
+    k = 0;
+    while (k < jobs) {
+        base = bounds[k] + k;
+        count = results[k * 2];
+        if (carry > bounds[k]) {
+            // A token of an earlier chunk runs into this one
+            count = 0;
+            lex_failed = 0;
+            if (carry < bounds[k + 1]) {
+                count = lex_chunk(carry, bounds[k + 1], base);
             }
-                 token_count = token_count + 1;
-             } else if (c == '\'') {
-                 token_start_col = col;
-                 pos = pos + 1;
-                 c = source_code[pos];
-                 token_val = c;
-                 int is_escape = 0;
-                 if (c == '\\') {
-                token_pool[pool_pos] = '\\';
-                pool_pos = pool_pos + 1;
-                is_escape = 1;
-                pos = pos + 1;
-                c = source_code[pos];
-                if (c == 'n') {
-                    token_val = 'n';
-                } else if (c == 't') {
-                           token_val = 't';
-                       } else if (c == '\'') {
-                           token_val = '\'';
-                       } else if (c == '\\') {
-                           token_val = '\\';
-                       } else {
-                           token_val = c;
-                       }
+            results[k * 2 + 1] = lex_failed;
+        }
+        if (results[k * 2 + 1] != 0) {
+            failed = 1;
+        }
+        i = 0;
+        while (i < count * TOKEN_REC) {
+            pre_recs[total * TOKEN_REC + i] = pre_recs[base * TOKEN_REC + i];
+            i = i + 1;
+        }
+        total = total + count;
+        if (count > 0) {
+            packed = pre_recs[(total - 1) * TOKEN_REC];
+            kind = packed - (packed / 256) * 256;
+            carry = pre_recs[(total - 1) * TOKEN_REC + 1] + packed / 256;
+            if (kind == TK_STRING || kind == TK_CHAR) {
+                carry = carry + 1;
+                // Closing quote
             }
-                 pos = pos + 1;
-                 c = source_code[pos];
-                 if (c != '\'') {
-                printf("%s\n", "Error: Unclosed or invalid char literal!");
-                return 1;
+        }
+        k = k + 1;
+    }
+    // Start over serially, it reports the error like it always does
+    lex_init(source_buf);
+    if (failed == 1) {
+        return -1;
+    }
+    n_pre = total;
+    lex_pos = len;
+    return 0;
+}
+
+int lex_only(char* source_code, int repeat, int jobs) {
+    // Lexes 'source_code' 'repeat' times, with lex_parallel() if 'jobs'
+    // is above 1, and prints the token count and a checksum of the
+    // tokens of the last round, to compare serial and parallel runs.
+    // Used by bench/bench_stage1.py --lex to measure lexer throughput.
+    if (source_code == 0) {
+        printf("%s\n", "Error: Could not read input file.");
+        return 1;
+    }
+    int i = 0;
+    int kind;
+    int idx;
+    int sum = 0;
+    while (i < repeat) {
+        // Tokens are dropped as the window wraps around
+        lex_init(source_code);
+        if (jobs > 1) {
+            lex_parallel(jobs);
+        }
+        kind = -1;
+        while (kind != TK_EOF) {
+            idx = n_tokens;
+            kind = lex_fill(TOKEN_WINDOW);
+            while (i == repeat - 1 && idx < n_tokens) {
+                sum = sum * 31 + tok_kind(idx) + tok_start(idx) + tok_len(idx) * 7;
+                sum = sum - (sum / 1000003) * 1000003;
+                idx = idx + 1;
             }
-                 pos = pos + 1;
-                 // Add token
-                 buffer[0] = token_val;
-                 buffer[1] = '\0';
-                 token_types[token_count] = "CHAR";
-                 token_lines[token_count] = line_num;
-                 token_cols[token_count] = token_start_col;
-                 token_values[token_count] = pool_pos - is_escape;
-                 token_pool[pool_pos] = buffer[0];
-                 token_pool[pool_pos + 1] = buffer[1];
-                 pool_pos = pool_pos + 2;
-                 token_count = token_count + 1;
-             }
-             // --- 7. Handle Errors ---
-             else {
-                 printf("%s\n", concat("Error: Unexpected character!", ctos(c)));
-                 return 1;
-             }
+        }
+        i = i + 1;
+    }
+    printf("%s\n", concat(itos(n_tokens), " tokens"));
+    printf("%s\n", concat("checksum ", itos(sum)));
+    return 0;
+}
+
+int parse_only(char* source_code, int repeat) {
+    // Lexes and parses 'source_code' 'repeat' times and prints the
+    // token count. Nothing is emitted and the tree is dropped after
+    // each global declaration, so memory stays flat on large inputs.
+    // Used by bench/bench_stage1.py --parse to measure parser throughput.
+    if (source_code == 0) {
+        printf("%s\n", "Error: Could not read input file.");
+        return 1;
+    }
+    int i = 0;
+    while (i < repeat) {
+        compile_reset(source_code);
+        while (peek() != TK_EOF) {
+            global_decl();
+            ast_reset();
+        }
+        i = i + 1;
     }
-    // Add EOF Token
-    add_simple_token(token_count, "EOF", line_num, col);
-    token_count = token_count + 1;
-    n_tokens = token_count;
+    printf("%s\n", concat(itos(n_tokens), " tokens"));
     return 0;
 }
 
@@ -1584,54 +3325,135 @@ int is_space(char c) {
     return (c == ' ') || (c == '\t') || (c == '\n');
 }
 
-int is_ident_char(char c) {
-    // Checks if a char can be part of an identifier *after* the first char.
-    // Corresponds to: [A-Za-z0-9_]
-    return is_letter(c) || is_digit(c);
+int dfa_init() {
+    // Decodes the generated DFA_* strings into the dfa_* arrays.
+    // Every char of a string is one value, stored as value + 40.
+    int i = 0;
+    dfa_class = grow_ints(0, 256);
+    while (i < 256) {
+        // Every byte above 127 is in the class of char code 128
+        if (i < 128) {
+            dfa_class[i] = ctoi(DFA_CLASS_OF[i]) - 40;
+        } else {
+            dfa_class[i] = ctoi(DFA_CLASS_OF[128]) - 40;
+        }
+        i = i + 1;
+    }
+    dfa_next = grow_ints(0, DFA_STATES * DFA_CLASSES);
+    i = 0;
+    while (i < DFA_STATES * DFA_CLASSES) {
+        dfa_next[i] = ctoi(DFA_NEXT[i]) - 40;
+        i = i + 1;
+    }
+    dfa_accept = grow_ints(0, DFA_STATES);
+    dfa_accel = grow_ints(0, DFA_STATES);
+    i = 0;
+    while (i < DFA_STATES) {
+        dfa_accept[i] = ctoi(DFA_ACCEPT[i]) - 41;
+        dfa_accel[i] = ctoi(DFA_ACCEL[i]) - 40;
+        i = i + 1;
+    }
+    // A byte whose state has no way out is a whole token by itself
+    int state;
+    int k;
+    dfa_single = grow_ints(0, 256);
+    i = 0;
+    while (i < 256) {
+        dfa_single[i] = -1;
+        state = dfa_next[DFA_CLASSES + dfa_class[i]];
+        if (state != 0 && dfa_accept[state] != TK_MISMATCH) {
+            k = 0;
+            while (k < DFA_CLASSES && dfa_next[state * DFA_CLASSES + k] == 0) {
+                k = k + 1;
+            }
+            if (k == DFA_CLASSES) {
+                dfa_single[i] = dfa_accept[state];
+            }
+        }
+        i = i + 1;
+    }
+    return 0;
 }
 
-char* check_keywords(char* s) {
-    // Checks if a string 's' is a keyword.
-    // If it is, return the keyword's Token Type.
-    // Otherwise, return "ID".
-    if (strcmp(s, "ah") == 0) {
-        return "FN";
-    } else if (strcmp(s, "beg") == 0) {
-               return "LET";
-           } else if (strcmp(s, "boo") == 0) {
-               return "PRINT";
-           } else if (strcmp(s, "if") == 0) {
-               return "IF";
-           } else if (strcmp(s, "else") == 0) {
-               return "ELSE";
-           } else if (strcmp(s, "while") == 0) {
-               return "WHILE";
-           } else if (strcmp(s, "return") == 0) {
-               return "RETURN";
-           } else if (strcmp(s, "int*") == 0 || strcmp(s, "char*") == 0 || strcmp(s, "int") == 0 || strcmp(s, "char") == 0 || strcmp(s, "void") == 0) {
-               return "TYPE";
+// --- BEGIN GENERATED: check_keywords ---
+int check_keywords(char* s, int len) {
+    // Returns the token kind of identifier 's' (length 'len'):
+    // a keyword kind, TK_TYPE for type names, or TK_ID.
+    // Generated by python/lexer/gen_keywords.py, do not edit.
+    if (len == 2) {
+        if (s[0] == 'a') {
+            if (s[1] == 'h') {
+                return TK_FN;
+            }
+        } else if (s[0] == 'i') {
+                   if (s[1] == 'f') {
+                return TK_IF;
+            }
+               }
+    } else if (len == 3) {
+               if (s[0] == 'b') {
+            if (s[1] == 'e' && s[2] == 'g') {
+                return TK_LET;
+            }
+            if (s[1] == 'o' && s[2] == 'o') {
+                return TK_PRINT;
+            }
+        } else if (s[0] == 'i') {
+                   if (s[1] == 'n' && s[2] == 't') {
+                return TK_TYPE;
+            }
+               }
+           } else if (len == 4) {
+               if (s[0] == 'c') {
+            if (s[1] == 'h' && s[2] == 'a' && s[3] == 'r') {
+                return TK_TYPE;
+            }
+        } else if (s[0] == 'e') {
+                   if (s[1] == 'l' && s[2] == 's' && s[3] == 'e') {
+                return TK_ELSE;
+            }
+               } else if (s[0] == 'v') {
+                   if (s[1] == 'o' && s[2] == 'i' && s[3] == 'd') {
+                return TK_TYPE;
+            }
+               }
+           } else if (len == 5) {
+               if (s[0] == 'w') {
+            if (s[1] == 'h' && s[2] == 'i' && s[3] == 'l' && s[4] == 'e') {
+                return TK_WHILE;
+            }
+        }
+           } else if (len == 6) {
+               if (s[0] == 'r') {
+            if (s[1] == 'e' && s[2] == 't' && s[3] == 'u' && s[4] == 'r' && s[5] == 'n') {
+                return TK_RETURN;
+            }
+        }
            }
-           // Default case: not a keyword
-
-    return "ID";
+    return TK_ID;
 }
 
-int add_simple_token(int index, char* type, int line, int col) {
-    // Helper to add a simple token (without a value) to the token arrays.
-    token_types[index] = type;
-    token_values[index] = -1;
-    // -1 means no value
-    token_lines[index] = line;
-    token_cols[index] = col;
+// --- END GENERATED: check_keywords ---
+int add_simple_token(int rec, int type, int start, int len) {
+    // Helper to write a token record at offset 'rec' of token_recs.
+    // Its text is the span [start, start + len) of source_buf.
+    token_recs[rec] = type + len * 256;
+    token_recs[rec + 1] = start;
     return 0;
 }
 
 char* concat(char* str1, char* str2) {
-    static char buf[1024];
-    snprintf(buf, sizeof(buf), "%s%s", str1, str2);
+    size_t len1 = strlen(str1);
+    char* buf = malloc(len1 + strlen(str2) + 1);
+    memcpy(buf, str1, len1);
+    strcpy(buf + len1, str2);
     return buf;
 }
 
+static inline int str_is(char* s, char* lit) {
+    return s[0] == lit[0] && (lit[0] == '\0' || strcmp(s + 1, lit + 1) == 0);
+}
+
 char* itos(int x) {
     static char buf[32];
     snprintf(buf, sizeof(buf), "%d", x);
@@ -1645,18 +3467,166 @@ char* ctos(char c) {
     return buf;
 }
 
-char* read_file(char* path) {
-    FILE* f = fopen(path, "rb");
-    if (!f) return NULL;
-    fseek(f, 0, SEEK_END);
-    long len = ftell(f);
-    fseek(f, 0, SEEK_SET);
+int ctoi(char c) {
+    return (unsigned char)c;
+}
+
+char* substr(char* s, int start, int len) {
     char* buf = malloc(len + 1);
-    if (buf) {
-        fread(buf, 1, len, f);
-        buf[len] = '\0';
+    memcpy(buf, s + start, len);
+    buf[len] = '\0';
+    return buf;
+}
+
+char** grow_strs(char** a, int cap) {
+    return realloc(a, cap * sizeof(char*));
+}
+
+char* grow_chars(char* a, int cap) {
+    return realloc(a, cap);
+}
+
+int* grow_ints(int* a, int cap) {
+    return realloc(a, cap * sizeof(int));
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static int scan_level = 0; // 0: scalar, 1: SSE2, 2: AVX2
+
+static inline int scan_stop(char c, int cls) {
+    if (cls == 0) return c != ' ' && c != '\t' && c != '\n';
+    if (cls == 1) return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_');
+    if (cls == 2) return c == '\n' || c == '\0';
+    return c == '"' || c == '\\' || c == '\0';
+}
+
+#if defined(__x86_64__)
+static inline __attribute__((always_inline)) unsigned scan_mask_sse2(__m128i v, int cls) {
+    if (cls == 0) return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')))) & 0xFFFF;
+    if (cls == 1) {
+        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), v));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+        __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+        return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(lower, upper), _mm_or_si128(digit, under))) & 0xFFFF;
     }
-    fclose(f);
+    __m128i stop = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+    if (cls == 2) return _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    return _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+}
+
+static inline __attribute__((always_inline)) int scan_sse2(char* s, int pos, int cls) {
+    char* p = s + pos;
+    char* a = (char*)((size_t)p & ~(size_t)15);
+    unsigned mask = scan_mask_sse2(_mm_load_si128((__m128i*)a), cls) & (0xFFFFu << (p - a));
+    while (mask == 0) {
+        a = a + 16;
+        mask = scan_mask_sse2(_mm_load_si128((__m128i*)a), cls);
+    }
+    return (int)(a - s) + __builtin_ctz(mask);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline unsigned scan_mask_avx2(__m256i v, int cls) {
+    if (cls == 0) return ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+    if (cls == 1) {
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+        __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        return ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(lower, upper), _mm256_or_si256(digit, under)));
+    }
+    __m256i stop = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+    if (cls == 2) return _mm256_movemask_epi8(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    return _mm256_movemask_epi8(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))));
+}
+
+__attribute__((target("avx2")))
+static int scan_avx2(char* s, int pos, int cls) {
+    char* p = s + pos;
+    char* a = (char*)((size_t)p & ~(size_t)31);
+    unsigned mask = scan_mask_avx2(_mm256_load_si256((__m256i*)a), cls) & (0xFFFFFFFFu << (p - a));
+    while (mask == 0) {
+        a = a + 32;
+        mask = scan_mask_avx2(_mm256_load_si256((__m256i*)a), cls);
+    }
+    return (int)(a - s) + __builtin_ctz(mask);
+}
+
+#endif
+
+static inline __attribute__((always_inline)) int scan(char* s, int pos, int cls) {
+    // Short runs are the common case, check two bytes before going wide
+    if (scan_stop(s[pos], cls)) return pos;
+    if (scan_stop(s[pos + 1], cls)) return pos + 1;
+#if defined(__x86_64__)
+    if (scan_level == 2) return scan_avx2(s, pos + 2, cls);
+    if (scan_level == 1) return scan_sse2(s, pos + 2, cls);
+#endif
+    while (!scan_stop(s[pos], cls)) pos++;
+    return pos;
+}
+
+__attribute__((constructor))
+static void scan_init(void) {
+#if defined(__x86_64__)
+    scan_level = __builtin_cpu_supports("avx2") ? 2 : 1;
+#endif
+    if (getenv("DAV_SCALAR_LEX")) scan_level = 0;
+}
+
+int skip_spaces(char* s, int pos) {
+    return scan(s, pos, 0);
+}
+
+int scan_ident(char* s, int pos) {
+    return scan(s, pos, 1);
+}
+
+int scan_line_end(char* s, int pos) {
+    return scan(s, pos, 2);
+}
+
+int scan_string_end(char* s, int pos) {
+    return scan(s, pos, 3);
+}
+
+char* read_file(char* path) {
+    int fd = strcmp(path, "-") == 0 ? 0 : open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t len = st.st_size;
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t span = (len / page + 1) * page;
+        char* buf = mmap(NULL, span, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf != MAP_FAILED) {
+            if (mmap(buf, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {
+                madvise(buf, len, MADV_SEQUENTIAL);
+                close(fd);
+                return buf;
+            }
+            munmap(buf, span);
+        }
+    }
+    size_t cap = 65536;
+    size_t len = 0;
+    ssize_t n;
+    char* buf = malloc(cap + 1);
+    while ((n = read(fd, buf + len, cap - len)) > 0) {
+        len = len + n;
+        if (len == cap) {
+            cap = cap * 2;
+            buf = realloc(buf, cap + 1);
+        }
+    }
+    buf[len] = '\0';
+    if (fd != 0) close(fd);
     return buf;
 }
 
@@ -1667,3 +3637,59 @@ void write_file(char* path, char* content) {
     fclose(f);
 }
 
+int open_output(char* path) {
+    if (strcmp(path, "-") == 0) return 1;
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+int write_chars(int fd, char* buf, int len) {
+    int done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n <= 0) return -1;
+        done = done + n;
+    }
+    return done;
+}
+
+void copy_chars(char* dst, char* src, int len) {
+    memcpy(dst, src, len);
+}
+
+static FILE* cc_pipe = NULL;
+
+int open_cc(char* cmd) {
+    signal(SIGPIPE, SIG_IGN);
+    fflush(stdout);
+    cc_pipe = popen(cmd, "w");
+    return cc_pipe ? fileno(cc_pipe) : -1;
+}
+
+int close_cc() {
+    int status = pclose(cc_pipe);
+    return status >= 0 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int* shared_ints(int n) {
+    int* p = mmap(NULL, (size_t)n * sizeof(int) + 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+void free_shared(int* p, int n) {
+    munmap(p, (size_t)n * sizeof(int) + 1);
+}
+
+int fork_worker() {
+    fflush(stdout);
+    return fork();
+}
+
+int wait_workers() {
+    while (wait(NULL) > 0) {}
+    return 0;
+}
+
+void exit_worker() {
+    _exit(0);
+}
+
@@ -1,38 +1,211 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 char* concat(char* str1, char* str2);
+static inline int str_is(char* s, char* lit);
 char* itos(int x);
 char* ctos(char c);
+int ctoi(char c);
+char* substr(char* s, int start, int len);
+char** grow_strs(char** a, int cap);
+char* grow_chars(char* a, int cap);
+int* grow_ints(int* a, int cap);
+int skip_spaces(char* s, int pos);
+int scan_ident(char* s, int pos);
+int scan_line_end(char* s, int pos);
+int scan_string_end(char* s, int pos);
 
 char* read_file(char* path);
 void write_file(char* path, char* content);
-char* token_types[50000];
-int token_values[50000];
-int token_lines[50000];
-int token_cols[50000];
-char token_pool[500000];
+int open_output(char* path);
+int write_chars(int fd, char* buf, int len);
+void copy_chars(char* dst, char* src, int len);
+int open_cc(char* cmd);
+int close_cc();
+int* shared_ints(int n);
+void free_shared(int* p, int n);
+int fork_worker();
+int wait_workers();
+void exit_worker();
+int TK_EOF = 0;
+int TK_ID = 1;
+int TK_NUMBER = 2;
+int TK_STRING = 3;
+int TK_CHAR = 4;
+int TK_TYPE = 5;
+int TK_FN = 6;
+int TK_LET = 7;
+int TK_PRINT = 8;
+int TK_IF = 9;
+int TK_ELSE = 10;
+int TK_WHILE = 11;
+int TK_RETURN = 12;
+int TK_ASSIGN = 13;
+int TK_EQ = 14;
+int TK_NE = 15;
+int TK_LT = 16;
+int TK_GT = 17;
+int TK_LE = 18;
+int TK_GE = 19;
+int TK_AND = 20;
+int TK_OR = 21;
+int TK_PLUS = 22;
+int TK_MINUS = 23;
+int TK_MUL = 24;
+int TK_DIV = 25;
+int TK_LPAREN = 26;
+int TK_RPAREN = 27;
+int TK_LBRACE = 28;
+int TK_RBRACE = 29;
+int TK_LSQUARE = 30;
+int TK_RSQUARE = 31;
+int TK_SEMICOL = 32;
+int TK_COMMA = 33;
+int TK_COMMENT = 34;
+int TK_SKIP = 35;
+int TK_NEWLINE = 36;
+int TK_MISMATCH = 37;
+int N_TOKEN_KINDS = 38;
+char* OP_PREC = "00000000000000334444215566000000000000";
+int TOKEN_WINDOW = 256;
+int TOKEN_REC = 2;
+char* source_buf;
+int token_recs[514];
 int n_tokens = 0;
+int next_rec = 0;
+int lex_pos = 0;
+int lex_end = 2147483647;
+int lex_failed = 0;
+int lex_quiet = 0;
+int* dfa_class;
+int* dfa_next;
+int* dfa_accept;
+int* dfa_accel;
+int* dfa_single;
+int DFA_STATES = 54;
+int DFA_CLASSES = 38;
+char* DFA_CLASS_OF = "())))))))*+)))))))))))))))))))))*,-)))./012345678888888888)9:;<))==========================>?@)=)A=BC===DE====FG==H=I=J====KLM)))";
+char* DFA_NEXT = "(((((((((((((((((((((((((((((((((((((((*+,-./0123456*789:;<=>*?=@==A====BCDE((((((((((((((((((((((((((((((((((((((((+((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((](((((((((((((((((((ZZZZ[ZZZZZZZZZZZZZZZZZ\\ZZZZZZZZZZZZZZ((((((Y((((((((((((((((((((((((((((((((VVVVVV(VVVVVVVVVVVVVVVWVVVVVVVVVVVVVV(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((U((((((((((((((((((((((((((((((((((((T(8((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((S(((((((((((((((((((((((((((((((((((((R(((((((((((((((((((((((((((((((((((((Q((((((((((((((((((((((((((((((((((=((((=(((==========(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((=((((=(((===M======(((((((((((((((((((=((((=(((=====J====(((((((((((((((((((=((((=(((======G===(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((F(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((=((((=(((====H=====(((((((((((((((((((=((((=(((==I=======(((((((((((((((((((=((((=(((==========(((((((((((((((((((=((((=(((========K=(((((((((((((L(((((=((((=(((==========(((((((((((((((((((((((((((((((((((((((((((((((((((((((((=((((=(((N=========(((((((((((((((((((=((((=(((=======O==(((((((((((((P(((((=((((=(((==========(((((((((((((L(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((T((((((((((((((((((((((UU(UUUUUUUUUUUUUUUUUUUUUUUUUUUUUUUUUU(((((((X(((((((((((((((((((((((((((((((VV(VVVVVVVVVVVVVVVVVVVVVVVVVVVVVVVVVV(((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((ZZZZ[ZZZZZZZZZZZZZZZZZ\\ZZZZZZZZZZZZZZ(((((((((((((((((((((((((((((((((((((((ZZ(ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ((((((((((((((((((((((((((((((((((((((";
+char* DFA_ACCEPT = "((NLMNNNNCDA?J@B+I96:*GH***ENF>**.*..**..<7;+K((-=(,(8";
+char* DFA_ACCEL = "((((((((((((((((((((()(((((((((((((((((((((((*((((+(((";
+int* pre_recs;
+int n_pre = -1;
+int* pre_mem;
+int pre_mem_cap = 0;
+int* pre_bounds;
+int pre_bounds_cap = 0;
+int pre_pos = 0;
+int* line_starts;
+int n_lines = 0;
+int line_cap = 0;
 int parser_pos = 0;
-char* current_fn_ret_type;
-char* expr_type;
-char* global_names[1000];
-char* global_types[1000];
+int current_fn_ret_type;
+int expr_type = 0;
+int TY_NONE = 0;
+int TY_VOID = 1;
+int TY_INT = 2;
+int TY_CHAR = 3;
+int TYPE_PTR = 4;
+int TY_STR = 7;
+char** type_names;
+int n_type_names = 0;
+int type_name_cap = 0;
+int n_errors = 0;
+int MAX_ERRORS = 20;
+int panic_mode = 0;
+int print_errors = 1;
+char* diagnostics = "";
+char* diag_mem;
+int diag_len = 0;
+int diag_cap = 0;
+int msg_len = 0;
+int EX_LEAF = 0;
+int EX_BINARY = 1;
+int EX_CALL = 2;
+int EX_INDEX = 3;
+int EX_PAREN = 4;
+int EX_NEG = 5;
+int EX_CONCAT = 6;
+int EX_STRCMP = 7;
+int EX_PTR_ADD = 8;
+int ST_LET = 9;
+int ST_ARRAY = 10;
+int ST_DECL = 11;
+int ST_PRINT = 12;
+int ST_ASSIGN = 13;
+int ST_STORE = 14;
+int ST_CALL = 15;
+int ST_IF = 16;
+int ST_WHILE = 17;
+int ST_RETURN = 18;
+int ST_BLOCK = 19;
+int FN_DECL = 20;
+int FN_PARAM = 21;
+int PROGRAM = 22;
+int* ast;
+int ast_top = 0;
+int ast_cap = 0;
+int* ast_stack;
+int ast_stack_top = 0;
+int ast_stack_cap = 0;
+char** intern_names;
+int* intern_hashes;
+int* intern_name_caps;
+int n_interned = 0;
+int n_name_bufs = 0;
+int intern_cap = 0;
+int* intern_slots;
+int intern_slot_cap = 0;
+int* global_syms;
+int* global_types;
 int n_globals = 0;
-char* local_names[1000];
-char* local_types[1000];
+int global_cap = 0;
+int* global_slots;
+int* global_stamps;
+int global_slot_cap = 0;
+int global_gen = 1;
+int* local_syms;
+int* local_types;
 int n_locals = 0;
-char c_code_buffer[1000000];
-int c_code_pos = 0;
-char expr_peek_buffer[4096];
+int local_cap = 0;
+int* local_slots;
+int* local_stamps;
+int local_slot_cap = 0;
+int local_gen = 1;
+int* local_slot_of;
+int* scope_marks;
+int n_scopes = 0;
+int scope_cap = 0;
+int OUT_BLOCK = 65536;
+char out_block[65536];
+int out_pos = 0;
+int out_fd = -1;
+int out_failed = 0;
+char* out_mem;
+int out_mem_len = 0;
+int out_mem_cap = 0;
+char* src_mem;
+int src_mem_cap = 0;
 int is_letter(char c);
 int is_digit(char c);
 int is_space(char c);
-int is_ident_char(char c);
-char* check_keywords(char* s);
-int add_simple_token(int index, char* type, int line, int col);
-int tokenize(char* source_code);
+int check_keywords(char* s, int len);
+int dfa_init();
+int add_simple_token(int rec, int type, int start, int len);
+int lex_init(char* source_code);
+int lex_fill(int count);
+int fill_from_pre(int count);
+int lex_chunk(int from, int to, int base);
+int lex_parallel(int jobs);
+int lex_only(char* source_code, int repeat, int jobs);
+int parse_only(char* source_code, int repeat);
 int parse();
 int global_decl();
 int fn_decl();
@@ -43,970 +216,1900 @@ int if_stmt();
 int while_stmt();
 int return_stmt();
 int id_stmt();
+int block();
 int expr();
-int logical();
-int relational();
-int additive();
-int multiplicative();
+int binary_expr(int min_prec);
+int op_prec(int kind);
+int binary_node(int op_kind, int op_pos, int prec, int left, int left_type, int right, int right_type);
 int unary();
 int atom();
-char* peek();
+int call_args(int tok_idx);
+int new_expr(int kind, int value, int a, int b);
+int new_node(int kind, int value, int size);
+int node_kind(int node);
+int node_value(int node);
+int push_node(int node);
+int pop_nodes(int dest, int mark);
+int ast_reset();
+int emit_program(int program);
+int emit_fn(int fn);
+int emit_stmt(int node);
+int emit_expr(int node);
+int peek();
 int next();
-int expect(char* kind);
+int expect(int kind);
+int diag_add(char* s);
+int diag_drop();
+int report_error();
+int add_error();
+int syntax_error();
+int synchronize(int is_global);
+char* token_name(int kind);
+int tok_rec(int idx);
+int tok_kind(int idx);
+int tok_start(int idx);
+int tok_len(int idx);
+int tok_lineno(int idx);
+int line_of(int pos);
+int tok_sym(int idx);
+int type_of_tok(int idx);
+int pointer_to(int type);
+int deref(int type);
+int is_pointer(int type);
+char* type_name(int type);
 int clear_local_symbols();
-char* get_symbol_type(int is_global, char* name);
-int add_symbol(int is_global, char* name, char* type);
-int str_ends_with(char* s, char c);
-char* op_to_c_op(char* tok_type);
+int clear_global_symbols();
+int enter_scope();
+int leave_scope();
+int get_symbol_type(int is_global, int sym);
+int find_symbol(int is_global, int sym);
+int add_symbol(int is_global, int sym, int type);
+int insert_slot(int is_global, int i);
+int rehash_symbols(int is_global);
+int intern(char* s, int len);
+int intern_str(char* s);
+int intern_reset();
+char* sym_name(int sym);
+int name_equals(char* name, char* s, int len);
+int name_hash(char* s, int len);
+int rehash_names();
+char* op_to_c_op(int tok_type);
 int emit(char* s);
-char* peek_code(char* level);
+int emit_span(int start, int len);
+int emit_chars(char* s, int len);
+int flush_output();
+char* shell_quote(char* s);
+char* compile(char* source, int len);
+int compile_reset(char* code);
 int c_include();
 int c_prototype();
 int c_helper();
 int preset_global_functions();
 int main(int argc, char* argv[]) {
-if (argc != 3) {
-printf("%s\n", "Usage: compiler <input_file.dav> <output_file.c>");
+if (argc == 4 && str_is(argv[1], "--lex")) {
+return lex_only(read_file(argv[2]), atoi(argv[3]), 1);
+}
+if (argc == 5 && str_is(argv[1], "--lex")) {
+return lex_only(read_file(argv[2]), atoi(argv[3]), atoi(argv[4]));
+}
+if (argc == 4 && str_is(argv[1], "--parse")) {
+return parse_only(read_file(argv[2]), atoi(argv[3]));
+}
+int jobs = 1;
+char* cc = "";
+int arg = 1;
+while (arg + 3 < argc && (str_is(argv[arg], "--jobs") || str_is(argv[arg], "--cc"))) {
+if (str_is(argv[arg], "--jobs")) {
+jobs = atoi(argv[arg + 1]);
+}
+else {
+cc = argv[arg + 1];
+}
+arg = arg + 2;
+}
+if (argc - arg != 2) {
+printf("%s\n", "Usage: compiler [--jobs N] [--cc CC] <input_file.dav> <output_file.c>  (input - reads stdin, output - writes stdout)");
 return 1;
 }
-char* input_file = argv[1];
-char* output_file = argv[2];
+char* input_file = argv[arg];
+char* output_file = argv[arg + 1];
 char* code = read_file(input_file);
 if (code == 0) {
 printf("%s\n", "Error: Could not read input file.");
 return 1;
 }
+compile_reset(code);
+if (jobs > 1) {
+lex_parallel(jobs);
+}
+int program = parse();
+if (n_errors > 0) {
+printf("%s\n", concat(concat(concat(itos(n_errors), " error(s), "), output_file), " not written."));
+return 1;
+}
+if (str_is(cc, "")) {
+out_fd = open_output(output_file);
+}
+else {
+out_fd = open_cc(concat(concat(cc, " -x c - -o "), shell_quote(output_file)));
+}
+if (out_fd < 0) {
+printf("%s\n", "Error: Could not open output file.");
+return 1;
+}
 c_include();
 c_prototype();
-preset_global_functions();
-tokenize(code);
-parse();
+emit_program(program);
 c_helper();
-write_file(output_file, c_code_buffer);
+flush_output();
+if (!str_is(cc, "")) {
+int status = close_cc();
+if (status != 0) {
+printf("%s\n", concat(concat(concat(concat("Error: ", cc), " failed, "), output_file), " not built."));
+return 1;
+}
+}
+if (out_failed == 1) {
+printf("%s\n", "Error: Could not write output file.");
+return 1;
+}
 return 0;
 }
-int parse() {
-while (strcmp(peek(), "EOF") != 0) {
-global_decl();
+char* shell_quote(char* s) {
+char* quoted = "'";
+int start = 0;
+int i = 0;
+while (s[i] != '\0') {
+if (s[i] == '\'') {
+quoted = concat(concat(quoted, substr(s, start, i - start)), "'\\''");
+start = i + 1;
 }
+i = i + 1;
+}
+return concat(concat(quoted, substr(s, start, i - start)), "'");
+}
+char* compile(char* source, int len) {
+if (len + 1 > src_mem_cap) {
+src_mem_cap = (len + 1) * 2;
+src_mem = grow_chars(src_mem, src_mem_cap);
+}
+copy_chars(src_mem, source, len);
+src_mem[len] = '\0';
+compile_reset(src_mem);
+print_errors = 0;
+out_fd = -1;
+out_mem_len = 0;
+int program = parse();
+if (n_errors > 0) {
+return "";
+}
+c_include();
+c_prototype();
+emit_program(program);
+c_helper();
+flush_output();
+return out_mem;
+}
+int compile_reset(char* code) {
+n_errors = 0;
+panic_mode = 0;
+diagnostics = "";
+diag_len = 0;
+msg_len = 0;
+out_pos = 0;
+out_failed = 0;
+clear_global_symbols();
+clear_local_symbols();
+intern_reset();
+preset_global_functions();
+lex_init(code);
 return 0;
 }
+int parse() {
+ast_reset();
+int mark = ast_stack_top;
+int decl;
+while (peek() != TK_EOF && n_errors < MAX_ERRORS) {
+decl = global_decl();
+push_node(decl);
+if (decl < 0 || panic_mode == 1) {
+synchronize(1);
+}
+}
+int program = new_node(PROGRAM, ast_stack_top - mark, 1 + ast_stack_top - mark);
+pop_nodes(program + 1, mark);
+return program;
+}
 int global_decl() {
-char* tok = peek();
-if (strcmp(tok, "FN") == 0) {
-fn_decl();
+int tok = peek();
+if (tok == TK_FN) {
+return fn_decl();
 }
-else if (strcmp(tok, "LET") == 0) {
-let_stmt(1);
+else if (tok == TK_LET) {
+return let_stmt(1);
 }
 else {
-int tok_line = token_lines[parser_pos];
-printf("%s\n", concat("Error: Unexpected global token on line ", itos(tok_line)));
-printf("%s\n", concat("Expected FN, LET, or COMMENT, but got: ", tok));
+int tok_line = tok_lineno(parser_pos);
+diag_add("Error: Unexpected global token on line ");
+diag_add(itos(tok_line));
+diag_add("\nExpected FN, LET, or COMMENT, but got: ");
+diag_add(token_name(tok));
+syntax_error();
 next();
 return -1;
 }
-return 0;
+return -1;
 }
 int fn_decl() {
-int fn_tok_idx = expect("FN");
-int line_num = token_lines[fn_tok_idx];
-char* fn_type = "void";
-if (strcmp(peek(), "TYPE") == 0) {
-int fn_type_idx = next();
-fn_type = token_pool + token_values[fn_type_idx];
-}
-if (strcmp(peek(), "MUL") == 0) {
+int fn_tok_idx = expect(TK_FN);
+int line_pos = tok_start(fn_tok_idx);
+int fn_type = TY_VOID;
+if (peek() == TK_TYPE) {
+fn_type = type_of_tok(next());
+}
+while (peek() == TK_MUL) {
 next();
-if (strcmp(fn_type, "int") == 0) {
-fn_type = "int*";
+fn_type = pointer_to(fn_type);
 }
-else if (strcmp(fn_type, "char") == 0) {
-fn_type = "char*";
+int fn_sym = tok_sym(expect(TK_ID));
+current_fn_ret_type = fn_type;
+add_symbol(1, fn_sym, fn_type);
+expect(TK_LPAREN);
+clear_local_symbols();
+int mark = ast_stack_top;
+while (peek() != TK_RPAREN && peek() != TK_EOF && panic_mode == 0) {
+if (ast_stack_top > mark) {
+expect(TK_COMMA);
+}
+int param_type = TY_INT;
+if (peek() == TK_TYPE) {
+param_type = type_of_tok(next());
+}
+while (peek() == TK_MUL) {
+next();
+param_type = pointer_to(param_type);
+}
+int param_sym = tok_sym(expect(TK_ID));
+int param = new_node(FN_PARAM, 0, 5);
+ast[param + 1] = param_type;
+ast[param + 2] = param_sym;
+if (peek() == TK_LSQUARE) {
+next();
+param_type = pointer_to(param_type);
+ast[param] = FN_PARAM + 256;
+if (peek() == TK_NUMBER) {
+int size_idx = next();
+ast[param] = FN_PARAM + 512;
+ast[param + 3] = tok_start(size_idx);
+ast[param + 4] = tok_len(size_idx);
+}
+expect(TK_RSQUARE);
+}
+add_symbol(0, param_sym, param_type);
+push_node(param);
+}
+expect(TK_RPAREN);
+int n_params = ast_stack_top - mark;
+int fn = new_node(FN_DECL, n_params, 4 + n_params);
+ast[fn + 1] = fn_type;
+ast[fn + 2] = fn_sym;
+ast[fn + 3] = -1;
+pop_nodes(fn + 4, mark);
+if (peek() == TK_SEMICOL) {
+next();
+clear_local_symbols();
+return fn;
 }
-else if (strcmp(fn_type, "char*") == 0) {
-fn_type = "char**";
+else if (peek() == TK_LBRACE) {
+next();
+int body = block();
+ast[fn + 3] = body;
+expect(TK_RBRACE);
+return fn;
 }
 else {
-printf("%s\n", concat("Error: Cannot make array of type ", fn_type));
+diag_add("Error: Expected ';' or '{' after function signature, line ");
+diag_add(itos(line_of(line_pos)));
+syntax_error();
 return -1;
 }
 }
-int fn_name_idx = expect("ID");
-char* fn_name = token_pool + token_values[fn_name_idx];
-current_fn_ret_type = fn_type;
-add_symbol(1, fn_name, fn_type);
-expect("LPAREN");
-emit(fn_type);
-emit(" ");
-emit(fn_name);
-emit("(");
-char* param_types[20];
-char* param_names[20];
-int param_has_arrays_part[20];
-int n_params = 0;
-int i = 0;
-while (strcmp(peek(), "RPAREN") != 0) {
-if (n_params > 0) {
-expect("COMMA");
-emit(", ");
+int block() {
+int mark = ast_stack_top;
+int stmt;
+while (peek() != TK_RBRACE && peek() != TK_EOF && peek() != TK_FN && n_errors < MAX_ERRORS) {
+stmt = statement();
+push_node(stmt);
+if (stmt < 0 || panic_mode == 1) {
+synchronize(0);
 }
-char* param_type = "int";
-if (strcmp(peek(), "TYPE") == 0) {
-int param_type_idx = next();
-param_type = token_pool + token_values[param_type_idx];
 }
-if (strcmp(peek(), "MUL") == 0) {
-next();
-if (strcmp(param_type, "int") == 0) {
-param_type = "int*";
+int body = new_node(ST_BLOCK, ast_stack_top - mark, 1 + ast_stack_top - mark);
+pop_nodes(body + 1, mark);
+return body;
+}
+int statement() {
+int tok = peek();
+if (tok == TK_LET) {
+return let_stmt(0);
+}
+else if (tok == TK_PRINT) {
+return print_stmt();
 }
-else if (strcmp(param_type, "char") == 0) {
-param_type = "char*";
+else if (tok == TK_IF) {
+return if_stmt();
 }
-else if (strcmp(param_type, "char*") == 0) {
-param_type = "char**";
+else if (tok == TK_WHILE) {
+return while_stmt();
+}
+else if (tok == TK_RETURN) {
+return return_stmt();
+}
+else if (tok == TK_ID) {
+return id_stmt();
 }
 else {
-printf("%s\n", concat("Error: Cannot make array of type ", param_type));
+diag_add("Error: Unexpected statement: ");
+diag_add(token_name(tok));
+diag_add(" on line ");
+diag_add(itos(tok_lineno(parser_pos)));
+syntax_error();
+next();
+return -1;
+}
 return -1;
 }
+int let_stmt(int is_global) {
+int line_pos = tok_start(parser_pos);
+expect(TK_LET);
+int var_type = TY_NONE;
+if (peek() == TK_TYPE) {
+var_type = type_of_tok(next());
 }
-int param_name_idx = expect("ID");
-char* param_name = token_pool + token_values[param_name_idx];
-emit(param_type);
-emit(" ");
-emit(param_name);
-int param_array_part = 0;
-if (strcmp(peek(), "LSQUARE") == 0) {
+while (peek() == TK_MUL) {
 next();
-param_array_part = 1;
-if (strcmp(peek(), "NUMBER") == 0) {
-int size_idx = next();
-char* size_str = token_pool + token_values[size_idx];
-emit("[");
-emit(size_str);
-emit("]");
+var_type = pointer_to(var_type);
+}
+int var_sym = tok_sym(expect(TK_ID));
+char* var_name = sym_name(var_sym);
+if ((is_global == 0 && get_symbol_type(0, var_sym) != TY_NONE) || (is_global == 1 && get_symbol_type(1, var_sym) != TY_NONE)) {
+diag_add("Error: Redefinition of variable ");
+diag_add(var_name);
+diag_add(", line ");
+diag_add(itos(line_of(line_pos)));
+report_error();
+return -1;
 }
-else {
-emit("[]");
+if (peek() == TK_ASSIGN) {
+next();
+int value = expr();
+int right_type = expr_type;
+if (var_type == TY_NONE) {
+var_type = right_type;
 }
-expect("RSQUARE");
+else if (var_type != right_type) {
+diag_add("Error: Incompatible type ");
+diag_add(type_name(right_type));
+diag_add(" to ");
+diag_add(type_name(var_type));
+diag_add(", line ");
+diag_add(itos(line_of(line_pos)));
+report_error();
+add_symbol(is_global, var_sym, var_type);
+return -1;
 }
-param_types[n_params] = param_type;
-param_names[n_params] = param_name;
-param_has_arrays_part[n_params] = param_array_part;
-n_params = n_params + 1;
+expect(TK_SEMICOL);
+add_symbol(is_global, var_sym, var_type);
+int let = new_node(ST_LET, 0, 4);
+ast[let + 1] = var_type;
+ast[let + 2] = var_sym;
+ast[let + 3] = value;
+return let;
 }
-expect("RPAREN");
-emit(")");
-if (strcmp(peek(), "SEMICOL") == 0) {
+else if (peek() == TK_LSQUARE) {
 next();
-emit(";\n");
-return 0;
+if (var_type == TY_NONE || var_type == TY_VOID) {
+diag_add("Error: Array declaration must have an explicit type on line");
+diag_add(itos(line_of(line_pos)));
+report_error();
+return -1;
 }
-else if (strcmp(peek(), "LBRACE") == 0) {
+int size_tok = expect(TK_NUMBER);
+expect(TK_RSQUARE);
+expect(TK_SEMICOL);
+add_symbol(is_global, var_sym, pointer_to(var_type));
+int array = new_node(ST_ARRAY, 0, 5);
+ast[array + 1] = var_type;
+ast[array + 2] = var_sym;
+ast[array + 3] = tok_start(size_tok);
+ast[array + 4] = tok_len(size_tok);
+return array;
+}
+else if (peek() == TK_SEMICOL) {
 next();
-emit(" {\n");
-clear_local_symbols();
-i = 0;
-while (i < n_params) {
-char* var_type = param_types[i];
-if (param_has_arrays_part[i] == 1) {
-if (strcmp(var_type, "int") == 0) {
-var_type = "int*";
-}
-else if (strcmp(var_type, "char") == 0) {
-var_type = "char*";
+if (var_type == TY_NONE) {
+diag_add("Error: Declaration without assignment must have explicit type on line");
+diag_add(itos(line_of(line_pos)));
+report_error();
+return -1;
 }
-else if (strcmp(var_type, "char*") == 0) {
-var_type = "char**";
+add_symbol(is_global, var_sym, var_type);
+int decl = new_node(ST_DECL, 0, 3);
+ast[decl + 1] = var_type;
+ast[decl + 2] = var_sym;
+return decl;
 }
 else {
-printf("%s\n", concat("Error: Cannot make array of type ", var_type));
+diag_add("Error: Expected '=', '[', or ';' after variable name on line");
+diag_add(itos(line_of(line_pos)));
+syntax_error();
+next();
+return -1;
 }
 }
-add_symbol(0, param_names[i], var_type);
-i = i + 1;
+int print_stmt() {
+int line_pos = tok_start(parser_pos);
+expect(TK_PRINT);
+expect(TK_LPAREN);
+int value = expr();
+int type = expr_type;
+int format = 0;
+if (type == TY_INT) {
+format = 0;
 }
-while (strcmp(peek(), "RBRACE") != 0 && strcmp(peek(), "EOF") != 0) {
-statement();
+else if (type == TY_CHAR) {
+format = 1;
 }
-expect("RBRACE");
-emit("}\n");
-return 0;
+else if (type == TY_STR) {
+format = 2;
 }
 else {
-printf("%s\n", concat("Error: Expected ';' or '{' after function signature, line ", itos(line_num)));
+diag_add("Error: Unprintable type '");
+diag_add(type_name(type));
+diag_add("' on line ");
+diag_add(itos(line_of(line_pos)));
+report_error();
 return -1;
 }
+expect(TK_RPAREN);
+expect(TK_SEMICOL);
+int print = new_node(ST_PRINT, format, 2);
+ast[print + 1] = value;
+return print;
 }
-int statement() {
-char* tok = peek();
-if (strcmp(tok, "LET") == 0) {
-let_stmt(0);
+int id_stmt() {
+int tok_idx = next();
+int line_pos = tok_start(tok_idx);
+int var_sym = tok_sym(tok_idx);
+char* var_name;
+int var_type = get_symbol_type(0, var_sym);
+if (var_type == TY_NONE) {
+var_name = sym_name(var_sym);
+diag_add("Error: Undeclared identifier '");
+diag_add(var_name);
+diag_add("' on line ");
+diag_add(itos(line_of(line_pos)));
+report_error();
+return -1;
+}
+if (peek() == TK_ASSIGN) {
+next();
+int value = expr();
+int assign = new_node(ST_ASSIGN, 0, 3);
+ast[assign + 1] = var_sym;
+ast[assign + 2] = value;
+int right_type = expr_type;
+if (var_type != right_type) {
+diag_add("Error: Incompatible ");
+diag_add(type_name(right_type));
+diag_add(" to ");
+diag_add(type_name(var_type));
+diag_add(" conversion on line ");
+diag_add(itos(line_of(line_pos)));
+report_error();
+return -1;
 }
-else if (strcmp(tok, "PRINT") == 0) {
-print_stmt();
+expect(TK_SEMICOL);
+return assign;
+}
+else if (peek() == TK_LPAREN) {
+next();
+int call = call_args(tok_idx);
+expect(TK_SEMICOL);
+int stmt = new_node(ST_CALL, 0, 2);
+ast[stmt + 1] = call;
+return stmt;
 }
-else if (strcmp(tok, "IF") == 0) {
-if_stmt();
+else if (peek() == TK_LSQUARE) {
+next();
+if (is_pointer(var_type) == 0) {
+var_name = sym_name(var_sym);
+diag_add("Error: Variable '");
+diag_add(var_name);
+diag_add("' is not an array and cannot be indexed, line ");
+diag_add(itos(line_of(line_pos)));
+report_error();
+return -1;
 }
-else if (strcmp(tok, "WHILE") == 0) {
-while_stmt();
+int index = expr();
+if (expr_type != TY_INT) {
+diag_add("Error: Array index must be an integer, got ");
+diag_add(type_name(expr_type));
+diag_add(", line ");
+diag_add(itos(line_of(line_pos)));
+report_error();
+return -1;
 }
-else if (strcmp(tok, "RETURN") == 0) {
-return_stmt();
+expect(TK_RSQUARE);
+expect(TK_ASSIGN);
+int value = expr();
+int right_type = expr_type;
+int base_type = deref(var_type);
+if (base_type != right_type) {
+diag_add("Error: Incompatible types: cannot assign ");
+diag_add(type_name(right_type));
+diag_add(" to array element of type ");
+diag_add(type_name(base_type));
+diag_add(", line ");
+diag_add(itos(line_of(line_pos)));
+report_error();
+return -1;
 }
-else if (strcmp(tok, "ID") == 0) {
-id_stmt();
+expect(TK_SEMICOL);
+int store = new_node(ST_STORE, 0, 4);
+ast[store + 1] = var_sym;
+ast[store + 2] = index;
+ast[store + 3] = value;
+return store;
 }
 else {
-printf("%s\n", concat("Error: Unexpected statement: ", concat(tok, concat(" on line ", itos(token_lines[parser_pos])))));
-next();
+var_name = sym_name(var_sym);
+diag_add("Error: Invalid statement start. Expected '=', '(', or '[' after ID '");
+diag_add(var_name);
+diag_add("', line ");
+diag_add(itos(line_of(line_pos)));
+syntax_error();
 return -1;
 }
-return 0;
 }
-int let_stmt(int is_global) {
-int line_num = token_lines[parser_pos];
-expect("LET");
-char* var_type = "undefined";
-if (strcmp(peek(), "TYPE") == 0) {
-int var_type_idx = next();
-var_type = token_pool + token_values[var_type_idx];
-}
-if (strcmp(peek(), "MUL") == 0) {
+int if_stmt() {
+expect(TK_IF);
+int cond = expr();
+int else_part = -1;
+expect(TK_LBRACE);
+enter_scope();
+int then_part = block();
+leave_scope();
+expect(TK_RBRACE);
+if (peek() == TK_ELSE) {
 next();
-if (strcmp(var_type, "int") == 0) {
-var_type = "int*";
+if (peek() == TK_IF) {
+else_part = if_stmt();
 }
-else if (strcmp(var_type, "char") == 0) {
-var_type = "char*";
+else if (peek() == TK_LBRACE) {
+next();
+enter_scope();
+else_part = block();
+leave_scope();
+expect(TK_RBRACE);
 }
 else {
-printf("%s\n", concat("Error: Cannot make array of type ", var_type));
+int tok_line = tok_lineno(parser_pos);
+diag_add("Error: Expected 'if' or '{' after 'else', line ");
+diag_add(itos(tok_line));
+syntax_error();
 return -1;
 }
 }
-int var_name_idx = expect("ID");
-char* var_name = token_pool + token_values[var_name_idx];
-if ((is_global == 0 && strcmp(get_symbol_type(0, var_name), "") != 0) || (is_global == 1 && strcmp(get_symbol_type(1, var_name), "") != 0)) {
-printf("%s\n", concat("Error: Redefinition of variable ", concat(var_name, concat(", line ", itos(line_num)))));
+int node = new_node(ST_IF, 0, 4);
+ast[node + 1] = cond;
+ast[node + 2] = then_part;
+ast[node + 3] = else_part;
+return node;
+}
+int while_stmt() {
+expect(TK_WHILE);
+int cond = expr();
+expect(TK_LBRACE);
+enter_scope();
+int body = block();
+leave_scope();
+expect(TK_RBRACE);
+int node = new_node(ST_WHILE, 0, 3);
+ast[node + 1] = cond;
+ast[node + 2] = body;
+return node;
+}
+int return_stmt() {
+int line_pos = tok_start(parser_pos);
+expect(TK_RETURN);
+int value = expr();
+int ret_type = expr_type;
+if (current_fn_ret_type != ret_type) {
+diag_add("Error: Incompatible ");
+diag_add(type_name(ret_type));
+diag_add(" to ");
+diag_add(type_name(current_fn_ret_type));
+diag_add(" conversion on line ");
+diag_add(itos(line_of(line_pos)));
+report_error();
 return -1;
 }
-if (strcmp(peek(), "ASSIGN") == 0) {
-next();
-emit(var_type);
-emit(" ");
-emit(var_name);
-emit(" = ");
-expr();
-emit(";\n");
-char* right_type = expr_type;
-if (strcmp(var_type, "undefined") == 0) {
-var_type = right_type;
+expect(TK_SEMICOL);
+int node = new_node(ST_RETURN, 0, 2);
+ast[node + 1] = value;
+return node;
+}
+int expr() {
+int node = binary_expr(1);
+if (node < 0) {
+panic_mode = 1;
 }
-else if (strcmp(var_type, right_type) != 0) {
-printf("%s\n", concat("Error: Incompatible type ", concat(right_type, concat(" to ", concat(var_type, concat(", line ", itos(line_num)))))));
+return node;
+}
+int binary_expr(int min_prec) {
+int left = unary();
+int left_type = expr_type;
+if (left < 0) {
 return -1;
 }
-expect("SEMICOL");
-add_symbol(is_global, var_name, var_type);
-return 0;
+while (op_prec(peek()) >= min_prec) {
+int op_idx = next();
+int op_kind = tok_kind(op_idx);
+int op_pos = tok_start(op_idx);
+int prec = op_prec(op_kind);
+int right = binary_expr(prec + 1);
+if (right < 0) {
+return -1;
 }
-else if (strcmp(peek(), "LSQUARE") == 0) {
-next();
-if (strcmp(var_type, "undefined") == 0) {
-printf("%s\n", concat("Error: Array declaration must have an explicit type on line", itos(line_num)));
+left = binary_node(op_kind, op_pos, prec, left, left_type, right, expr_type);
+if (left < 0) {
 return -1;
 }
-int size_tok = expect("NUMBER");
-char* size = token_pool + token_values[size_tok];
-expect("RSQUARE");
-expect("SEMICOL");
-char* array_type = "int*";
-if (strcmp(var_type, "int") == 0) {
-array_type = "int*";
+left_type = expr_type;
+}
+expr_type = left_type;
+return left;
 }
-else if (strcmp(var_type, "char") == 0) {
-array_type = "char*";
+int op_prec(int kind) {
+if (kind >= N_TOKEN_KINDS) {
+return 0;
 }
-else if (strcmp(var_type, "char*") == 0) {
-array_type = "char**";
+return ctoi(OP_PREC[kind]) - ctoi('0');
 }
-else {
-printf("%s\n", concat("Error: Cannot make array of type ", var_type));
+int binary_node(int op_kind, int op_pos, int prec, int left, int left_type, int right, int right_type) {
+char* op = op_to_c_op(op_kind);
+if (prec <= 2) {
+if (left_type != TY_INT || right_type != TY_INT) {
+diag_add("Error: Logical operators '&&' and '||' can only be used on integers, line ");
+diag_add(itos(line_of(op_pos)));
+report_error();
 return -1;
 }
-add_symbol(is_global, var_name, array_type);
-emit(var_type);
-emit(" ");
-emit(var_name);
-emit("[");
-emit(size);
-emit("];\n");
-return 0;
+expr_type = TY_INT;
+return new_expr(EX_BINARY, op_kind, left, right);
 }
-else if (strcmp(peek(), "SEMICOL") == 0) {
-next();
-if (strcmp(var_type, "undefined") == 0) {
-printf("%s\n", concat("Error: Declaration without assignment must have explicit type on line", itos(line_num)));
+if (prec <= 4) {
+expr_type = TY_INT;
+if (left_type == TY_STR && right_type == TY_STR) {
+if (op_kind == TK_EQ || op_kind == TK_NE) {
+return new_expr(EX_STRCMP, op_kind, left, right);
+}
+diag_add("Error: Operator '");
+diag_add(op);
+diag_add("' not allowed on strings, line ");
+diag_add(itos(line_of(op_pos)));
+report_error();
 return -1;
 }
-add_symbol(is_global, var_name, var_type);
-emit(var_type);
-emit(" ");
-emit(var_name);
-emit(";\n");
-return 0;
+else if ((left_type == TY_STR && right_type == TY_INT) || (left_type == TY_INT && right_type == TY_STR)) {
+if (op_kind == TK_EQ || op_kind == TK_NE) {
+return new_expr(EX_BINARY, op_kind, left, right);
 }
-else {
-printf("%s\n", concat("Error: Expected '=', '[', or ';' after variable name on line", itos(line_num)));
-next();
+diag_add("Error: Operator '");
+diag_add(op);
+diag_add("' not allowed on strings, line ");
+diag_add(itos(line_of(op_pos)));
+report_error();
+return -1;
+}
+else if (left_type == TY_STR || right_type == TY_STR) {
+diag_add("Error: Comparison between string and non-string, line ");
+diag_add(itos(line_of(op_pos)));
+report_error();
 return -1;
 }
+return new_expr(EX_BINARY, op_kind, left, right);
 }
-int print_stmt() {
-int line_num = token_lines[parser_pos];
-expect("PRINT");
-expect("LPAREN");
-char* expr_code = peek_code("expr");
-char* type = expr_type;
-if (strcmp(type, "int") == 0) {
-emit("printf(\"%d\\n\", ");
+if (prec == 5) {
+if (left_type == TY_INT && right_type == TY_INT) {
+expr_type = TY_INT;
+return new_expr(EX_BINARY, op_kind, left, right);
 }
-else if (strcmp(type, "char") == 0) {
-emit("printf(\"%c\\n\", ");
+else if (is_pointer(left_type) && right_type == TY_INT) {
+expr_type = left_type;
+return new_expr(EX_BINARY, op_kind, left, right);
 }
-else if (strcmp(type, "char*") == 0) {
-emit("printf(\"%s\\n\", ");
+else if (left_type == TY_INT && is_pointer(right_type)) {
+if (op_kind == TK_PLUS) {
+expr_type = right_type;
+return new_expr(EX_PTR_ADD, 0, left, right);
 }
-else {
-printf("%s\n", concat("Error: Unprintable type '", concat(type, concat("' on line ", itos(line_num)))));
+diag_add("Error: Cannot subtract a pointer from an integer, line ");
+diag_add(itos(line_of(op_pos)));
+report_error();
 return -1;
 }
-emit(expr_code);
-emit(");\n");
-expect("RPAREN");
-expect("SEMICOL");
-return 0;
+else if (left_type == TY_STR && right_type == TY_STR && op_kind == TK_PLUS) {
+expr_type = TY_STR;
+return new_expr(EX_CONCAT, 0, left, right);
+}
+diag_add("Error: Operator '");
+diag_add(op);
+diag_add("' not allowed between '");
+diag_add(type_name(left_type));
+diag_add("' and '");
+diag_add(type_name(right_type));
+diag_add("', line ");
+diag_add(itos(line_of(op_pos)));
+report_error();
+return -1;
 }
-int id_stmt() {
+if (left_type != TY_INT || right_type != TY_INT) {
+diag_add("Error: Operators '*' and '/' can only be used on integers, line ");
+diag_add(itos(line_of(op_pos)));
+report_error();
+return -1;
+}
+expr_type = TY_INT;
+return new_expr(EX_BINARY, op_kind, left, right);
+}
+int unary() {
+if (peek() == TK_MINUS) {
+int op_idx = next();
+int op_pos = tok_start(op_idx);
+int operand = unary();
+if (expr_type != TY_INT) {
+diag_add("Error: Unary '-' operator can only be applied to integers, line ");
+diag_add(itos(line_of(op_pos)));
+report_error();
+return -1;
+}
+expr_type = TY_INT;
+int neg = new_node(EX_NEG, 0, 2);
+ast[neg + 1] = operand;
+return neg;
+}
+return atom();
+}
+int atom() {
 int tok_idx = next();
-int line_num = token_lines[tok_idx];
-char* var_name = token_pool + token_values[tok_idx];
-char* var_type = get_symbol_type(0, var_name);
-char* right_type;
-if (strcmp(var_type, "") == 0) {
-printf("%s\n", concat("Error: Undeclared identifier '", concat(var_name, concat("' on line ", itos(line_num)))));
+int tok_type = tok_kind(tok_idx);
+int tok_pos = tok_start(tok_idx);
+char* var_name;
+if (tok_type == TK_NUMBER) {
+expr_type = TY_INT;
+return new_expr(EX_LEAF, tok_type, tok_pos, tok_len(tok_idx));
+}
+else if (tok_type == TK_CHAR) {
+expr_type = TY_CHAR;
+return new_expr(EX_LEAF, tok_type, tok_pos, tok_len(tok_idx));
+}
+else if (tok_type == TK_STRING) {
+expr_type = TY_STR;
+return new_expr(EX_LEAF, tok_type, tok_pos, tok_len(tok_idx));
+}
+else if (tok_type == TK_LPAREN) {
+int inner = expr();
+expect(TK_RPAREN);
+int paren = new_node(EX_PAREN, 0, 2);
+ast[paren + 1] = inner;
+return paren;
+}
+else if (tok_type == TK_ID) {
+int sym_type = get_symbol_type(0, tok_sym(tok_idx));
+if (sym_type == TY_NONE) {
+var_name = sym_name(tok_sym(tok_idx));
+diag_add("Error: Undeclared identifier '");
+diag_add(var_name);
+diag_add("' on line ");
+diag_add(itos(line_of(tok_pos)));
+report_error();
 return -1;
 }
-if (strcmp(peek(), "ASSIGN") == 0) {
+if (peek() == TK_LPAREN) {
 next();
-emit(var_name);
-emit(" = ");
-expr();
-emit(";\n");
-right_type = expr_type;
-if (strcmp(var_type, right_type) != 0) {
-printf("%s\n", concat("Error: Incompatible ", concat(right_type, concat(" to ", concat(var_type, concat(" conversion on line ", itos(line_num)))))));
+int call = call_args(tok_idx);
+expr_type = sym_type;
+return call;
+}
+else if (peek() == TK_LSQUARE) {
+if (is_pointer(sym_type) == 0) {
+var_name = sym_name(tok_sym(tok_idx));
+diag_add("Error: Variable '");
+diag_add(var_name);
+diag_add("' is not an array and cannot be indexed, line ");
+diag_add(itos(line_of(tok_pos)));
+report_error();
 return -1;
 }
-expect("SEMICOL");
-return 0;
-}
-else if (strcmp(peek(), "LPAREN") == 0) {
+int name_len = tok_len(tok_idx);
 next();
-emit(var_name);
-emit("(");
+int index = expr();
+if (expr_type != TY_INT) {
+diag_add("Error: Array index must be an integer, line ");
+diag_add(itos(line_of(tok_pos)));
+report_error();
+return -1;
+}
+expect(TK_RSQUARE);
+expr_type = deref(sym_type);
+int node = new_node(EX_INDEX, 0, 4);
+ast[node + 1] = tok_pos;
+ast[node + 2] = name_len;
+ast[node + 3] = index;
+return node;
+}
+else {
+expr_type = sym_type;
+return new_expr(EX_LEAF, tok_type, tok_pos, tok_len(tok_idx));
+}
+}
+else {
+diag_add("Error: Unexpected token in expression: ");
+diag_add(token_name(tok_type));
+diag_add(" on line ");
+diag_add(itos(line_of(tok_pos)));
+syntax_error();
+return -1;
+}
+return -1;
+}
+int call_args(int tok_idx) {
+int name_pos = tok_start(tok_idx);
+int name_len = tok_len(tok_idx);
+int mark = ast_stack_top;
 int arg_count = 0;
-while (strcmp(peek(), "RPAREN") != 0) {
+while (peek() != TK_RPAREN && peek() != TK_EOF && panic_mode == 0) {
 if (arg_count > 0) {
-expect("COMMA");
-emit(", ");
+expect(TK_COMMA);
 }
-expr();
+push_node(expr());
 arg_count = arg_count + 1;
 }
-expect("RPAREN");
-expect("SEMICOL");
-emit(");\n");
+expect(TK_RPAREN);
+int n_args = ast_stack_top - mark;
+int call = new_node(EX_CALL, n_args, 3 + n_args);
+ast[call + 1] = name_pos;
+ast[call + 2] = name_len;
+pop_nodes(call + 3, mark);
+return call;
+}
+int new_expr(int kind, int value, int a, int b) {
+int node = new_node(kind, value, 3);
+ast[node + 1] = a;
+ast[node + 2] = b;
+return node;
+}
+int new_node(int kind, int value, int size) {
+while (ast_top + size > ast_cap) {
+ast_cap = ast_cap * 2 + 4096;
+ast = grow_ints(ast, ast_cap);
+}
+int node = ast_top;
+ast[node] = kind + value * 256;
+ast_top = ast_top + size;
+return node;
+}
+int node_kind(int node) {
+int word = ast[node];
+return word - (word / 256) * 256;
+}
+int node_value(int node) {
+return ast[node] / 256;
+}
+int push_node(int node) {
+if (node < 0) {
 return 0;
 }
-else if (strcmp(peek(), "LSQUARE") == 0) {
-next();
-if (str_ends_with(var_type, '*') == 0) {
-printf("%s\n", concat("Error: Variable '", concat(var_name, concat("' is not an array and cannot be indexed, line ", itos(line_num)))));
-return -1;
+if (ast_stack_top == ast_stack_cap) {
+ast_stack_cap = ast_stack_cap * 2 + 256;
+ast_stack = grow_ints(ast_stack, ast_stack_cap);
 }
-emit(var_name);
-emit("[");
-expr();
-emit("] = ");
-if (strcmp(expr_type, "int") != 0) {
-printf("%s\n", concat("Error: Array index must be an integer, got ", concat(expr_type, concat(", line ", itos(line_num)))));
-return -1;
+ast_stack[ast_stack_top] = node;
+ast_stack_top = ast_stack_top + 1;
+return 0;
 }
-expect("RSQUARE");
-expect("ASSIGN");
-expr();
-emit(";\n");
-right_type = expr_type;
-char* base_type = "int";
-if (strcmp(var_type, "int*") == 0) {
-base_type = "int";
+int pop_nodes(int dest, int mark) {
+int i = mark;
+while (i < ast_stack_top) {
+ast[dest + i - mark] = ast_stack[i];
+i = i + 1;
+}
+ast_stack_top = mark;
+return 0;
 }
-else if (strcmp(var_type, "char*") == 0) {
-base_type = "char";
+int ast_reset() {
+ast_top = 0;
+ast_stack_top = 0;
+return 0;
 }
-else if (strcmp(var_type, "char**") == 0) {
-base_type = "char*";
+int emit_program(int program) {
+int n = node_value(program);
+int i = 1;
+while (i <= n) {
+int decl = ast[program + i];
+if (node_kind(decl) == FN_DECL) {
+emit_fn(decl);
 }
-if (strcmp(base_type, right_type) != 0) {
-printf("%s\n", concat("Error: Incompatible types: cannot assign ", concat(right_type, concat(" to array element of type ", concat(base_type, concat(", line ", itos(line_num)))))));
-return -1;
+else {
+emit_stmt(decl);
+}
+i = i + 1;
 }
-expect("SEMICOL");
 return 0;
 }
-else {
-printf("%s\n", concat("Error: Invalid statement start. Expected '=', '(', or '[' after ID '", concat(var_name, concat("', line ", itos(line_num)))));
-return -1;
+int emit_fn(int fn) {
+emit(type_name(ast[fn + 1]));
+emit(" ");
+emit(sym_name(ast[fn + 2]));
+emit("(");
+int n_params = node_value(fn);
+int i = 0;
+while (i < n_params) {
+if (i > 0) {
+emit(", ");
 }
+int param = ast[fn + 4 + i];
+emit(type_name(ast[param + 1]));
+emit(" ");
+emit(sym_name(ast[param + 2]));
+if (node_value(param) == 1) {
+emit("[]");
 }
-int if_stmt() {
-expect("IF");
-emit("if (");
-expr();
-emit(") {\n");
-expect("LBRACE");
-while (strcmp(peek(), "RBRACE") != 0 && strcmp(peek(), "EOF") != 0) {
-statement();
+else if (node_value(param) == 2) {
+emit("[");
+emit_span(ast[param + 3], ast[param + 4]);
+emit("]");
 }
-expect("RBRACE");
-emit("}\n");
-if (strcmp(peek(), "ELSE") == 0) {
-next();
-emit("else ");
-if (strcmp(peek(), "IF") == 0) {
-if_stmt();
+i = i + 1;
 }
-else if (strcmp(peek(), "LBRACE") == 0) {
-next();
+emit(")");
+if (ast[fn + 3] < 0) {
+emit(";\n");
+}
+else {
+emit(" ");
+emit_stmt(ast[fn + 3]);
+}
+return 0;
+}
+int emit_stmt(int node) {
+int kind = node_kind(node);
+if (kind == ST_BLOCK) {
 emit("{\n");
-while (strcmp(peek(), "RBRACE") != 0 && strcmp(peek(), "EOF") != 0) {
-statement();
+int n = node_value(node);
+int i = 1;
+while (i <= n) {
+emit_stmt(ast[node + i]);
+i = i + 1;
 }
-expect("RBRACE");
 emit("}\n");
 }
-else {
-int tok_line = token_lines[parser_pos];
-printf("%s\n", concat("Error: Expected 'if' or '{' after 'else', line ", itos(tok_line)));
-return -1;
+else if (kind == ST_LET) {
+emit(type_name(ast[node + 1]));
+emit(" ");
+emit(sym_name(ast[node + 2]));
+emit(" = ");
+emit_expr(ast[node + 3]);
+emit(";\n");
 }
+else if (kind == ST_ARRAY) {
+emit(type_name(ast[node + 1]));
+emit(" ");
+emit(sym_name(ast[node + 2]));
+emit("[");
+emit_span(ast[node + 3], ast[node + 4]);
+emit("];\n");
 }
-return 0;
+else if (kind == ST_DECL) {
+emit(type_name(ast[node + 1]));
+emit(" ");
+emit(sym_name(ast[node + 2]));
+emit(";\n");
 }
-int while_stmt() {
-expect("WHILE");
-emit("while (");
-expr();
-emit(") {\n");
-expect("LBRACE");
-while (strcmp(peek(), "RBRACE") != 0 && strcmp(peek(), "EOF") != 0) {
-statement();
+else if (kind == ST_PRINT) {
+char* format = "printf(\"%d\\n\", ";
+if (node_value(node) == 1) {
+format = "printf(\"%c\\n\", ";
 }
-expect("RBRACE");
-emit("}\n");
-return 0;
+if (node_value(node) == 2) {
+format = "printf(\"%s\\n\", ";
 }
-int return_stmt() {
-int line_num = token_lines[parser_pos];
-expect("RETURN");
+emit(format);
+emit_expr(ast[node + 1]);
+emit(");\n");
+}
+else if (kind == ST_ASSIGN) {
+emit(sym_name(ast[node + 1]));
+emit(" = ");
+emit_expr(ast[node + 2]);
+emit(";\n");
+}
+else if (kind == ST_STORE) {
+emit(sym_name(ast[node + 1]));
+emit("[");
+emit_expr(ast[node + 2]);
+emit("] = ");
+emit_expr(ast[node + 3]);
+emit(";\n");
+}
+else if (kind == ST_CALL) {
+emit_expr(ast[node + 1]);
+emit(";\n");
+}
+else if (kind == ST_IF) {
+emit("if (");
+emit_expr(ast[node + 1]);
+emit(") ");
+emit_stmt(ast[node + 2]);
+if (ast[node + 3] >= 0) {
+emit("else ");
+emit_stmt(ast[node + 3]);
+}
+}
+else if (kind == ST_WHILE) {
+emit("while (");
+emit_expr(ast[node + 1]);
+emit(") ");
+emit_stmt(ast[node + 2]);
+}
+else if (kind == ST_RETURN) {
 emit("return ");
-expr();
+emit_expr(ast[node + 1]);
 emit(";\n");
-char* ret_type = expr_type;
-expect("SEMICOL");
-if (strcmp(current_fn_ret_type, ret_type) != 0) {
-printf("%s\n", concat("Error: Incompatible ", concat(ret_type, concat(" to ", concat(current_fn_ret_type, concat(" conversion on line ", itos(line_num)))))));
-return -1;
 }
 return 0;
 }
-int expr() {
-return logical();
-}
-int logical() {
-relational();
-char* left_type = expr_type;
-while (strcmp(peek(), "OR") == 0 || strcmp(peek(), "AND") == 0) {
-int op_idx = next();
-char* op = op_to_c_op(token_types[op_idx]);
-emit(" ");
-emit(op);
-emit(" ");
-logical();
-char* right_type = expr_type;
-if (strcmp(left_type, "int") != 0 || strcmp(right_type, "int") != 0) {
-printf("%s\n", concat("Error: Logical operators '&&' and '||' can only be used on integers, line ", itos(token_lines[op_idx])));
+int emit_expr(int node) {
+if (node < 0) {
 return -1;
 }
-expr_type = "int";
-left_type = "int";
+int kind = node_kind(node);
+if (kind == EX_LEAF) {
+if (node_value(node) == TK_CHAR) {
+emit("'");
+emit_span(ast[node + 1], ast[node + 2]);
+emit("'");
+}
+else if (node_value(node) == TK_STRING) {
+emit("\"");
+emit_span(ast[node + 1], ast[node + 2]);
+emit("\"");
+}
+else {
+emit_span(ast[node + 1], ast[node + 2]);
 }
-expr_type = left_type;
-return 0;
 }
-int relational() {
-char* left_ptr = peek_code("additive");
-char* left_type = expr_type;
-char left_buf[2048];
+else if (kind == EX_BINARY) {
+emit_expr(ast[node + 1]);
+emit(" ");
+emit(op_to_c_op(node_value(node)));
+emit(" ");
+emit_expr(ast[node + 2]);
+}
+else if (kind == EX_CALL) {
+emit_span(ast[node + 1], ast[node + 2]);
+emit("(");
+int n_args = node_value(node);
 int i = 0;
-while (left_ptr[i] != '\0') {
-left_buf[i] = left_ptr[i];
+while (i < n_args) {
+if (i > 0) {
+emit(", ");
+}
+emit_expr(ast[node + 3 + i]);
 i = i + 1;
 }
-left_buf[i] = '\0';
-if (strcmp(peek(), "EQ") == 0 || strcmp(peek(), "NE") == 0 || strcmp(peek(), "LT") == 0 || strcmp(peek(), "GT") == 0 || strcmp(peek(), "LE") == 0 || strcmp(peek(), "GE") == 0) {
-while (strcmp(peek(), "EQ") == 0 || strcmp(peek(), "NE") == 0 || strcmp(peek(), "LT") == 0 || strcmp(peek(), "GT") == 0 || strcmp(peek(), "LE") == 0 || strcmp(peek(), "GE") == 0) {
-int op_idx = next();
-char* op = op_to_c_op(token_types[op_idx]);
-int line = token_lines[op_idx];
-char* right_code = peek_code("relational");
-char* right_type = expr_type;
-if (strcmp(left_type, "char*") == 0 && strcmp(right_type, "char*") == 0) {
-if (strcmp(op, "==") == 0) {
-emit("strcmp(");
-emit(left_buf);
+emit(")");
+}
+else if (kind == EX_INDEX) {
+emit_span(ast[node + 1], ast[node + 2]);
+emit("[");
+emit_expr(ast[node + 3]);
+emit("]");
+}
+else if (kind == EX_PAREN) {
+emit("(");
+emit_expr(ast[node + 1]);
+emit(")");
+}
+else if (kind == EX_NEG) {
+emit("-");
+emit_expr(ast[node + 1]);
+}
+else if (kind == EX_CONCAT) {
+emit("concat(");
+emit_expr(ast[node + 1]);
 emit(", ");
-emit(right_code);
-emit(") == 0");
+emit_expr(ast[node + 2]);
+emit(")");
 }
-else if (strcmp(op, "!=") == 0) {
-emit("strcmp(");
-emit(left_buf);
+else if (kind == EX_STRCMP) {
+int str = ast[node + 1];
+int lit = ast[node + 2];
+if (node_kind(str) == EX_LEAF && node_value(str) == TK_STRING) {
+str = ast[node + 2];
+lit = ast[node + 1];
+}
+if (node_kind(lit) == EX_LEAF && node_value(lit) == TK_STRING) {
+if (node_value(node) == TK_NE) {
+emit("!");
+}
+emit("str_is(");
+emit_expr(str);
 emit(", ");
-emit(right_code);
-emit(") != 0");
+emit_expr(lit);
+emit(")");
 }
 else {
-printf("%s\n", concat("Error: Operator '", concat(op, concat("' not allowed on strings, line ", itos(line)))));
+emit("strcmp(");
+emit_expr(ast[node + 1]);
+emit(", ");
+emit_expr(ast[node + 2]);
+emit(") ");
+emit(op_to_c_op(node_value(node)));
+emit(" 0");
+}
+}
+else if (kind == EX_PTR_ADD) {
+emit_expr(ast[node + 1]);
+emit("+");
+emit_expr(ast[node + 2]);
+}
+return 0;
+}
+int peek() {
+if (parser_pos == n_tokens) {
+lex_fill(TOKEN_WINDOW / 2);
+}
+return tok_kind(parser_pos);
+}
+int next() {
+if (parser_pos == n_tokens) {
+lex_fill(TOKEN_WINDOW / 2);
+}
+int current_pos = parser_pos;
+parser_pos = parser_pos + 1;
+return current_pos;
+}
+int expect(int kind) {
+int tok_type = peek();
+if (tok_type == kind) {
+if (kind == TK_SEMICOL || kind == TK_LBRACE || kind == TK_RBRACE) {
+panic_mode = 0;
+}
+return next();
+}
+int tok_line = tok_lineno(parser_pos);
+diag_add("Error: Syntax Error on line ");
+diag_add(itos(tok_line));
+diag_add("\nExpected token: ");
+diag_add(token_name(kind));
+diag_add("\n... but got token: ");
+diag_add(token_name(tok_type));
+syntax_error();
 return -1;
 }
+int diag_add(char* s) {
+int len = strlen(s);
+if (diag_len + msg_len + len + 2 > diag_cap) {
+diag_cap = (diag_len + msg_len + len + 2) * 2;
+diag_mem = grow_chars(diag_mem, diag_cap);
 }
-else if ((strcmp(left_type, "char*") == 0 && strcmp(right_type, "int") == 0) || (strcmp(left_type, "int") == 0 && strcmp(right_type, "char*") == 0)) {
-if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0) {
-emit(left_buf);
-emit(" ");
-emit(op);
-emit(" ");
-emit(right_code);
+copy_chars(diag_mem + diag_len + msg_len, s, len);
+msg_len = msg_len + len;
+diag_mem[diag_len + msg_len] = '\0';
+return 0;
 }
-else {
-printf("%s\n", concat("Error: Operator '", concat(op, concat("' not allowed on strings, line ", itos(line)))));
+int diag_drop() {
+msg_len = 0;
+diag_mem[diag_len] = '\0';
+return 0;
+}
+int report_error() {
+if (panic_mode == 1) {
+diag_drop();
 return -1;
 }
+return add_error();
 }
-else if (strcmp(left_type, "char*") == 0 || strcmp(right_type, "char*") == 0) {
-printf("%s\n", concat("Error: Comparison between string and non-string, line ", itos(line)));
+int add_error() {
+if (n_errors >= MAX_ERRORS) {
+diag_drop();
 return -1;
 }
-else {
-emit(left_buf);
-emit(" ");
-emit(op);
-emit(" ");
-emit(right_code);
+n_errors = n_errors + 1;
+if (n_errors == MAX_ERRORS) {
+diag_add("\nError: Too many errors, stopping.");
 }
-expr_type = "int";
-left_type = "int";
+if (print_errors == 1) {
+printf("%s\n", diag_mem + diag_len);
+diag_drop();
+return -1;
+}
+diag_mem[diag_len + msg_len] = '\n';
+diag_mem[diag_len + msg_len + 1] = '\0';
+diag_len = diag_len + msg_len + 1;
+msg_len = 0;
+diagnostics = diag_mem;
+return -1;
 }
+int syntax_error() {
+if (lex_failed == 0 || peek() != TK_EOF) {
+report_error();
 }
 else {
-emit(left_buf);
-expr_type = left_type;
+diag_drop();
 }
+panic_mode = 1;
+return -1;
+}
+int synchronize(int is_global) {
+int tok = peek();
+if (is_global == 1) {
+while (tok != TK_FN && tok != TK_LET && tok != TK_EOF) {
+next();
+tok = peek();
+}
+panic_mode = 0;
 return 0;
 }
-int additive() {
-char* left_ptr = peek_code("multiplicative");
-char* left_type = expr_type;
-char left_buf[2048];
-int i = 0;
-while (left_ptr[i] != '\0') {
-left_buf[i] = left_ptr[i];
-i = i + 1;
+if (parser_pos > 0) {
+int prev = tok_kind(parser_pos - 1);
+if (prev == TK_SEMICOL || prev == TK_RBRACE) {
+panic_mode = 0;
+return 0;
 }
-left_buf[i] = '\0';
-if (strcmp(peek(), "PLUS") == 0 || strcmp(peek(), "MINUS") == 0) {
-while (strcmp(peek(), "PLUS") == 0 || strcmp(peek(), "MINUS") == 0) {
-int op_idx = next();
-char* op = op_to_c_op(token_types[op_idx]);
-int line = token_lines[op_idx];
-char* right_code = peek_code("additive");
-char* right_type = expr_type;
-if (strcmp(left_type, "int") == 0 && strcmp(right_type, "int") == 0) {
-emit(left_buf);
-emit(" ");
-emit(op);
-emit(" ");
-emit(right_code);
-expr_type = "int";
 }
-else if (str_ends_with(left_type, '*') && strcmp(right_type, "int") == 0) {
-emit(left_buf);
-emit(" ");
-emit(op);
-emit(" ");
-emit(right_code);
-expr_type = left_type;
+while (tok != TK_SEMICOL && tok != TK_RBRACE && tok != TK_EOF && tok != TK_FN && tok != TK_LET && tok != TK_PRINT && tok != TK_IF && tok != TK_WHILE && tok != TK_RETURN) {
+next();
+tok = peek();
 }
-else if (strcmp(left_type, "int") == 0 && str_ends_with(right_type, '*')) {
-if (strcmp(op, "+") == 0) {
-emit(left_buf);
-emit(op);
-emit(right_code);
-expr_type = right_type;
+if (tok == TK_SEMICOL) {
+next();
+}
+panic_mode = 0;
+return 0;
+}
+char* token_name(int kind) {
+if (kind == TK_EOF) {
+return "EOF";
+}
+if (kind == TK_ID) {
+return "ID";
+}
+if (kind == TK_NUMBER) {
+return "NUMBER";
+}
+if (kind == TK_STRING) {
+return "STRING";
+}
+if (kind == TK_CHAR) {
+return "CHAR";
+}
+if (kind == TK_TYPE) {
+return "TYPE";
+}
+if (kind == TK_FN) {
+return "FN";
+}
+if (kind == TK_LET) {
+return "LET";
+}
+if (kind == TK_PRINT) {
+return "PRINT";
+}
+if (kind == TK_IF) {
+return "IF";
+}
+if (kind == TK_ELSE) {
+return "ELSE";
+}
+if (kind == TK_WHILE) {
+return "WHILE";
+}
+if (kind == TK_RETURN) {
+return "RETURN";
+}
+if (kind == TK_ASSIGN) {
+return "ASSIGN";
+}
+if (kind == TK_EQ) {
+return "EQ";
+}
+if (kind == TK_NE) {
+return "NE";
+}
+if (kind == TK_LT) {
+return "LT";
+}
+if (kind == TK_GT) {
+return "GT";
+}
+if (kind == TK_LE) {
+return "LE";
+}
+if (kind == TK_GE) {
+return "GE";
+}
+if (kind == TK_AND) {
+return "AND";
+}
+if (kind == TK_OR) {
+return "OR";
+}
+if (kind == TK_PLUS) {
+return "PLUS";
+}
+if (kind == TK_MINUS) {
+return "MINUS";
+}
+if (kind == TK_MUL) {
+return "MUL";
+}
+if (kind == TK_DIV) {
+return "DIV";
+}
+if (kind == TK_LPAREN) {
+return "LPAREN";
+}
+if (kind == TK_RPAREN) {
+return "RPAREN";
+}
+if (kind == TK_LBRACE) {
+return "LBRACE";
+}
+if (kind == TK_RBRACE) {
+return "RBRACE";
+}
+if (kind == TK_LSQUARE) {
+return "LSQUARE";
+}
+if (kind == TK_RSQUARE) {
+return "RSQUARE";
+}
+if (kind == TK_SEMICOL) {
+return "SEMICOL";
+}
+if (kind == TK_COMMA) {
+return "COMMA";
+}
+return "UNKNOWN";
+}
+int tok_rec(int idx) {
+if (idx < 0) {
+return TOKEN_WINDOW * TOKEN_REC;
+}
+int rec = next_rec - (n_tokens - idx) * TOKEN_REC;
+if (rec < 0) {
+rec = rec + TOKEN_WINDOW * TOKEN_REC;
+}
+return rec;
+}
+int tok_kind(int idx) {
+int packed = token_recs[tok_rec(idx)];
+return packed - (packed / 256) * 256;
+}
+int tok_start(int idx) {
+return token_recs[tok_rec(idx) + 1];
+}
+int tok_len(int idx) {
+return token_recs[tok_rec(idx)] / 256;
+}
+int tok_lineno(int idx) {
+return line_of(tok_start(idx));
+}
+int line_of(int pos) {
+if (n_lines == 0) {
+int p = 0;
+while (p >= 0) {
+if (n_lines == line_cap) {
+line_cap = line_cap * 2 + 1024;
+line_starts = grow_ints(line_starts, line_cap);
+}
+line_starts[n_lines] = p;
+n_lines = n_lines + 1;
+p = scan_line_end(source_buf, p);
+if (source_buf[p] == '\0') {
+p = -1;
 }
 else {
-printf("%s\n", concat("Error: Cannot subtract a pointer from an integer, line ", itos(line)));
-return -1;
+p = p + 1;
 }
 }
-else if (strcmp(left_type, "char*") == 0 && strcmp(right_type, "char*") == 0 && strcmp(op, "+") == 0) {
-emit("concat(");
-emit(left_buf);
-emit(", ");
-emit(right_code);
-emit(")");
-expr_type = "char*";
+}
+int lo = 0;
+int hi = n_lines - 1;
+int mid;
+while (lo < hi) {
+mid = (lo + hi + 1) / 2;
+if (line_starts[mid] <= pos) {
+lo = mid;
 }
 else {
-printf("%s\n", concat("Error: Operator '", concat(op, concat("' not allowed between '", concat(left_type, concat("' and '", concat(right_type, concat("', line ", itos(line)))))))));
-return -1;
+hi = mid - 1;
 }
-left_type = expr_type;
 }
+return lo + 1;
+}
+int tok_sym(int idx) {
+return intern(source_buf + tok_start(idx), tok_len(idx));
+}
+int type_of_tok(int idx) {
+char c = source_buf[tok_start(idx)];
+int len = tok_len(idx);
+if (c == 'i') {
+return TY_INT + (len - 3) * TYPE_PTR;
+}
+if (c == 'c') {
+return TY_CHAR + (len - 4) * TYPE_PTR;
+}
+return TY_VOID;
+}
+int pointer_to(int type) {
+return type + TYPE_PTR;
+}
+int deref(int type) {
+return type - TYPE_PTR;
+}
+int is_pointer(int type) {
+return type >= TYPE_PTR;
+}
+char* type_name(int type) {
+while (n_type_names <= type) {
+if (n_type_names == type_name_cap) {
+type_name_cap = type_name_cap * 2 + 16;
+type_names = grow_strs(type_names, type_name_cap);
+}
+if (n_type_names == TY_NONE) {
+type_names[n_type_names] = "undefined";
+}
+else if (n_type_names == TY_VOID) {
+type_names[n_type_names] = "void";
+}
+else if (n_type_names == TY_INT) {
+type_names[n_type_names] = "int";
+}
+else if (n_type_names == TY_CHAR) {
+type_names[n_type_names] = "char";
 }
 else {
-emit(left_buf);
-expr_type = left_type;
+type_names[n_type_names] = concat(type_names[deref(n_type_names)], "*");
 }
-expr_type = left_type;
-return 0;
+n_type_names = n_type_names + 1;
 }
-int multiplicative() {
-unary();
-char* left_type = expr_type;
-while (strcmp(peek(), "MUL") == 0 || strcmp(peek(), "DIV") == 0) {
-int op_idx = next();
-char* op = op_to_c_op(token_types[op_idx]);
-emit(" ");
-emit(op);
-emit(" ");
-unary();
-char* right_type = expr_type;
-if (strcmp(left_type, "int") != 0 || strcmp(right_type, "int") != 0) {
-printf("%s\n", concat("Error: Operators '*' and '/' can only be used on integers, line ", itos(token_lines[op_idx])));
-return -1;
+return type_names[type];
+}
+int clear_local_symbols() {
+n_locals = 0;
+n_scopes = 0;
+local_gen = local_gen + 1;
+return 0;
 }
-expr_type = "int";
-left_type = "int";
+int enter_scope() {
+if (n_scopes == scope_cap) {
+scope_cap = scope_cap * 2 + 16;
+scope_marks = grow_ints(scope_marks, scope_cap);
 }
-expr_type = left_type;
+scope_marks[n_scopes] = n_locals;
+n_scopes = n_scopes + 1;
 return 0;
 }
-int unary() {
-if (strcmp(peek(), "MINUS") == 0) {
-int op_idx = next();
-emit("-");
-unary();
-if (strcmp(expr_type, "int") != 0) {
-printf("%s\n", concat("Error: Unary '-' operator can only be applied to integers, line ", itos(token_lines[op_idx])));
-return -1;
+int leave_scope() {
+n_scopes = n_scopes - 1;
+while (n_locals > scope_marks[n_scopes]) {
+n_locals = n_locals - 1;
+local_stamps[local_slot_of[n_locals]] = 0;
 }
-expr_type = "int";
 return 0;
 }
-return atom();
+int clear_global_symbols() {
+n_globals = 0;
+global_gen = global_gen + 1;
+return 0;
 }
-int atom() {
-int tok_idx = next();
-char* tok_type = token_types[tok_idx];
-int tok_val_idx = token_values[tok_idx];
-int tok_line = token_lines[tok_idx];
-if (strcmp(tok_type, "NUMBER") == 0) {
-expr_type = "int";
-emit(token_pool + tok_val_idx);
-}
-else if (strcmp(tok_type, "CHAR") == 0) {
-expr_type = "char";
-emit("'");
-emit(token_pool + tok_val_idx);
-emit("'");
+int get_symbol_type(int is_global, int sym) {
+int i;
+if (is_global == 0) {
+i = find_symbol(0, sym);
+if (i >= 0) {
+return local_types[i];
 }
-else if (strcmp(tok_type, "STRING") == 0) {
-expr_type = "char*";
-emit("\"");
-emit(token_pool + tok_val_idx);
-emit("\"");
 }
-else if (strcmp(tok_type, "LPAREN") == 0) {
-emit("(");
-expr();
-emit(")");
-expect("RPAREN");
+i = find_symbol(1, sym);
+if (i >= 0) {
+return global_types[i];
+}
+return TY_NONE;
 }
-else if (strcmp(tok_type, "ID") == 0) {
-char* var_name = token_pool + tok_val_idx;
-char* sym_type = get_symbol_type(0, var_name);
-if (strcmp(sym_type, "") == 0) {
-printf("%s\n", concat("Error: Undeclared identifier '", concat(var_name, concat("' on line ", itos(tok_line)))));
+int find_symbol(int is_global, int sym) {
+int slot;
+int i;
+if (is_global == 0) {
+if (local_slot_cap == 0) {
 return -1;
 }
-if (strcmp(peek(), "LPAREN") == 0) {
-next();
-emit(var_name);
-emit("(");
-int arg_count = 0;
-while (strcmp(peek(), "RPAREN") != 0) {
-if (arg_count > 0) {
-expect("COMMA");
-emit(", ");
+slot = sym - (sym / local_slot_cap) * local_slot_cap;
+while (local_stamps[slot] == local_gen) {
+i = local_slots[slot];
+if (local_syms[i] == sym) {
+return i;
 }
-expr();
-arg_count = arg_count + 1;
+slot = slot + 1;
+if (slot == local_slot_cap) {
+slot = 0;
 }
-expr_type = sym_type;
-expect("RPAREN");
-emit(")");
 }
-else if (strcmp(peek(), "LSQUARE") == 0) {
-if (str_ends_with(sym_type, '*') == 0) {
-printf("%s\n", concat("Error: Variable '", concat(var_name, concat("' is not an array and cannot be indexed, line ", itos(tok_line)))));
-return -1;
 }
-next();
-emit(var_name);
-emit("[");
-expr();
-if (strcmp(expr_type, "int") != 0) {
-printf("%s\n", concat("Error: Array index must be an integer, line ", itos(tok_line)));
+else {
+if (global_slot_cap == 0) {
 return -1;
 }
-expect("RSQUARE");
-emit("]");
-if (strcmp(sym_type, "int*") == 0) {
-expr_type = "int";
+slot = sym - (sym / global_slot_cap) * global_slot_cap;
+while (global_stamps[slot] == global_gen) {
+i = global_slots[slot];
+if (global_syms[i] == sym) {
+return i;
+}
+slot = slot + 1;
+if (slot == global_slot_cap) {
+slot = 0;
+}
 }
-else if (strcmp(sym_type, "char*") == 0) {
-expr_type = "char";
 }
-else if (strcmp(sym_type, "char**") == 0) {
-expr_type = "char*";
+return -1;
+}
+int add_symbol(int is_global, int sym, int type) {
+if (is_global == 0) {
+if (n_locals == local_cap) {
+local_cap = local_cap * 2 + 64;
+local_syms = grow_ints(local_syms, local_cap);
+local_types = grow_ints(local_types, local_cap);
+local_slot_of = grow_ints(local_slot_of, local_cap);
+}
+local_syms[n_locals] = sym;
+local_types[n_locals] = type;
+n_locals = n_locals + 1;
+if (n_locals * 2 > local_slot_cap) {
+rehash_symbols(0);
 }
 else {
-expr_type = "int";
+insert_slot(0, n_locals - 1);
 }
 }
 else {
-expr_type = sym_type;
-emit(var_name);
+if (n_globals == global_cap) {
+global_cap = global_cap * 2 + 64;
+global_syms = grow_ints(global_syms, global_cap);
+global_types = grow_ints(global_types, global_cap);
 }
+global_syms[n_globals] = sym;
+global_types[n_globals] = type;
+n_globals = n_globals + 1;
+if (n_globals * 2 > global_slot_cap) {
+rehash_symbols(1);
 }
 else {
-printf("%s\n", concat("Error: Unexpected token in expression: ", concat(tok_type, concat(" on line ", itos(tok_line)))));
-return -1;
+insert_slot(1, n_globals - 1);
+}
 }
 return 0;
 }
-char* peek() {
-return token_types[parser_pos];
+int insert_slot(int is_global, int i) {
+int slot;
+if (is_global == 0) {
+slot = local_syms[i] - (local_syms[i] / local_slot_cap) * local_slot_cap;
+while (local_stamps[slot] == local_gen) {
+slot = slot + 1;
+if (slot == local_slot_cap) {
+slot = 0;
 }
-int next() {
-int current_pos = parser_pos;
-parser_pos = parser_pos + 1;
-return current_pos;
 }
-int expect(char* kind) {
-char* tok_type = peek();
-if (strcmp(tok_type, kind) == 0) {
-return next();
+local_slots[slot] = i;
+local_stamps[slot] = local_gen;
+local_slot_of[i] = slot;
 }
-int tok_line = token_lines[parser_pos];
-printf("%s\n", concat("Error: Syntax Error on line ", itos(tok_line)));
-printf("%s\n", concat("Expected token: ", kind));
-printf("%s\n", concat("... but got token: ", tok_type));
-return -1;
+else {
+slot = global_syms[i] - (global_syms[i] / global_slot_cap) * global_slot_cap;
+while (global_stamps[slot] == global_gen) {
+slot = slot + 1;
+if (slot == global_slot_cap) {
+slot = 0;
+}
+}
+global_slots[slot] = i;
+global_stamps[slot] = global_gen;
 }
-int clear_local_symbols() {
-n_locals = 0;
 return 0;
 }
-char* get_symbol_type(int is_global, char* name) {
+int rehash_symbols(int is_global) {
 int i = 0;
+int n;
 if (is_global == 0) {
-while (i < n_locals) {
-if (strcmp(local_names[i], name) == 0) {
-return local_types[i];
+local_slot_cap = local_slot_cap * 2 + 64;
+local_slots = grow_ints(local_slots, local_slot_cap);
+local_stamps = grow_ints(local_stamps, local_slot_cap);
+while (i < local_slot_cap) {
+local_stamps[i] = 0;
+i = i + 1;
+}
+n = n_locals;
+}
+else {
+global_slot_cap = global_slot_cap * 2 + 64;
+global_slots = grow_ints(global_slots, global_slot_cap);
+global_stamps = grow_ints(global_stamps, global_slot_cap);
+while (i < global_slot_cap) {
+global_stamps[i] = 0;
+i = i + 1;
+}
+n = n_globals;
 }
+i = 0;
+while (i < n) {
+insert_slot(is_global, i);
+i = i + 1;
+}
+return 0;
+}
+int intern(char* s, int len) {
+int hash = name_hash(s, len);
+int slot;
+int id;
+if (n_interned * 2 >= intern_slot_cap) {
+rehash_names();
+}
+slot = hash - (hash / intern_slot_cap) * intern_slot_cap;
+while (intern_slots[slot] >= 0) {
+id = intern_slots[slot];
+if (intern_hashes[id] == hash && name_equals(intern_names[id], s, len)) {
+return id;
+}
+slot = slot + 1;
+if (slot == intern_slot_cap) {
+slot = 0;
+}
+}
+if (n_interned == intern_cap) {
+intern_cap = intern_cap * 2 + 256;
+intern_names = grow_strs(intern_names, intern_cap);
+intern_hashes = grow_ints(intern_hashes, intern_cap);
+intern_name_caps = grow_ints(intern_name_caps, intern_cap);
+}
+id = n_interned;
+if (id == n_name_bufs) {
+intern_names[id] = substr(s, 0, len);
+intern_name_caps[id] = len + 1;
+n_name_bufs = n_name_bufs + 1;
+}
+else {
+if (intern_name_caps[id] < len + 1) {
+intern_name_caps[id] = len + 1;
+intern_names[id] = grow_chars(intern_names[id], len + 1);
+}
+char* name = intern_names[id];
+copy_chars(name, s, len);
+name[len] = '\0';
+}
+intern_hashes[id] = hash;
+intern_slots[slot] = id;
+n_interned = n_interned + 1;
+return id;
+}
+int intern_str(char* s) {
+return intern(s, strlen(s));
+}
+int intern_reset() {
+int i = 0;
+while (i < intern_slot_cap) {
+intern_slots[i] = -1;
 i = i + 1;
 }
+n_interned = 0;
+return 0;
 }
-else {
-while (i < n_globals) {
-if (strcmp(global_names[i], name) == 0) {
-return global_types[i];
+char* sym_name(int sym) {
+return intern_names[sym];
+}
+int name_equals(char* name, char* s, int len) {
+int i = 0;
+while (i < len) {
+if (name[i] != s[i]) {
+return 0;
 }
 i = i + 1;
 }
+if (name[len] != '\0') {
+return 0;
 }
-if (is_global == 0) {
-return get_symbol_type(1, name);
+return 1;
 }
-return "";
+int name_hash(char* s, int len) {
+int h = len;
+int i = 0;
+while (i < len) {
+h = h * 31 + ctoi(s[i]);
+h = h - (h / 1000003) * 1000003;
+i = i + 1;
 }
-int add_symbol(int is_global, char* name, char* type) {
-if (is_global == 0) {
-local_names[n_locals] = name;
-local_types[n_locals] = type;
-n_locals = n_locals + 1;
+return h;
 }
-else {
-global_names[n_globals] = name;
-global_types[n_globals] = type;
-n_globals = n_globals + 1;
+int rehash_names() {
+int i = 0;
+int slot;
+intern_slot_cap = intern_slot_cap * 2 + 512;
+intern_slots = grow_ints(intern_slots, intern_slot_cap);
+while (i < intern_slot_cap) {
+intern_slots[i] = -1;
+i = i + 1;
 }
-return 0;
+i = 0;
+while (i < n_interned) {
+slot = intern_hashes[i] - (intern_hashes[i] / intern_slot_cap) * intern_slot_cap;
+while (intern_slots[slot] >= 0) {
+slot = slot + 1;
+if (slot == intern_slot_cap) {
+slot = 0;
 }
-int str_ends_with(char* s, char c) {
-int len = strlen(s);
-if (len == 0) {
-return 0;
 }
-if (s[len - 1] == c) {
-return 1;
+intern_slots[slot] = i;
+i = i + 1;
 }
 return 0;
 }
-char* op_to_c_op(char* tok_type) {
-if (strcmp(tok_type, "PLUS") == 0) {
+char* op_to_c_op(int tok_type) {
+if (tok_type == TK_PLUS) {
 return "+";
 }
-if (strcmp(tok_type, "MINUS") == 0) {
+if (tok_type == TK_MINUS) {
 return "-";
 }
-if (strcmp(tok_type, "MUL") == 0) {
+if (tok_type == TK_MUL) {
 return "*";
 }
-if (strcmp(tok_type, "DIV") == 0) {
+if (tok_type == TK_DIV) {
 return "/";
 }
-if (strcmp(tok_type, "EQ") == 0) {
+if (tok_type == TK_EQ) {
 return "==";
 }
-if (strcmp(tok_type, "NE") == 0) {
+if (tok_type == TK_NE) {
 return "!=";
 }
-if (strcmp(tok_type, "LT") == 0) {
+if (tok_type == TK_LT) {
 return "<";
 }
-if (strcmp(tok_type, "GT") == 0) {
+if (tok_type == TK_GT) {
 return ">";
 }
-if (strcmp(tok_type, "LE") == 0) {
+if (tok_type == TK_LE) {
 return "<=";
 }
-if (strcmp(tok_type, "GE") == 0) {
+if (tok_type == TK_GE) {
 return ">=";
 }
-if (strcmp(tok_type, "AND") == 0) {
+if (tok_type == TK_AND) {
 return "&&";
 }
-if (strcmp(tok_type, "OR") == 0) {
+if (tok_type == TK_OR) {
 return "||";
 }
 return "";
 }
 int emit(char* s) {
 int i = 0;
-int len = strlen(s);
-if (c_code_pos + len >= 1000000) {
-printf("%s\n", "CRITICAL ERROR: C code output buffer overflow! Increase c_code_buffer size.");
-return -1;
+while (s[i] != '\0') {
+if (out_pos == OUT_BLOCK) {
+flush_output();
 }
-while (i < len) {
-c_code_buffer[c_code_pos] = s[i];
-c_code_pos = c_code_pos + 1;
+out_block[out_pos] = s[i];
+out_pos = out_pos + 1;
 i = i + 1;
 }
-c_code_buffer[c_code_pos] = '\0';
 return 0;
 }
-char* peek_code(char* level) {
-int start_pos = c_code_pos;
-if (strcmp(level, "expr") == 0) {
-expr();
+int emit_span(int start, int len) {
+return emit_chars(source_buf + start, len);
 }
-else if (strcmp(level, "logical") == 0) {
-logical();
+int emit_chars(char* s, int len) {
+if (out_pos + len <= OUT_BLOCK) {
+copy_chars(out_block + out_pos, s, len);
+out_pos = out_pos + len;
+return 0;
 }
-else if (strcmp(level, "relational") == 0) {
-relational();
+int n;
+while (len > 0) {
+if (out_pos == OUT_BLOCK) {
+flush_output();
 }
-else if (strcmp(level, "additive") == 0) {
-additive();
+n = OUT_BLOCK - out_pos;
+if (n > len) {
+n = len;
 }
-else if (strcmp(level, "multiplicative") == 0) {
-multiplicative();
+copy_chars(out_block + out_pos, s, n);
+out_pos = out_pos + n;
+s = s + n;
+len = len - n;
 }
-else if (strcmp(level, "unary") == 0) {
-unary();
+return 0;
 }
-else if (strcmp(level, "atom") == 0) {
-atom();
+int flush_output() {
+if (out_pos > 0 && out_fd < 0) {
+if (out_mem_len + out_pos >= out_mem_cap) {
+out_mem_cap = (out_mem_len + out_pos) * 2 + 1;
+out_mem = grow_chars(out_mem, out_mem_cap);
 }
-else {
-printf("%s\n", concat("Error: Unknown peek level: ", level));
-return "";
+copy_chars(out_mem + out_mem_len, out_block, out_pos);
+out_mem_len = out_mem_len + out_pos;
+out_mem[out_mem_len] = '\0';
 }
-int end_pos = c_code_pos;
-int len = end_pos - start_pos;
-if (len >= 4096) {
-printf("%s\n", "Error: Expression too complex to peek (max 4096 chars).");
-return "";
+else if (out_pos > 0) {
+if (write_chars(out_fd, out_block, out_pos) != out_pos) {
+out_failed = 1;
 }
-int i = 0;
-while (i < len) {
-expr_peek_buffer[i] = c_code_buffer[start_pos + i];
-i = i + 1;
 }
-expr_peek_buffer[i] = '\0';
-c_code_pos = start_pos;
-return expr_peek_buffer;
+out_pos = 0;
+return 0;
 }
 int c_include() {
 emit("#include <stdio.h>\n");
 emit("#include <stdlib.h>\n");
-emit("#include <string.h>\n\n");
+emit("#include <string.h>\n");
+emit("#include <fcntl.h>\n");
+emit("#include <signal.h>\n");
+emit("#include <sys/mman.h>\n");
+emit("#include <sys/stat.h>\n");
+emit("#include <sys/wait.h>\n");
+emit("#include <unistd.h>\n\n");
 return 0;
 }
 int c_prototype() {
 emit("char* concat(char* str1, char* str2);\n");
+emit("static inline int str_is(char* s, char* lit);\n");
 emit("char* itos(int x);\n");
-emit("char* ctos(char c);\n\n");
+emit("char* ctos(char c);\n");
+emit("int ctoi(char c);\n");
+emit("char* substr(char* s, int start, int len);\n");
+emit("char** grow_strs(char** a, int cap);\n");
+emit("char* grow_chars(char* a, int cap);\n");
+emit("int* grow_ints(int* a, int cap);\n");
+emit("int skip_spaces(char* s, int pos);\n");
+emit("int scan_ident(char* s, int pos);\n");
+emit("int scan_line_end(char* s, int pos);\n");
+emit("int scan_string_end(char* s, int pos);\n\n");
 emit("char* read_file(char* path);\n");
 emit("void write_file(char* path, char* content);\n");
+emit("int open_output(char* path);\n");
+emit("int write_chars(int fd, char* buf, int len);\n");
+emit("void copy_chars(char* dst, char* src, int len);\n");
+emit("int open_cc(char* cmd);\n");
+emit("int close_cc();\n");
+emit("int* shared_ints(int n);\n");
+emit("void free_shared(int* p, int n);\n");
+emit("int fork_worker();\n");
+emit("int wait_workers();\n");
+emit("void exit_worker();\n");
 return 0;
 }
 int c_helper() {
 emit("\nchar* concat(char* str1, char* str2) {\n");
-emit("static char buf[1024];\n");
-emit("snprintf(buf, sizeof(buf), \"%s%s\", str1, str2);\n");
+emit("size_t len1 = strlen(str1);\n");
+emit("char* buf = malloc(len1 + strlen(str2) + 1);\n");
+emit("memcpy(buf, str1, len1);\n");
+emit("strcpy(buf + len1, str2);\n");
 emit("return buf;\n}\n\n");
+emit("static inline int str_is(char* s, char* lit) {\n");
+emit("return s[0] == lit[0] && (lit[0] == '\\0' || strcmp(s + 1, lit + 1) == 0);\n}\n\n");
 emit("char* itos(int x) {\n");
 emit("static char buf[32];\n");
 emit("snprintf(buf, sizeof(buf), \"%d\", x);\n");
@@ -1016,404 +2119,723 @@ emit("static char buf[2];\n");
 emit("buf[0] = c;\n");
 emit("buf[1] = '\\0';\n");
 emit("return buf;\n}\n\n");
-emit("char* read_file(char* path) {\n");
-emit("FILE* f = fopen(path, \"rb\");\n");
-emit("if (!f) return NULL;\n");
-emit("fseek(f, 0, SEEK_END);\n");
-emit("long len = ftell(f);\n");
-emit("fseek(f, 0, SEEK_SET);\n");
+emit("int ctoi(char c) {\n");
+emit("return (unsigned char)c;\n}\n\n");
+emit("char* substr(char* s, int start, int len) {\n");
 emit("char* buf = malloc(len + 1);\n");
-emit("fread(buf, 1, len, f);\n");
+emit("memcpy(buf, s + start, len);\n");
+emit("buf[len] = '\\0';\n");
+emit("return buf;\n}\n\n");
+emit("char** grow_strs(char** a, int cap) {\n");
+emit("return realloc(a, cap * sizeof(char*));\n}\n\n");
+emit("char* grow_chars(char* a, int cap) {\n");
+emit("return realloc(a, cap);\n}\n\n");
+emit("int* grow_ints(int* a, int cap) {\n");
+emit("return realloc(a, cap * sizeof(int));\n}\n\n");
+emit("#if defined(__x86_64__)\n");
+emit("#include <immintrin.h>\n");
+emit("#endif\n\n");
+emit("static int scan_level = 0; // 0: scalar, 1: SSE2, 2: AVX2\n\n");
+emit("static inline int scan_stop(char c, int cls) {\n");
+emit("if (cls == 0) return c != ' ' && c != '\\t' && c != '\\n';\n");
+emit("if (cls == 1) return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_');\n");
+emit("if (cls == 2) return c == '\\n' || c == '\\0';\n");
+emit("return c == '\"' || c == '\\\\' || c == '\\0';\n");
+emit("}\n\n");
+emit("#if defined(__x86_64__)\n");
+emit("static inline __attribute__((always_inline)) unsigned scan_mask_sse2(__m128i v, int cls) {\n");
+emit("if (cls == 0) return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\t'))), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\n')))) & 0xFFFF;\n");
+emit("if (cls == 1) {\n");
+emit("__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), v));\n");
+emit("__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));\n");
+emit("__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));\n");
+emit("__m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));\n");
+emit("return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(lower, upper), _mm_or_si128(digit, under))) & 0xFFFF;\n");
+emit("}\n");
+emit("__m128i stop = _mm_cmpeq_epi8(v, _mm_setzero_si128());\n");
+emit("if (cls == 2) return _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\n'))));\n");
+emit("stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\"')));\n");
+emit("return _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\\\'))));\n");
+emit("}\n\n");
+emit("static inline __attribute__((always_inline)) int scan_sse2(char* s, int pos, int cls) {\n");
+emit("char* p = s + pos;\n");
+emit("char* a = (char*)((size_t)p & ~(size_t)15);\n");
+emit("unsigned mask = scan_mask_sse2(_mm_load_si128((__m128i*)a), cls) & (0xFFFFu << (p - a));\n");
+emit("while (mask == 0) {\n");
+emit("a = a + 16;\n");
+emit("mask = scan_mask_sse2(_mm_load_si128((__m128i*)a), cls);\n");
+emit("}\n");
+emit("return (int)(a - s) + __builtin_ctz(mask);\n");
+emit("}\n\n");
+emit("__attribute__((target(\"avx2\"), always_inline))\n");
+emit("static inline unsigned scan_mask_avx2(__m256i v, int cls) {\n");
+emit("if (cls == 0) return ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\t'))), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\n'))));\n");
+emit("if (cls == 1) {\n");
+emit("__m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));\n");
+emit("__m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));\n");
+emit("__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));\n");
+emit("__m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));\n");
+emit("return ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(lower, upper), _mm256_or_si256(digit, under)));\n");
+emit("}\n");
+emit("__m256i stop = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());\n");
+emit("if (cls == 2) return _mm256_movemask_epi8(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\n'))));\n");
+emit("stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"')));\n");
+emit("return _mm256_movemask_epi8(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\\\'))));\n");
+emit("}\n\n");
+emit("__attribute__((target(\"avx2\")))\n");
+emit("static int scan_avx2(char* s, int pos, int cls) {\n");
+emit("char* p = s + pos;\n");
+emit("char* a = (char*)((size_t)p & ~(size_t)31);\n");
+emit("unsigned mask = scan_mask_avx2(_mm256_load_si256((__m256i*)a), cls) & (0xFFFFFFFFu << (p - a));\n");
+emit("while (mask == 0) {\n");
+emit("a = a + 32;\n");
+emit("mask = scan_mask_avx2(_mm256_load_si256((__m256i*)a), cls);\n");
+emit("}\n");
+emit("return (int)(a - s) + __builtin_ctz(mask);\n");
+emit("}\n\n");
+emit("#endif\n\n");
+emit("static inline __attribute__((always_inline)) int scan(char* s, int pos, int cls) {\n");
+emit("// Short runs are the common case, check two bytes before going wide\n");
+emit("if (scan_stop(s[pos], cls)) return pos;\n");
+emit("if (scan_stop(s[pos + 1], cls)) return pos + 1;\n");
+emit("#if defined(__x86_64__)\n");
+emit("if (scan_level == 2) return scan_avx2(s, pos + 2, cls);\n");
+emit("if (scan_level == 1) return scan_sse2(s, pos + 2, cls);\n");
+emit("#endif\n");
+emit("while (!scan_stop(s[pos], cls)) pos++;\n");
+emit("return pos;\n");
+emit("}\n\n");
+emit("__attribute__((constructor))\n");
+emit("static void scan_init(void) {\n");
+emit("#if defined(__x86_64__)\n");
+emit("scan_level = __builtin_cpu_supports(\"avx2\") ? 2 : 1;\n");
+emit("#endif\n");
+emit("if (getenv(\"DAV_SCALAR_LEX\")) scan_level = 0;\n");
+emit("}\n\n");
+emit("int skip_spaces(char* s, int pos) {\n");
+emit("return scan(s, pos, 0);\n");
+emit("}\n\n");
+emit("int scan_ident(char* s, int pos) {\n");
+emit("return scan(s, pos, 1);\n");
+emit("}\n\n");
+emit("int scan_line_end(char* s, int pos) {\n");
+emit("return scan(s, pos, 2);\n");
+emit("}\n\n");
+emit("int scan_string_end(char* s, int pos) {\n");
+emit("return scan(s, pos, 3);\n");
+emit("}\n\n");
+emit("char* read_file(char* path) {\n");
+emit("int fd = strcmp(path, \"-\") == 0 ? 0 : open(path, O_RDONLY);\n");
+emit("if (fd < 0) return NULL;\n");
+emit("struct stat st;\n");
+emit("if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {\n");
+emit("size_t len = st.st_size;\n");
+emit("size_t page = sysconf(_SC_PAGESIZE);\n");
+emit("size_t span = (len / page + 1) * page;\n");
+emit("char* buf = mmap(NULL, span, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);\n");
+emit("if (buf != MAP_FAILED) {\n");
+emit("if (mmap(buf, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {\n");
+emit("madvise(buf, len, MADV_SEQUENTIAL);\n");
+emit("close(fd);\n");
+emit("return buf;\n");
+emit("}\n");
+emit("munmap(buf, span);\n");
+emit("}\n");
+emit("}\n");
+emit("size_t cap = 65536;\n");
+emit("size_t len = 0;\n");
+emit("ssize_t n;\n");
+emit("char* buf = malloc(cap + 1);\n");
+emit("while ((n = read(fd, buf + len, cap - len)) > 0) {\n");
+emit("len = len + n;\n");
+emit("if (len == cap) {\n");
+emit("cap = cap * 2;\n");
+emit("buf = realloc(buf, cap + 1);\n");
+emit("}\n");
+emit("}\n");
 emit("buf[len] = '\\0';\n");
-emit("fclose(f);\n");
+emit("if (fd != 0) close(fd);\n");
 emit("return buf;\n}\n\n");
 emit("void write_file(char* path, char* content) {\n");
 emit("FILE* f = fopen(path, \"w\");\n");
 emit("if (!f) return;\n");
 emit("fprintf(f, \"%s\", content);\n");
-emit("fclose(f);\n}\n");
+emit("fclose(f);\n}\n\n");
+emit("int open_output(char* path) {\n");
+emit("if (strcmp(path, \"-\") == 0) return 1;\n");
+emit("return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);\n}\n\n");
+emit("int write_chars(int fd, char* buf, int len) {\n");
+emit("int done = 0;\n");
+emit("while (done < len) {\n");
+emit("ssize_t n = write(fd, buf + done, len - done);\n");
+emit("if (n <= 0) return -1;\n");
+emit("done = done + n;\n");
+emit("}\n");
+emit("return done;\n}\n\n");
+emit("void copy_chars(char* dst, char* src, int len) {\n");
+emit("memcpy(dst, src, len);\n}\n\n");
+emit("static FILE* cc_pipe = NULL;\n\n");
+emit("int open_cc(char* cmd) {\n");
+emit("signal(SIGPIPE, SIG_IGN);\n");
+emit("fflush(stdout);\n");
+emit("cc_pipe = popen(cmd, \"w\");\n");
+emit("return cc_pipe ? fileno(cc_pipe) : -1;\n}\n\n");
+emit("int close_cc() {\n");
+emit("int status = pclose(cc_pipe);\n");
+emit("return status >= 0 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;\n}\n\n");
+emit("int* shared_ints(int n) {\n");
+emit("int* p = mmap(NULL, (size_t)n * sizeof(int) + 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);\n");
+emit("return p == MAP_FAILED ? NULL : p;\n}\n\n");
+emit("void free_shared(int* p, int n) {\n");
+emit("munmap(p, (size_t)n * sizeof(int) + 1);\n}\n\n");
+emit("int fork_worker() {\n");
+emit("fflush(stdout);\n");
+emit("return fork();\n}\n\n");
+emit("int wait_workers() {\n");
+emit("while (wait(NULL) > 0) {}\n");
+emit("return 0;\n}\n\n");
+emit("void exit_worker() {\n");
+emit("_exit(0);\n}\n");
 return 0;
 }
 int preset_global_functions() {
-add_symbol(1, "concat", "char*");
-add_symbol(1, "ctos", "char*");
-add_symbol(1, "itos", "char*");
-add_symbol(1, "strlen", "int");
-add_symbol(1, "strcmp", "int");
-add_symbol(1, "read_file", "char*");
-add_symbol(1, "write_file", "void");
-return 0;
-}
-int tokenize(char* source_code) {
-int pos = 0;
-int line_num = 1;
-int line_start = 0;
-char buffer[100];
-int i = 0;
-int token_count = 0;
-int pool_pos = 0;
-char c;
-int col;
-int j;
-char token_val;
-int token_start_col;
-while (source_code[pos] != '\0') {
-c = source_code[pos];
-col = pos - line_start;
-i = 0;
-if (token_count >= 50000) {
-printf("%s\n", "CRITICAL ERROR: Too many tokens! Increase token array sizes.");
+add_symbol(1, intern_str("concat"), TY_STR);
+add_symbol(1, intern_str("ctos"), TY_STR);
+add_symbol(1, intern_str("ctoi"), TY_INT);
+add_symbol(1, intern_str("itos"), TY_STR);
+add_symbol(1, intern_str("substr"), TY_STR);
+add_symbol(1, intern_str("grow_strs"), pointer_to(TY_STR));
+add_symbol(1, intern_str("grow_chars"), TY_STR);
+add_symbol(1, intern_str("grow_ints"), pointer_to(TY_INT));
+add_symbol(1, intern_str("skip_spaces"), TY_INT);
+add_symbol(1, intern_str("scan_ident"), TY_INT);
+add_symbol(1, intern_str("scan_line_end"), TY_INT);
+add_symbol(1, intern_str("scan_string_end"), TY_INT);
+add_symbol(1, intern_str("atoi"), TY_INT);
+add_symbol(1, intern_str("strlen"), TY_INT);
+add_symbol(1, intern_str("strcmp"), TY_INT);
+add_symbol(1, intern_str("read_file"), TY_STR);
+add_symbol(1, intern_str("write_file"), TY_VOID);
+add_symbol(1, intern_str("open_output"), TY_INT);
+add_symbol(1, intern_str("write_chars"), TY_INT);
+add_symbol(1, intern_str("copy_chars"), TY_VOID);
+add_symbol(1, intern_str("open_cc"), TY_INT);
+add_symbol(1, intern_str("close_cc"), TY_INT);
+add_symbol(1, intern_str("shared_ints"), pointer_to(TY_INT));
+add_symbol(1, intern_str("free_shared"), TY_VOID);
+add_symbol(1, intern_str("fork_worker"), TY_INT);
+add_symbol(1, intern_str("wait_workers"), TY_INT);
+add_symbol(1, intern_str("exit_worker"), TY_VOID);
 return 0;
 }
-if (pool_pos >= 499000) {
-printf("%s\n", "CRITICAL ERROR: String pool overflow! Increase token_pool size.");
+int lex_init(char* source_code) {
+if (dfa_next == 0) {
+dfa_init();
+}
+source_buf = source_code;
+lex_pos = 0;
+lex_end = 2147483647;
+n_lines = 0;
+lex_failed = 0;
+lex_quiet = 0;
+n_pre = -1;
+pre_pos = 0;
+n_tokens = 0;
+next_rec = 0;
+parser_pos = 0;
 return 0;
 }
+int lex_fill(int count) {
+char* source_code = source_buf;
+int pos = lex_pos;
+int kind = -1;
+int start;
+int len;
+char c;
+int done = 0;
+int* class_of = dfa_class;
+int* next_state = dfa_next;
+int* accept = dfa_accept;
+int* accel_of = dfa_accel;
+int* single = dfa_single;
+int classes = DFA_CLASSES;
+int state;
+int last;
+int to;
+int accel;
+int p;
+if (n_pre >= 0) {
+return fill_from_pre(count);
+}
+while (done < count) {
+kind = -1;
+start = pos;
+while (kind == -1 && lex_failed == 0 && source_code[pos] != '\0' && pos < lex_end) {
+c = source_code[pos];
+start = pos;
 if (is_space(c)) {
-if (c == '\n') {
-line_num = line_num + 1;
-line_start = pos + 1;
+pos = skip_spaces(source_code, pos);
 }
+else {
+kind = single[ctoi(c)];
+if (kind >= 0) {
 pos = pos + 1;
 }
+else if (is_letter(c)) {
+p = scan_ident(source_code, pos + 1);
+kind = check_keywords(source_code + start, p - start);
+if (kind == TK_TYPE) {
+kind = -1;
+}
+else {
+pos = p;
+}
+}
 else if (is_digit(c)) {
-token_start_col = col;
 while (is_digit(c)) {
-buffer[i] = c;
-i = i + 1;
 pos = pos + 1;
 c = source_code[pos];
 }
 if (c == '.') {
-buffer[i] = c;
-i = i + 1;
 pos = pos + 1;
 c = source_code[pos];
 while (is_digit(c)) {
-buffer[i] = c;
-i = i + 1;
 pos = pos + 1;
 c = source_code[pos];
 }
 }
-buffer[i] = '\0';
-token_types[token_count] = "NUMBER";
-token_lines[token_count] = line_num;
-token_cols[token_count] = token_start_col;
-token_values[token_count] = pool_pos;
-j = 0;
-while (j <= i) {
-token_pool[pool_pos] = buffer[j];
-pool_pos = pool_pos + 1;
-j = j + 1;
+kind = TK_NUMBER;
 }
-token_count = token_count + 1;
+if (kind == -1) {
+state = 1;
+last = 0;
+p = start;
+while (state != 0) {
+to = next_state[state * classes + class_of[ctoi(source_code[p])]];
+if (to == state && accel_of[state] != 0) {
+accel = accel_of[state];
+if (accel == 1) {
+p = scan_ident(source_code, p);
 }
-else if (is_letter(c)) {
-token_start_col = col;
-while (is_ident_char(c)) {
-buffer[i] = c;
-i = i + 1;
-pos = pos + 1;
-c = source_code[pos];
+else if (accel == 2) {
+p = scan_line_end(source_code, p);
+}
+else {
+p = scan_string_end(source_code, p);
 }
-buffer[i] = '\0';
-char* tok_type = check_keywords(buffer);
-token_types[token_count] = tok_type;
-token_lines[token_count] = line_num;
-token_cols[token_count] = token_start_col;
-if (strcmp(tok_type, "ID") != 0 && strcmp(tok_type, "TYPE") != 0) {
-token_values[token_count] = -1;
 }
 else {
-token_values[token_count] = pool_pos;
-j = 0;
-while (j <= i) {
-token_pool[pool_pos] = buffer[j];
-pool_pos = pool_pos + 1;
-j = j + 1;
+last = state;
+state = to;
+p = p + 1;
 }
 }
-token_count = token_count + 1;
+kind = accept[last];
+pos = p - 1;
+if (kind < 0) {
+kind = TK_MISMATCH;
+pos = start + 1;
+state = 1;
+p = start;
+while (state != 0) {
+if (accept[state] >= 0) {
+kind = accept[state];
+pos = p;
 }
-else if (c == '=') {
-if (source_code[pos + 1] == '=') {
-add_simple_token(token_count, "EQ", line_num, col);
-token_count = token_count + 1;
-pos = pos + 2;
+state = next_state[state * classes + class_of[ctoi(source_code[p])]];
+p = p + 1;
 }
-else {
-add_simple_token(token_count, "ASSIGN", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
 }
+if (kind == TK_ID) {
+kind = check_keywords(source_code + start, pos - start);
+}
+else if (kind == TK_COMMENT || kind == TK_SKIP || kind == TK_NEWLINE) {
+kind = -1;
 }
-else if (c == '!' && source_code[pos + 1] == '=') {
-add_simple_token(token_count, "NE", line_num, col);
-token_count = token_count + 1;
-pos = pos + 2;
+else if (kind == TK_MISMATCH) {
+if (lex_quiet == 0) {
+if (c == '"') {
+diag_add("Error: Unclosed string literal!");
+add_error();
 }
-else if (c == '>') {
-if (source_code[pos + 1] == '=') {
-add_simple_token(token_count, "GE", line_num, col);
-token_count = token_count + 1;
-pos = pos + 2;
+else if (c == '\'') {
+diag_add("Error: Unclosed or invalid char literal!");
+add_error();
 }
 else {
-add_simple_token(token_count, "GT", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+diag_add("Error: Unexpected character!");
+diag_add(ctos(c));
+add_error();
+}
+}
+kind = -1;
+lex_failed = 1;
+}
+}
+}
+}
+if (kind == -1) {
+kind = TK_EOF;
+start = pos;
 }
+len = pos - start;
+if (kind == TK_STRING || kind == TK_CHAR) {
+start = start + 1;
+len = len - 2;
 }
-else if (c == '<') {
-if (source_code[pos + 1] == '=') {
-add_simple_token(token_count, "LE", line_num, col);
-token_count = token_count + 1;
-pos = pos + 2;
+add_simple_token(next_rec, kind, start, len);
+n_tokens = n_tokens + 1;
+next_rec = next_rec + TOKEN_REC;
+if (next_rec == TOKEN_WINDOW * TOKEN_REC) {
+next_rec = 0;
+}
+done = done + 1;
+if (kind == TK_EOF) {
+done = count;
+}
+}
+lex_pos = pos;
+return kind;
+}
+int fill_from_pre(int count) {
+int done = 0;
+int kind = TK_EOF;
+int packed;
+while (done < count) {
+if (pre_pos < n_pre) {
+packed = pre_recs[pre_pos * TOKEN_REC];
+token_recs[next_rec] = packed;
+token_recs[next_rec + 1] = pre_recs[pre_pos * TOKEN_REC + 1];
+pre_pos = pre_pos + 1;
+kind = packed - (packed / 256) * 256;
 }
 else {
-add_simple_token(token_count, "LT", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+add_simple_token(next_rec, TK_EOF, lex_pos, 0);
+kind = TK_EOF;
+done = count;
+}
+n_tokens = n_tokens + 1;
+next_rec = next_rec + TOKEN_REC;
+if (next_rec == TOKEN_WINDOW * TOKEN_REC) {
+next_rec = 0;
+}
+done = done + 1;
+}
+return kind;
+}
+int lex_chunk(int from, int to, int base) {
+int count = 0;
+int idx;
+int rec;
+int kind = -1;
+lex_pos = from;
+lex_end = to;
+n_tokens = 0;
+next_rec = 0;
+while (kind != TK_EOF) {
+idx = n_tokens;
+kind = lex_fill(TOKEN_WINDOW);
+while (idx < n_tokens) {
+if (tok_kind(idx) != TK_EOF) {
+rec = tok_rec(idx);
+pre_recs[(base + count) * TOKEN_REC] = token_recs[rec];
+pre_recs[(base + count) * TOKEN_REC + 1] = token_recs[rec + 1];
+count = count + 1;
+}
+idx = idx + 1;
+}
+}
+return count;
+}
+int lex_parallel(int jobs) {
+int len = strlen(source_buf);
+int need = jobs * 2 + (len + jobs) * TOKEN_REC;
+int k = 1;
+int p;
+if (jobs < 2) {
+return -1;
 }
+if (need > pre_mem_cap) {
+if (pre_mem_cap > 0) {
+free_shared(pre_mem, pre_mem_cap);
 }
-else if (c == '&' && source_code[pos + 1] == '&') {
-add_simple_token(token_count, "AND", line_num, col);
-token_count = token_count + 1;
-pos = pos + 2;
+pre_mem_cap = 0;
+pre_mem = shared_ints(need);
+if (pre_mem == 0) {
+return -1;
 }
-else if (c == '|' && source_code[pos + 1] == '|') {
-add_simple_token(token_count, "OR", line_num, col);
-token_count = token_count + 1;
-pos = pos + 2;
+pre_mem_cap = need;
+}
+if (jobs + 1 > pre_bounds_cap) {
+pre_bounds_cap = jobs + 1;
+pre_bounds = grow_ints(pre_bounds, pre_bounds_cap);
+if (pre_bounds == 0) {
+pre_bounds_cap = 0;
+return -1;
 }
-else if (c == '/') {
-if (source_code[pos + 1] == '/') {
-while (source_code[pos] != '\n' && source_code[pos] != '\n') {
-pos = pos + 1;
 }
+int* bounds = pre_bounds;
+int* results = pre_mem;
+pre_recs = pre_mem + jobs * 2;
+bounds[0] = 0;
+while (k < jobs) {
+p = (len / jobs) * k;
+if (p < bounds[k - 1]) {
+p = bounds[k - 1];
 }
 else {
-add_simple_token(token_count, "DIV", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+p = scan_line_end(source_buf, p);
+if (source_buf[p] != '\0') {
+p = p + 1;
+}
+}
+bounds[k] = p;
+k = k + 1;
+}
+bounds[jobs] = len;
+lex_quiet = 1;
+k = 0;
+while (k < jobs) {
+p = fork_worker();
+if (p <= 0) {
+results[k * 2] = lex_chunk(bounds[k], bounds[k + 1], bounds[k] + k);
+results[k * 2 + 1] = lex_failed;
+if (p == 0) {
+exit_worker();
+}
+lex_failed = 0;
+}
+k = k + 1;
+}
+wait_workers();
+int total = 0;
+int carry = 0;
+int failed = 0;
+int base;
+int count;
+int i;
+int packed;
+int kind;
+k = 0;
+while (k < jobs) {
+base = bounds[k] + k;
+count = results[k * 2];
+if (carry > bounds[k]) {
+count = 0;
+lex_failed = 0;
+if (carry < bounds[k + 1]) {
+count = lex_chunk(carry, bounds[k + 1], base);
+}
+results[k * 2 + 1] = lex_failed;
+}
+if (results[k * 2 + 1] != 0) {
+failed = 1;
 }
+i = 0;
+while (i < count * TOKEN_REC) {
+pre_recs[total * TOKEN_REC + i] = pre_recs[base * TOKEN_REC + i];
+i = i + 1;
 }
-else if (c == '(') {
-add_simple_token(token_count, "LPAREN", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+total = total + count;
+if (count > 0) {
+packed = pre_recs[(total - 1) * TOKEN_REC];
+kind = packed - (packed / 256) * 256;
+carry = pre_recs[(total - 1) * TOKEN_REC + 1] + packed / 256;
+if (kind == TK_STRING || kind == TK_CHAR) {
+carry = carry + 1;
 }
-else if (c == ')') {
-add_simple_token(token_count, "RPAREN", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
 }
-else if (c == '{') {
-add_simple_token(token_count, "LBRACE", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+k = k + 1;
 }
-else if (c == '}') {
-add_simple_token(token_count, "RBRACE", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+lex_init(source_buf);
+if (failed == 1) {
+return -1;
 }
-else if (c == '[') {
-add_simple_token(token_count, "LSQUARE", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+n_pre = total;
+lex_pos = len;
+return 0;
 }
-else if (c == ']') {
-add_simple_token(token_count, "RSQUARE", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+int lex_only(char* source_code, int repeat, int jobs) {
+if (source_code == 0) {
+printf("%s\n", "Error: Could not read input file.");
+return 1;
 }
-else if (c == '+') {
-add_simple_token(token_count, "PLUS", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+int i = 0;
+int kind;
+int idx;
+int sum = 0;
+while (i < repeat) {
+lex_init(source_code);
+if (jobs > 1) {
+lex_parallel(jobs);
+}
+kind = -1;
+while (kind != TK_EOF) {
+idx = n_tokens;
+kind = lex_fill(TOKEN_WINDOW);
+while (i == repeat - 1 && idx < n_tokens) {
+sum = sum * 31 + tok_kind(idx) + tok_start(idx) + tok_len(idx) * 7;
+sum = sum - (sum / 1000003) * 1000003;
+idx = idx + 1;
 }
-else if (c == '-') {
-add_simple_token(token_count, "MINUS", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
 }
-else if (c == '*') {
-add_simple_token(token_count, "MUL", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+i = i + 1;
 }
-else if (c == ';') {
-add_simple_token(token_count, "SEMICOL", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+printf("%s\n", concat(itos(n_tokens), " tokens"));
+printf("%s\n", concat("checksum ", itos(sum)));
+return 0;
 }
-else if (c == ',') {
-add_simple_token(token_count, "COMMA", line_num, col);
-token_count = token_count + 1;
-pos = pos + 1;
+int parse_only(char* source_code, int repeat) {
+if (source_code == 0) {
+printf("%s\n", "Error: Could not read input file.");
+return 1;
+}
+int i = 0;
+while (i < repeat) {
+compile_reset(source_code);
+while (peek() != TK_EOF) {
+global_decl();
+ast_reset();
 }
-else if (c == '"') {
-token_start_col = col;
-pos = pos + 1;
-c = source_code[pos];
-while (c != '"' && c != '\0') {
-if (c == '\\') {
-buffer[i] = '\\';
 i = i + 1;
-pos = pos + 1;
-c = source_code[pos];
-if (c == 'n') {
-buffer[i] = 'n';
 }
-else if (c == 't') {
-buffer[i] = 't';
+printf("%s\n", concat(itos(n_tokens), " tokens"));
+return 0;
 }
-else if (c == '"') {
-buffer[i] = '"';
+int is_letter(char c) {
+return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c == '_');
 }
-else if (c == '\\') {
-buffer[i] = '\\';
+int is_digit(char c) {
+return c >= '0' && c <= '9';
 }
-else {
-buffer[i] = c;
+int is_space(char c) {
+return (c == ' ') || (c == '\t') || (c == '\n');
 }
+int dfa_init() {
+int i = 0;
+dfa_class = grow_ints(0, 256);
+while (i < 256) {
+if (i < 128) {
+dfa_class[i] = ctoi(DFA_CLASS_OF[i]) - 40;
 }
 else {
-buffer[i] = c;
+dfa_class[i] = ctoi(DFA_CLASS_OF[128]) - 40;
 }
 i = i + 1;
-pos = pos + 1;
-c = source_code[pos];
 }
-if (c == '\0') {
-printf("%s\n", "Error: Unclosed string literal!");
-return 1;
+dfa_next = grow_ints(0, DFA_STATES * DFA_CLASSES);
+i = 0;
+while (i < DFA_STATES * DFA_CLASSES) {
+dfa_next[i] = ctoi(DFA_NEXT[i]) - 40;
+i = i + 1;
 }
-pos = pos + 1;
-buffer[i] = '\0';
-token_types[token_count] = "STRING";
-token_lines[token_count] = line_num;
-token_cols[token_count] = token_start_col;
-token_values[token_count] = pool_pos;
-j = 0;
-while (j <= i) {
-token_pool[pool_pos] = buffer[j];
-pool_pos = pool_pos + 1;
-j = j + 1;
-}
-token_count = token_count + 1;
+dfa_accept = grow_ints(0, DFA_STATES);
+dfa_accel = grow_ints(0, DFA_STATES);
+i = 0;
+while (i < DFA_STATES) {
+dfa_accept[i] = ctoi(DFA_ACCEPT[i]) - 41;
+dfa_accel[i] = ctoi(DFA_ACCEL[i]) - 40;
+i = i + 1;
 }
-else if (c == '\'') {
-token_start_col = col;
-pos = pos + 1;
-c = source_code[pos];
-token_val = c;
-int is_escape = 0;
-if (c == '\\') {
-token_pool[pool_pos] = '\\';
-pool_pos = pool_pos + 1;
-is_escape = 1;
-pos = pos + 1;
-c = source_code[pos];
-if (c == 'n') {
-token_val = 'n';
+int state;
+int k;
+dfa_single = grow_ints(0, 256);
+i = 0;
+while (i < 256) {
+dfa_single[i] = -1;
+state = dfa_next[DFA_CLASSES + dfa_class[i]];
+if (state != 0 && dfa_accept[state] != TK_MISMATCH) {
+k = 0;
+while (k < DFA_CLASSES && dfa_next[state * DFA_CLASSES + k] == 0) {
+k = k + 1;
 }
-else if (c == 't') {
-token_val = 't';
+if (k == DFA_CLASSES) {
+dfa_single[i] = dfa_accept[state];
 }
-else if (c == '\'') {
-token_val = '\'';
 }
-else if (c == '\\') {
-token_val = '\\';
+i = i + 1;
 }
-else {
-token_val = c;
+return 0;
 }
+int check_keywords(char* s, int len) {
+if (len == 2) {
+if (s[0] == 'a') {
+if (s[1] == 'h') {
+return TK_FN;
 }
-pos = pos + 1;
-c = source_code[pos];
-if (c != '\'') {
-printf("%s\n", "Error: Unclosed or invalid char literal!");
-return 1;
 }
-pos = pos + 1;
-buffer[0] = token_val;
-buffer[1] = '\0';
-token_types[token_count] = "CHAR";
-token_lines[token_count] = line_num;
-token_cols[token_count] = token_start_col;
-token_values[token_count] = pool_pos - is_escape;
-token_pool[pool_pos] = buffer[0];
-token_pool[pool_pos + 1] = buffer[1];
-pool_pos = pool_pos + 2;
-token_count = token_count + 1;
+else if (s[0] == 'i') {
+if (s[1] == 'f') {
+return TK_IF;
 }
-else {
-printf("%s\n", concat("Error: Unexpected character!", ctos(c)));
-return 1;
 }
 }
-add_simple_token(token_count, "EOF", line_num, col);
-token_count = token_count + 1;
-n_tokens = token_count;
-return 0;
+else if (len == 3) {
+if (s[0] == 'b') {
+if (s[1] == 'e' && s[2] == 'g') {
+return TK_LET;
 }
-int is_letter(char c) {
-return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c == '_');
+if (s[1] == 'o' && s[2] == 'o') {
+return TK_PRINT;
 }
-int is_digit(char c) {
-return c >= '0' && c <= '9';
 }
-int is_space(char c) {
-return (c == ' ') || (c == '\t') || (c == '\n');
+else if (s[0] == 'i') {
+if (s[1] == 'n' && s[2] == 't') {
+return TK_TYPE;
 }
-int is_ident_char(char c) {
-return is_letter(c) || is_digit(c);
 }
-char* check_keywords(char* s) {
-if (strcmp(s, "ah") == 0) {
-return "FN";
 }
-else if (strcmp(s, "beg") == 0) {
-return "LET";
+else if (len == 4) {
+if (s[0] == 'c') {
+if (s[1] == 'h' && s[2] == 'a' && s[3] == 'r') {
+return TK_TYPE;
 }
-else if (strcmp(s, "boo") == 0) {
-return "PRINT";
 }
-else if (strcmp(s, "if") == 0) {
-return "IF";
+else if (s[0] == 'e') {
+if (s[1] == 'l' && s[2] == 's' && s[3] == 'e') {
+return TK_ELSE;
 }
-else if (strcmp(s, "else") == 0) {
-return "ELSE";
 }
-else if (strcmp(s, "while") == 0) {
-return "WHILE";
+else if (s[0] == 'v') {
+if (s[1] == 'o' && s[2] == 'i' && s[3] == 'd') {
+return TK_TYPE;
 }
-else if (strcmp(s, "return") == 0) {
-return "RETURN";
 }
-else if (strcmp(s, "int*") == 0 || strcmp(s, "char*") == 0 || strcmp(s, "int") == 0 || strcmp(s, "char") == 0 || strcmp(s, "void") == 0) {
-return "TYPE";
 }
-return "ID";
+else if (len == 5) {
+if (s[0] == 'w') {
+if (s[1] == 'h' && s[2] == 'i' && s[3] == 'l' && s[4] == 'e') {
+return TK_WHILE;
+}
+}
+}
+else if (len == 6) {
+if (s[0] == 'r') {
+if (s[1] == 'e' && s[2] == 't' && s[3] == 'u' && s[4] == 'r' && s[5] == 'n') {
+return TK_RETURN;
 }
-int add_simple_token(int index, char* type, int line, int col) {
-token_types[index] = type;
-token_values[index] = -1;
-token_lines[index] = line;
-token_cols[index] = col;
+}
+}
+return TK_ID;
+}
+int add_simple_token(int rec, int type, int start, int len) {
+token_recs[rec] = type + len * 256;
+token_recs[rec + 1] = start;
 return 0;
 }
 
 char* concat(char* str1, char* str2) {
-static char buf[1024];
-snprintf(buf, sizeof(buf), "%s%s", str1, str2);
+size_t len1 = strlen(str1);
+char* buf = malloc(len1 + strlen(str2) + 1);
+memcpy(buf, str1, len1);
+strcpy(buf + len1, str2);
 return buf;
 }
 
+static inline int str_is(char* s, char* lit) {
+return s[0] == lit[0] && (lit[0] == '\0' || strcmp(s + 1, lit + 1) == 0);
+}
+
 char* itos(int x) {
 static char buf[32];
 snprintf(buf, sizeof(buf), "%d", x);
@@ -1427,16 +2849,166 @@ buf[1] = '\0';
 return buf;
 }
 
-char* read_file(char* path) {
-FILE* f = fopen(path, "rb");
-if (!f) return NULL;
-fseek(f, 0, SEEK_END);
-long len = ftell(f);
-fseek(f, 0, SEEK_SET);
+int ctoi(char c) {
+return (unsigned char)c;
+}
+
+char* substr(char* s, int start, int len) {
 char* buf = malloc(len + 1);
-fread(buf, 1, len, f);
+memcpy(buf, s + start, len);
 buf[len] = '\0';
-fclose(f);
+return buf;
+}
+
+char** grow_strs(char** a, int cap) {
+return realloc(a, cap * sizeof(char*));
+}
+
+char* grow_chars(char* a, int cap) {
+return realloc(a, cap);
+}
+
+int* grow_ints(int* a, int cap) {
+return realloc(a, cap * sizeof(int));
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static int scan_level = 0; // 0: scalar, 1: SSE2, 2: AVX2
+
+static inline int scan_stop(char c, int cls) {
+if (cls == 0) return c != ' ' && c != '\t' && c != '\n';
+if (cls == 1) return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_');
+if (cls == 2) return c == '\n' || c == '\0';
+return c == '"' || c == '\\' || c == '\0';
+}
+
+#if defined(__x86_64__)
+static inline __attribute__((always_inline)) unsigned scan_mask_sse2(__m128i v, int cls) {
+if (cls == 0) return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')))) & 0xFFFF;
+if (cls == 1) {
+__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), v));
+__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));
+__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+__m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(lower, upper), _mm_or_si128(digit, under))) & 0xFFFF;
+}
+__m128i stop = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+if (cls == 2) return _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+return _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+}
+
+static inline __attribute__((always_inline)) int scan_sse2(char* s, int pos, int cls) {
+char* p = s + pos;
+char* a = (char*)((size_t)p & ~(size_t)15);
+unsigned mask = scan_mask_sse2(_mm_load_si128((__m128i*)a), cls) & (0xFFFFu << (p - a));
+while (mask == 0) {
+a = a + 16;
+mask = scan_mask_sse2(_mm_load_si128((__m128i*)a), cls);
+}
+return (int)(a - s) + __builtin_ctz(mask);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline unsigned scan_mask_avx2(__m256i v, int cls) {
+if (cls == 0) return ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+if (cls == 1) {
+__m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+__m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+__m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+return ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(lower, upper), _mm256_or_si256(digit, under)));
+}
+__m256i stop = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+if (cls == 2) return _mm256_movemask_epi8(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+return _mm256_movemask_epi8(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))));
+}
+
+__attribute__((target("avx2")))
+static int scan_avx2(char* s, int pos, int cls) {
+char* p = s + pos;
+char* a = (char*)((size_t)p & ~(size_t)31);
+unsigned mask = scan_mask_avx2(_mm256_load_si256((__m256i*)a), cls) & (0xFFFFFFFFu << (p - a));
+while (mask == 0) {
+a = a + 32;
+mask = scan_mask_avx2(_mm256_load_si256((__m256i*)a), cls);
+}
+return (int)(a - s) + __builtin_ctz(mask);
+}
+
+#endif
+
+static inline __attribute__((always_inline)) int scan(char* s, int pos, int cls) {
+// Short runs are the common case, check two bytes before going wide
+if (scan_stop(s[pos], cls)) return pos;
+if (scan_stop(s[pos + 1], cls)) return pos + 1;
+#if defined(__x86_64__)
+if (scan_level == 2) return scan_avx2(s, pos + 2, cls);
+if (scan_level == 1) return scan_sse2(s, pos + 2, cls);
+#endif
+while (!scan_stop(s[pos], cls)) pos++;
+return pos;
+}
+
+__attribute__((constructor))
+static void scan_init(void) {
+#if defined(__x86_64__)
+scan_level = __builtin_cpu_supports("avx2") ? 2 : 1;
+#endif
+if (getenv("DAV_SCALAR_LEX")) scan_level = 0;
+}
+
+int skip_spaces(char* s, int pos) {
+return scan(s, pos, 0);
+}
+
+int scan_ident(char* s, int pos) {
+return scan(s, pos, 1);
+}
+
+int scan_line_end(char* s, int pos) {
+return scan(s, pos, 2);
+}
+
+int scan_string_end(char* s, int pos) {
+return scan(s, pos, 3);
+}
+
+char* read_file(char* path) {
+int fd = strcmp(path, "-") == 0 ? 0 : open(path, O_RDONLY);
+if (fd < 0) return NULL;
+struct stat st;
+if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+size_t len = st.st_size;
+size_t page = sysconf(_SC_PAGESIZE);
+size_t span = (len / page + 1) * page;
+char* buf = mmap(NULL, span, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+if (buf != MAP_FAILED) {
+if (mmap(buf, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {
+madvise(buf, len, MADV_SEQUENTIAL);
+close(fd);
+return buf;
+}
+munmap(buf, span);
+}
+}
+size_t cap = 65536;
+size_t len = 0;
+ssize_t n;
+char* buf = malloc(cap + 1);
+while ((n = read(fd, buf + len, cap - len)) > 0) {
+len = len + n;
+if (len == cap) {
+cap = cap * 2;
+buf = realloc(buf, cap + 1);
+}
+}
+buf[len] = '\0';
+if (fd != 0) close(fd);
 return buf;
 }
 
@@ -1446,3 +3018,59 @@ if (!f) return;
 fprintf(f, "%s", content);
 fclose(f);
 }
+
+int open_output(char* path) {
+if (strcmp(path, "-") == 0) return 1;
+return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+int write_chars(int fd, char* buf, int len) {
+int done = 0;
+while (done < len) {
+ssize_t n = write(fd, buf + done, len - done);
+if (n <= 0) return -1;
+done = done + n;
+}
+return done;
+}
+
+void copy_chars(char* dst, char* src, int len) {
+memcpy(dst, src, len);
+}
+
+static FILE* cc_pipe = NULL;
+
+int open_cc(char* cmd) {
+signal(SIGPIPE, SIG_IGN);
+fflush(stdout);
+cc_pipe = popen(cmd, "w");
+return cc_pipe ? fileno(cc_pipe) : -1;
+}
+
+int close_cc() {
+int status = pclose(cc_pipe);
+return status >= 0 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int* shared_ints(int n) {
+int* p = mmap(NULL, (size_t)n * sizeof(int) + 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+return p == MAP_FAILED ? NULL : p;
+}
+
+void free_shared(int* p, int n) {
+munmap(p, (size_t)n * sizeof(int) + 1);
+}
+
+int fork_worker() {
+fflush(stdout);
+return fork();
+}
+
+int wait_workers() {
+while (wait(NULL) > 0) {}
+return 0;
+}
+
+void exit_worker() {
+_exit(0);
+}
@@ -5,9 +5,16 @@ Description: testing for lexer
 Reference: https://docs.python.org/3/library/re.html#writing-a-tokenizer
 """
 
+import os
+import sys
+import time
 import unittest
-from python.lexer.custom_token import Token
-from python.lexer.lexer import tokenize
+from python.lexer.custom_token import Token, KEYWORDS, KIND_NAMES
+from python.lexer.lexer import tokenize, tokenize_arrays, tokenize_fast
+from python.lexer.gen_keywords import gen_check_keywords, splice
+from python.lexer import gen_dfa
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
 
 
 class TokenizerTest(unittest.TestCase):
@@ -60,13 +67,14 @@ class TokenizerTest(unittest.TestCase):
 
     def test_type_tokens(self):
         """Tests that type keywords are correctly tokenized."""
-        code = "int char char* int*"
+        code = "int char char* int* char**"
         expected = [
             Token('TYPE', 'int', 1, 0),
             Token('TYPE', 'char', 1, 4),
             Token('TYPE', 'char*', 1, 9),
             Token('TYPE', 'int*', 1, 15),
-            Token('EOF', None, 1, 19)
+            Token('TYPE', 'char**', 1, 20),
+            Token('EOF', None, 1, 26)
         ]
         self.assertTokensEqual(tokenize(code), expected)
 
@@ -250,6 +258,109 @@ class TokenizerTest(unittest.TestCase):
         ]
         self.assertTokensEqual(tokenize(code), expected)
 
+    def test_longest_match(self):
+        """Tests that the longest match wins over pattern order."""
+        code = "integer chars int*p x!=y"
+        expected = [
+            Token('ID', 'integer', 1, 0),
+            Token('ID', 'chars', 1, 8),
+            Token('TYPE', 'int*', 1, 14),
+            Token('ID', 'p', 1, 18),
+            Token('ID', 'x', 1, 20),
+            Token('NE', '!=', 1, 21),
+            Token('ID', 'y', 1, 23),
+            Token('EOF', None, 1, 24)
+        ]
+        self.assertTokensEqual(tokenize(code), expected)
+
+    def test_unclosed_string_error(self):
+        """Tests that an unclosed string falls back to a mismatch on the quote."""
+        code = 'x = 1\ns = "abc;'
+        with self.assertRaisesRegex(SyntaxError, r"Unexpected character '\"' on line 2"):
+            tokenize(code)
+
+    def test_every_keyword_is_classified(self):
+        """Tests that every entry in KEYWORDS lexes to its kind."""
+        for word, kind in KEYWORDS.items():
+            self.assertEqual(tokenize(word)[0].type, kind)
+
+    def test_stage1_keywords_in_sync(self):
+        """Tests that stage1's check_keywords() is generated from KEYWORDS."""
+        path = os.path.join(ROOT, 'stage1_compiler.dav')
+        with open(path) as f:
+            source = f.read()
+        self.assertEqual(splice(source, gen_check_keywords()), source,
+                         'run: python3 -m python.lexer.gen_keywords stage1_compiler.dav')
+
+    def test_dfa_tables_in_sync(self):
+        """Tests that both lexers' DFA tables are generated from TOKEN_SPEC."""
+        path = os.path.join(ROOT, 'stage1_compiler.dav')
+        with open(path) as f:
+            source = f.read()
+        with open(gen_dfa.PY_TABLE) as f:
+            table = f.read()
+        self.assertEqual(gen_dfa.generate(source), (table, source),
+                         'run: python3 -m python.lexer.gen_dfa stage1_compiler.dav')
+
+
+class FastTokenizerTest(unittest.TestCase):
+
+    SAMPLES = [
+        "",
+        "x = 10 ;",
+        "beg x = 1\nif x == 1 {\n\tboo x}\n\n",
+        "ah char** f(int* a, char c) { return \"a\\\"b\\n\"; } // end",
+        "c = '\\n' + 'x' - 45.6 * 78. / integer",
+        "a >= b && c <= d || e[f] != g // comment\n  y",
+    ]
+
+    def test_same_tokens(self):
+        """Tests that the fast mode produces exactly the tokens of tokenize()."""
+        for code in self.SAMPLES:
+            self.assertEqual(tokenize_fast(code), tokenize(code), code)
+
+    def test_arrays(self):
+        """Tests that the parallel arrays hold int kinds."""
+        kinds, values, lines, columns = tokenize_arrays("beg x = 1\n  y")
+        self.assertEqual([KIND_NAMES[k] for k in kinds],
+                         ['LET', 'ID', 'ASSIGN', 'NUMBER', 'ID', 'EOF'])
+        self.assertEqual(values, ['beg', 'x', '=', 1, 'y', None])
+        self.assertEqual(lines, [1, 1, 1, 1, 2, 2])
+        self.assertEqual(columns, [0, 4, 6, 8, 2, 3])
+
+    def test_same_errors(self):
+        """Tests that the fast mode raises the errors of tokenize()."""
+        for code in ["x = $ 10", "x = 10\n y @ 20", 's = "abc;', "c = 'ab';"]:
+            with self.assertRaises(SyntaxError) as slow:
+                tokenize(code)
+            with self.assertRaises(SyntaxError) as fast:
+                tokenize_fast(code)
+            self.assertEqual(str(fast.exception), str(slow.exception))
+
+    def test_timing_stage1_source(self):
+        """Compares the modes on stage1_compiler.dav, the stage0 bootstrap input.
+        Timings are only reported: wall-clock comparisons are too noisy to assert."""
+        with open(os.path.join(ROOT, 'stage1_compiler.dav')) as f:
+            code = f.read()
+        self.assertEqual(tokenize_fast(code), tokenize(code))
+        self.assertEqual([KIND_NAMES[k] for k in tokenize_arrays(code)[0]],
+                         [t.type for t in tokenize(code)])
+
+        def best_of(fn, runs=3):
+            best = float('inf')
+            for _ in range(runs):
+                start = time.perf_counter()
+                fn(code)
+                best = min(best, time.perf_counter() - start)
+            return best
+
+        slow = best_of(tokenize)
+        arrays = best_of(tokenize_arrays)
+        fast = best_of(tokenize_fast)
+        print(f'\n[timing] stage1_compiler.dav: tokenize {slow * 1000:.1f} ms, '
+              f'tokenize_fast {fast * 1000:.1f} ms, '
+              f'tokenize_arrays {arrays * 1000:.1f} ms', file=sys.stderr)
+
 
 if __name__ == '__main__':
     unittest.main()
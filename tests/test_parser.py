@@ -402,6 +402,42 @@ class TestParser(unittest.TestCase):
         parser.variables = {'s1': 'char*'}
         self.assertEqual(parser.expr(), ('char*', 'concat(s1, " world")'))
 
+    def test_same_level_operators_left_associative(self):
+        # s1 + " " + s2 == s1
+        tokens = [
+            ('ID', 's1', 1, 0), ('PLUS', '+', 1, 0), ('STRING', '" "', 1, 0),
+            ('PLUS', '+', 1, 0), ('ID', 's2', 1, 0),
+            ('EQ', '==', 1, 0), ('ID', 's1', 1, 0),
+            ('SEMICOL', ';', 1, 0)
+        ]
+        parser = Parser(tokens)
+        parser.variables = {'s1': 'char*', 's2': 'char*'}
+        self.assertEqual(parser.expr(), (
+            'int', 'strcmp(concat(concat(s1, " "), s2), s1) == 0'))
+
+    def test_string_literal_equality(self):
+        # "FN" != tok
+        tokens = [
+            ('STRING', '"FN"', 1, 0), ('NE', '!=', 1, 0), ('ID', 'tok', 1, 0),
+            ('SEMICOL', ';', 1, 0)
+        ]
+        parser = Parser(tokens)
+        parser.variables = {'tok': 'char*'}
+        self.assertEqual(parser.expr(), ('int', '!str_is(tok, "FN")'))
+
+    def test_c_precedence_levels(self):
+        # 0 || s1 == s2 && 1 < 2, grouped as in C
+        tokens = [
+            ('NUMBER', '0', 1, 0), ('OR', '||', 1, 0),
+            ('ID', 's1', 1, 0), ('EQ', '==', 1, 0), ('ID', 's2', 1, 0),
+            ('AND', '&&', 1, 0), ('NUMBER', '1', 1, 0), ('LT', '<', 1, 0),
+            ('NUMBER', '2', 1, 0), ('SEMICOL', ';', 1, 0)
+        ]
+        parser = Parser(tokens)
+        parser.variables = {'s1': 'char*', 's2': 'char*'}
+        self.assertEqual(parser.expr(), (
+            'int', '0 || strcmp(s1, s2) == 0 && 1 < 2'))
+
     def test_pointer_arithmetic_expr(self):
         """Tests that pointer + int arithmetic IS allowed."""
         tokens = [
@@ -756,6 +792,39 @@ class TestParser(unittest.TestCase):
         )
         self.assertEqual(parser.statement(), expected_code)
 
+    def test_block_scoped_declarations(self):
+        # if (x == 1) { beg int t = 1; } else { beg char* t = "a"; } t = 2;
+        tokens = [
+            ('IF', 'if', 1, 4), ('ID', 'x', 1, 4), ('EQ', '==', 1, 4),
+            ('NUMBER', 1, 1, 4), ('LBRACE', '{', 1, 4),
+            ('LET', 'beg', 2, 8), ('TYPE', 'int', 2, 8), ('ID', 't', 2, 8),
+            ('ASSIGN', '=', 2, 8), ('NUMBER', 1, 2, 8), ('SEMICOL', ';', 2, 8),
+            ('RBRACE', '}', 3, 4), ('ELSE', 'else', 3, 4), ('LBRACE', '{', 3, 4),
+            ('LET', 'beg', 4, 8), ('TYPE', 'char*', 4, 8), ('ID', 't', 4, 8),
+            ('ASSIGN', '=', 4, 8), ('STRING', '"a"', 4, 8), ('SEMICOL', ';', 4, 8),
+            ('RBRACE', '}', 5, 4),
+            ('ID', 't', 6, 4), ('ASSIGN', '=', 6, 4), ('NUMBER', 2, 6, 4),
+            ('SEMICOL', ';', 6, 4)
+        ]
+        parser = Parser(tokens)
+        parser.variables = {'x': 'int'}
+
+        # Sibling blocks may declare the same name with different types
+        expected_code = (
+            'if (x == 1) {\n'
+            '        int t = 1;\n'
+            '    } else {\n'
+            '        char* t = "a";\n'
+            '    }'
+        )
+        self.assertEqual(parser.statement(), expected_code)
+        self.assertEqual(parser.variables, {'x': 'int'})
+
+        # Neither is visible after the if
+        with self.assertRaises(SyntaxError) as cm:
+            parser.statement()
+        self.assertIn("Undeclared identifier, t", str(cm.exception))
+
 
 if __name__ == '__main__':
     unittest.main()
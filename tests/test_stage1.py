@@ -0,0 +1,109 @@
+"""
+File: test_stage1.py
+Description: testing for the stage1 compiler binary, built from the
+checked-in stage1a_compiler.c
+"""
+
+import os
+import re
+import shutil
+import subprocess
+import tempfile
+import unittest
+from python.lexer.lexer import tokenize_fast
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+@unittest.skipIf(shutil.which('gcc') is None, 'needs gcc')
+class Stage1Test(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmp = tempfile.mkdtemp()
+        cls.stage1 = os.path.join(cls.tmp, 'stage1')
+        subprocess.run(['gcc', '-w', os.path.join(ROOT, 'stage1a_compiler.c'),
+                        '-o', cls.stage1], check=True)
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.tmp)
+
+    def compile(self, code):
+        """Helper to run stage1 on 'code'; returns (returncode, output)."""
+        path = os.path.join(self.tmp, 'in.dav')
+        with open(path, 'w') as f:
+            f.write(code)
+        result = subprocess.run([self.stage1, path, os.path.join(self.tmp, 'out.c')],
+                                capture_output=True, text=True)
+        return result.returncode, result.stdout + result.stderr
+
+    def test_lex_same_tokens_as_stage0(self):
+        """Tests that stage1 --lex, serial and parallel, gives the kinds and
+        spans of tokenize_fast() on stage1_compiler.dav."""
+        path = os.path.join(ROOT, 'stage1_compiler.dav')
+        with open(path, encoding='latin-1') as f:
+            code = f.read()
+        tk = {name: int(n) for name, n in re.findall(r'beg int TK_(\w+) = (\d+);', code)}
+        line_starts = [0] + [m.end() for m in re.finditer('\n', code)]
+
+        # Same checksum as lex_only(); stage1 drops comments
+        tokens = [t for t in tokenize_fast(code) if t.type != 'COMMENT']
+        total = 0
+        for t in tokens:
+            start = line_starts[t.line - 1] + t.column
+            if t.type == 'NUMBER':
+                length = re.compile(r'\d+(\.\d*)?').match(code, start).end() - start
+            else:
+                length = len(t.value or '')
+            if t.type in ('STRING', 'CHAR'):
+                # stage1 keeps the span between the quotes
+                start, length = start + 1, length - 2
+            total = (total * 31 + tk[t.type] + start + length * 7) % 1000003
+
+        expected = f'{len(tokens)} tokens\nchecksum {total}\n'
+        for jobs in ['1', '4']:
+            result = subprocess.run([self.stage1, '--lex', path, '1', jobs],
+                                    capture_output=True, text=True, check=True)
+            self.assertEqual(result.stdout, expected, 'jobs ' + jobs)
+
+    def test_stage0_output_warning_free(self):
+        """Tests that the checked-in stage0 output builds under gcc -Wall."""
+        result = subprocess.run(['gcc', '-Wall', '-fsyntax-only',
+                                 os.path.join(ROOT, 'stage1_compiler.c')],
+                                capture_output=True, text=True)
+        self.assertEqual(result.stderr, '')
+
+    def run_program(self, code):
+        """Helper to compile 'code' with stage1 and gcc; returns its output."""
+        rc, out = self.compile(code)
+        self.assertEqual(rc, 0, out)
+        exe = os.path.join(self.tmp, 'out')
+        subprocess.run(['gcc', '-w', os.path.join(self.tmp, 'out.c'), '-o', exe], check=True)
+        return subprocess.run([exe], capture_output=True, text=True, check=True).stdout
+
+    def test_c_precedence_levels(self):
+        """Tests that || && == < group as in C, so strings compare with strcmp."""
+        out = self.run_program('ah int main() {\n'
+                               '    beg char* s = "ab";\n'
+                               '    beg char* t = "a" + "b";\n'
+                               '    boo(0 || s == t && 1 < 2);\n'
+                               '    return 0;\n'
+                               '}\n')
+        self.assertEqual(out, '1\n')
+
+    def test_bad_decl_after_token_window(self):
+        """Tests that a missing name or size far into the file is a syntax error."""
+        prefix = ''.join(f'ah int f{i}(int a) {{ return a + {i}; }}\n' for i in range(300))
+        for bad, got in [('ah int (int q) { return q; }', 'LPAREN'),
+                         ('ah int g(int a, int) { return a; }', 'RPAREN'),
+                         ('ah int main() { beg int 5 = 3; return 0; }', 'NUMBER'),
+                         ('ah int main() { beg int x[y]; return 0; }', 'ID')]:
+            rc, out = self.compile(prefix + bad + '\n')
+            self.assertEqual(rc, 1, bad)
+            self.assertIn('Syntax Error on line 301', out)
+            self.assertIn('but got token: ' + got, out)
+
+
+if __name__ == '__main__':
+    unittest.main()